@@ -37,21 +37,14 @@ ldc r8 $0
 
 ; prepare arguments for function
 ; save needed registers on stack
-push r5
-push r6
-push r7
-push r8
-push r0
+pushm r0 r5 r6 r7 r8
 
 ; prepare arguments for function
+mov r2 r0 ; vram offset
 mov r0 r7 ; counter on y
 mov r1 r8 ; counter on x
-pop r2   ; vram offset
-push r2
 
-push r0
-push r1
-push r2
+pushm r0 r1 r2
 
 ; move center of circle to the center of screen
 ldc r3 $2
@@ -64,18 +57,12 @@ call .circle_equation
 
 ; circle_equation returns color of circle point
 mov r3 r0
-pop r2
-pop r1
-pop r0
+popm r0 r1 r2
 
 ; plot the point
 call .point_on_idx
 
-pop r0
-pop r8
-pop r7
-pop r6
-pop r5
+popm r0 r5 r6 r7 r8
 
 ;increment counters
 
@@ -98,12 +85,7 @@ mul r1 r1 r1 	; y^2
 add r0 r1 r0 	; x^2 + y^2
 ldc r1 $32   	; r^2
 cmp r0 r1	; x^2 + y^2 <= r^2
-jmp.gt .circle_zero
-ldc r0 $1	; yes - return 1
-jmp .circle_ret
-.circle_zero:
-ldc r0 $0	; no - return 0
-.circle_ret:
+set.leq r0	; 1 if yes, 0 if no
 ret
 
 
@@ -113,43 +95,17 @@ scrhw r5 r6
 print r5
 print r6
 
-ldc r7 $0
-.cycle1:
-
-ldc r8 $0
-.cycle2:
-
-push r5
-push r6
-push r7
-push r8
-push r0
-
-mov r0 r7
-mov r1 r8
-pop r2	; vram offset
-push r2
-ldc r3 $0
-call .point_on_idx
-
-pop r0
-pop r8
-pop r7
-pop r6
-pop r5
-
-ldc r9 $1
-add r8 r8 r9
-cmp r8 r5
-jmp.lt .cycle2
-
-add r7 r7 r9
-cmp r7 r6
-jmp.lt .cycle1
+; Every color is a byte, r5 = number of words of the screen
+mul r5 r5 r6
+addi r5 $7
+shri r5 $3
+ldc r6 $0
+mset r0 r6 r5
 
 ret
 
 ; r0 = ypos, r1 = xpos, r2 = mem_base_addr, r3 (character) = point_data, 
+.inline .point_on_idx
 .point_on_idx:
 ; r5 = height
 scrhw r5 r6
@@ -157,37 +113,9 @@ scrhw r5 r6
 mul r5 r5 r0
 ; r5 = height * ypos + xpos
 add r5 r5 r1
-ldc r6 $3
-; r6 = r5 >> 3
-; r6 = r5 / 8
-; In fact, r6 now stores address in memory
-; Of the 8-byte word with 8 colors
-shr r6 r5 r6
-; Add base memory address for indexing
-add r6 r6 r2
-; r7 = ram[r6]
-ldm r6 r7
-ldc r8 $0x07
-; r8 = r5 % 8
-; Index inside the 8-byte word with 8 colors
-and r8 r5 r8
-ldc r9 $3
-; r8 = r8 * 8
-shl r8 r8 r9
-; r9 = mask for 8-bit color
-ldc r9 $0xff
-; shift mask to the color position
-shl r9 r9 r8
-not r9 r9
-; clear out old color in 8-byte word with mask
-and r7 r7 r9
-; shift the new color
-shl r3 r3 r8
-; mask out the new color
-not r9 r9
-and r3 r3 r9
-; put new color in old colors word
-or r7 r3 r7
+; Every color is a byte, r6 = byte address of the memory
+mov r6 r2
+shli r6 $3
 ; write new color to memory
-stm r6 r7
+stb r6 r3 r5
 ret
@@ -0,0 +1,32 @@
+; Solves a * x ^ 2 + b * x + c = 0 in doubles
+finput r0	; a
+finput r1	; b
+finput r2	; c
+
+fmul r3 r1 r1	; b ^ 2
+ldc.f r4 $4	; 4
+fmul r4 r4 r0	; 4 * a
+fmul r4 r4 r2	; 4 * a * c
+fsub r3 r3 r4	; b ^ 2 - 4 * a * c
+
+; Tests for negative discriminant
+ldc.f r6 $0
+fcmp r3 r6
+jmp.lt .no_solutions
+
+fsqrt r3 r3	; sqrt (D)
+fsub r4 r6 r1	; -b
+ldc.f r6 $2	; 2
+fmul r6 r0 r6	; 2 * a
+fsub r5 r4 r3	; -b - sqrt(D)
+fdiv r5 r5 r6	; (-b - sqrt(D)) / (2 * a)
+fprint r5
+fadd r5 r4 r3	; -b + sqrt(D)
+fdiv r5 r5 r6	; (-b + sqrt(D)) / (2 * a)
+fprint r5
+halt
+
+.no_solutions:
+ldc r6 $0
+print r6
+halt
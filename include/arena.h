@@ -0,0 +1,30 @@
+/**
+ * @file
+ *
+ * @brief Bump allocator
+ *
+ * Memory is carved sequentially from large blocks and is released
+ * all at once when the arena is destroyed.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_DEFAULT_BLOCK_SIZE (1 << 20)
+#define ARENA_ALIGNMENT (16)
+
+struct arena_block;
+
+struct arena {
+	struct arena_block *head;
+	size_t block_size;
+};
+
+int arena_init(struct arena *arena, size_t block_size);
+void *arena_alloc(struct arena *arena, size_t size);
+void *arena_calloc(struct arena *arena, size_t n_el, size_t el_size);
+int arena_destroy(struct arena *arena);
+
+#endif /* ARENA_H */
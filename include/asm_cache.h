@@ -0,0 +1,46 @@
+/**
+ * @file
+ *
+ * @brief On-disk cache of assembled objects
+ *
+ * Objects are stored in the cache directory under the hash of
+ * the source text and of the options affecting the output, so
+ * an unchanged source is never assembled twice. Sources split
+ * into several objects and linked with spu-ld are reassembled
+ * only where they changed.
+ */
+
+#ifndef ASM_CACHE_H
+#define ASM_CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Bump when the translator output changes for the same source,
+// changes of the instruction table are caught by the key anyway
+#define ASM_CACHE_VERSION (2)
+
+struct asm_cache {
+	const char *dir;
+	uint64_t key;
+
+	char *path;
+	char *tmp_path;
+
+	// Stream of the entry being stored, NULL if there is none
+	FILE *tmp_stream;
+};
+
+uint64_t asm_cache_hash(const char *text, size_t len, uint64_t salt);
+
+int asm_cache_init(struct asm_cache *cache, const char *dir, uint64_t key);
+int asm_cache_fetch(struct asm_cache *cache, FILE *out_stream, int *hit);
+
+FILE *asm_cache_store_begin(struct asm_cache *cache);
+int asm_cache_store_commit(struct asm_cache *cache);
+void asm_cache_store_abort(struct asm_cache *cache);
+
+void asm_cache_destroy(struct asm_cache *cache);
+
+#endif /* ASM_CACHE_H */
@@ -0,0 +1,35 @@
+/**
+ * @file
+ *
+ * @brief Assembler directives
+ *
+ * Directives start with the point like labels, but do not end
+ * with the colon:
+ *
+ * ```
+ * .data		; following labels and data go to the data section
+ * .text		; following labels and instructions go to the code section
+ * .global .label	; the label is visible to other objects
+ * .inline .label	; calls of the subroutine are inlined with -O
+ * .word $1 $0x10	; puts 64-bit words into the data section
+ * .zero $16		; puts zero words into the data section
+ * .jtable .l0 .l1	; puts code addresses of the labels into the data section
+ * ```
+ */
+
+#ifndef ASM_DIRECTIVES_H
+#define ASM_DIRECTIVES_H
+
+#include "spu_asm.h"
+
+typedef int (*asm_directive_fn)(struct asm_instruction *asm_instr);
+
+struct asm_directive {
+	const char *name;
+	asm_directive_fn fn;
+};
+
+const struct asm_directive *find_asm_directive(const struct asm_token *tok);
+int asm_section_directive(const struct asm_token *tok);
+
+#endif /* ASM_DIRECTIVES_H */
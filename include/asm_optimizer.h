@@ -0,0 +1,27 @@
+/**
+ * @file
+ *
+ * @brief Optimization passes of the assembler
+ *
+ * Passes work on the whole program IR after all labels are merged,
+ * before jumps are resolved and instructions are encoded.
+ * Removed and inlined instructions shift the code labels, so jumps
+ * are resolved against the optimized layout, and the IR may be
+ * replaced by a bigger one. Offsets of long jumps are read from
+ * the merged constant pool.
+ *
+ * The profile of the unoptimized program, if there is one, decides
+ * which calls are worth inlining and which paths should fall through.
+ */
+
+#ifndef ASM_OPTIMIZER_H
+#define ASM_OPTIMIZER_H
+
+#include "translator.h"
+#include "spu_profile.h"
+
+int asm_optimize(struct arena *arena, struct asm_ir_instr **ir, size_t *n_ir,
+		 struct label_table *labels, const spu_data_t *consts, size_t n_consts,
+		 const struct spu_profile *profile);
+
+#endif /* ASM_OPTIMIZER_H */
@@ -0,0 +1,20 @@
+/**
+ * @file
+ *
+ * @brief Read-only memory mapping of host files
+ */
+
+#ifndef FILE_MAP_H
+#define FILE_MAP_H
+
+#include <stddef.h>
+
+struct file_map {
+	const char *data;
+	size_t len;
+};
+
+int file_map_open(struct file_map *map, const char *filename);
+int file_map_close(struct file_map *map);
+
+#endif /* FILE_MAP_H */
@@ -2,7 +2,19 @@
 #define OPL_JMP_H
 
 #include "spu_asm.h"
+#include "translator.h"
 
+int intern_label(struct label_table *table, struct arena *arena,
+		 const char *name, size_t len, uint32_t *label_id);
+int parse_label_ref(const struct asm_instruction *asm_instr,
+		    const struct asm_token *label_tok);
+int parse_jmp_condition(const struct asm_instruction *asm_instr,
+			spu_register_num_t *jmp_condition);
+const char *jmp_condition_name(uint32_t condition);
+int push_pool_constant(struct translating_context *ctx,
+		       int64_t value, int32_t *index);
 int process_label(struct asm_instruction *asm_instr);
+int resolve_label_refs(struct asm_ir_instr *ir, size_t n_ir, size_t base,
+		       const struct label_table *labels, struct pvector *relocs);
 
 #endif /* OPL_JMP_H */
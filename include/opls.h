@@ -49,11 +49,11 @@ static int opl_##name##_parse_asm(const struct asm_instruction *asm_instr,	\
 										\
 	int ret = S_OK;								\
 										\
-	__VA_ARGS__								\
-										\
 	instr_data->layout = &opl_##name;					\
 	instr_data->opcode = asm_instr->op_cmd->opcode;				\
 										\
+	__VA_ARGS__								\
+										\
 _CT_EXIT_POINT:									\
 	return ret;								\
 }										\
@@ -9,9 +9,15 @@
 
 #include "spu_asm.h"
 #include "pvector.h"
+#include "spu_profile.h"
+#include "spu_vector.h"
+#include "spu_io.h"
 
 #define RET_STACK_MAX_SIZE (1024)
 #define RAM_SIZE (1048576)
+// Host files are mapped into the RAM by pages of this many words
+#define RAM_PAGE_WORDS (512)
+#define RAM_N_PAGES (RAM_SIZE / RAM_PAGE_WORDS)
 
 #define SCREEN_HEIGHT (15)
 #define SCREEN_WIDTH (15)
@@ -27,8 +33,21 @@ struct spu_context {
 	struct pvector stack;
 	struct pvector call_stack;
 	int64_t *ram;
+	// Bit per RAM page mapped read-only by SPUMapFile
+	uint64_t ro_pages[RAM_N_PAGES / 64];
+	size_t n_ro_pages;
+	// Constant pool of the program, read by ldk
+	spu_data_t *consts;
+	size_t n_consts;
+	// Number of elements of vector operations, set by vlen
+	uint64_t vlen;
+	const struct spu_vec_kernels *vec_kernels;
 	uint64_t screen_height;
 	uint64_t screen_width;
+	// Collected while executing if not NULL
+	struct spu_profile *profile;
+	// Buffers of print and input, flushed when the program stops
+	struct spu_io io;
 };
 
 
@@ -40,6 +59,28 @@ int SPUDtor(struct spu_context *ctx);
 	SPUCtor(&varName);
 
 int SPULoadBinary(struct spu_context *ctx, const char *filename);
+int SPUMapFile(struct spu_context *ctx, const char *filename,
+	       size_t addr, int readonly);
+
+/**
+ * Tells if the words [idx, idx + len) of the RAM may be written,
+ * the bounds are checked by the caller.
+ */
+static inline int spu_ram_writable(const struct spu_context *ctx,
+				   size_t idx, size_t len) {
+	if (!ctx->n_ro_pages || len == 0) {
+		return 1;
+	}
+
+	for (size_t page = idx / RAM_PAGE_WORDS;
+	     page <= (idx + len - 1) / RAM_PAGE_WORDS; page++) {
+		if (ctx->ro_pages[page / 64] & ((uint64_t)1 << (page % 64))) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
 
 int SPUDump(struct spu_context *ctx, FILE *out_stream);
 
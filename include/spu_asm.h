@@ -70,8 +70,8 @@
 /// The SPU will be little-endian
 #define SPU_BYTEORDER __LITTLE_ENDIAN
 
-// For internal use
-#define MAX_INSTR_ARGS (16)
+// For internal use, the mnemonic and a register of each bit of pushm
+#define MAX_INSTR_ARGS (1 + REGMASK_BLEN)
 
 #define INSTRUCTION_SIZE (4)
 
@@ -137,12 +137,23 @@ enum spu_opcodes {
 	 */
 	LDC_OPCODE	= 0x02,
 #define LDC_INTEGER_BLEN (20)
+#define LDC_INTEGER_MIN (-(1 << (LDC_INTEGER_BLEN - 1)))
+#define LDC_INTEGER_MAX ((1 << (LDC_INTEGER_BLEN - 1)) - 1)
 
 	/**
 	 * Loads data from nth stack frame to register. Layout like LDC.
 	 */
 	LDP_OPCODE	= 0x05,
 
+	/**
+	 * @brief Loads the constant from the constant pool to the register.
+	 *
+	 * Layout like LDC, the number is the index in the pool of the program.
+	 * The translator emits it for ldc constants wider than 20 bits
+	 * and for ldc of label addresses out of the ldc range.
+	 */
+	LDK_OPCODE	= 0x06,
+
 	/**
 	 * @brief Jump instruction
 	 *
@@ -163,9 +174,110 @@ enum spu_opcodes {
 	JMP_OPCODE	= 0x03,
 #define JMP_INTEGER_OFF  (4)
 #define JMP_INTEGER_BLEN (20)
+#define JMP_POSITION_MIN (-(1 << (JMP_INTEGER_BLEN - 1)))
+#define JMP_POSITION_MAX ((1 << (JMP_INTEGER_BLEN - 1)) - 1)
 
 	CALL_OPCODE	= 0x04,
 
+	/**
+	 * @brief Long jump and call
+	 *
+	 * Layout like JMP, the number is the index of the relative offset
+	 * in the constant pool. The translator emits them for jumps
+	 * and calls whose offset does not fit into 20 bits.
+	 */
+	JMPL_OPCODE	= 0x12,
+	CALLL_OPCODE	= 0x13,
+
+	/**
+	 * @brief Counted loop instruction
+	 *
+	 * Decrements Rc and jumps if it is not zero, layout like JMP
+	 * with the counter register in place of the flags.
+	 *
+	 * Has syntax: loop Rc .label
+	 */
+	LOOP_OPCODE	= 0x0D,
+
+	/**
+	 * @brief Loads the RAM word at Rb + (Ri << shift) + displacement to Rd
+	 *
+	 * Has syntax: ldx[.scale] Rb Rd [Ri] [$displacement]
+	 *
+	 * The scale 1, 2, 4 or 8 is written only with the index and
+	 * is encoded as the shift. rsp in the index field means there
+	 * is no index.
+	 *
+	 * Has layout:
+	 * ```
+	 * |---------------------------------------------------------------|
+	 * |                          3 bytes                              |
+	 * |----------|----------|----------|-------------|----------------|
+	 * | 4-bit Rd | 5-bit Rb | 5-bit Ri | 2-bit shift | 8-bit signed   |
+	 * |          |          |          |             | displacement   |
+	 * |----------|----------|----------|-------------|----------------|
+	 * ```
+	 */
+	LDX_OPCODE	= 0x07,
+	/// Stores Rd to the RAM word, layout like LDX
+	STX_OPCODE	= 0x08,
+
+	/**
+	 * Byte and 32-bit accesses, layout like LDX. The address is in bytes,
+	 * the byte of the word w at the offset b is at the address w * 8 + b.
+	 * ldb zero-extends the byte, ldw sign-extends the 32-bit value.
+	 */
+	LDB_OPCODE	= 0x09,
+	STB_OPCODE	= 0x0A,
+	LDW_OPCODE	= 0x0B,
+	STW_OPCODE	= 0x0C,
+#define MEM_SHIFT_BLEN (2)
+#define MEM_DISP_BLEN (8)
+#define MEM_NO_INDEX (REGISTER_RSP_CODE)
+
+	/**
+	 * @brief Pushes the registers of the mask to the stack
+	 *
+	 * Has syntax: pushm Rn Rm ...
+	 *
+	 * Registers are pushed in the ascending order, popm with the
+	 * same mask restores them. Only r0 - r23 fit in the mask.
+	 *
+	 * Has layout:
+	 * ```
+	 * |---------------------------------------------------------------|
+	 * |                          3 bytes                              |
+	 * |---------------------------------------------------------------|
+	 * |          24-bit mask, bit n is the register rn                |
+	 * |---------------------------------------------------------------|
+	 * ```
+	 */
+	PUSHM_OPCODE	= 0x0E,
+	/// Pops the registers of the mask from the stack, layout like PUSHM
+	POPM_OPCODE	= 0x0F,
+#define REGMASK_BLEN (24)
+
+	/**
+	 * @brief Extracts the bit field of Rn to Rd, zero-extended
+	 *
+	 * Has syntax: bfx Rd Rn $pos $len
+	 *
+	 * The field has to fit in the register: pos + len <= 64.
+	 *
+	 * Has layout:
+	 * ```
+	 * |---------------------------------------------------------------|
+	 * |                          3 bytes                              |
+	 * |----------|----------|-------------|---------------|-----------|
+	 * | 4-bit Rd | 5-bit Rn | 6-bit pos   | 6-bit len - 1 | reserved  |
+	 * |----------|----------|-------------|---------------|-----------|
+	 * ```
+	 */
+	BFX_OPCODE	= 0x10,
+	/// Inserts the low bits of Rn to the field of Rd, layout like BFX
+	BFI_OPCODE	= 0x11,
+#define BITFIELD_BLEN (6)
+
 	/**
 	 * @brief Directive operation
 	 *
@@ -276,6 +388,25 @@ struct spu_instruction {
  * | 4-bit Rd |  5-bit Rn  |     |
  * |----------|------------|-----|
  * ```
+ *
+ * Immediate operation commands:
+ * Rd = op( Rd, imm )
+ * ```
+ * |-----------------------------|
+ * |            14 bits          |
+ * |----------|------------------|
+ * | 4-bit Rd | 10-bit signed imm|
+ * |----------|------------------|
+ * ```
+ *
+ * Conditional commands, the condition is one of jmp_conditions:
+ * ```
+ * |-----------------------------------------|
+ * |                14 bits                  |
+ * |----------|------------|-------------|---|
+ * | 4-bit Rd |  5-bit Rn  | 3-bit cond  |   |
+ * |----------|------------|-------------|---|
+ * ```
  */
 enum spu_directive_opcodes {
 	/// Triple-register operation
@@ -289,15 +420,25 @@ enum spu_directive_opcodes {
 	DIV_OPCODE	= 0x04,
 	/// Triple-register operation
 	MOD_OPCODE	= 0x05,
-	/// Triple-register operation
+	/// Logical shift, triple-register operation. The count is taken modulo 64
 	SHR_OPCODE	= 0x06,
-	/// Triple-register operation
+	/// Triple-register operation, the count is taken modulo 64
 	SHL_OPCODE	= 0x07,
 
 	/// Integer square root
 	/// Unary operation
 	SQRT_OPCODE	= 0x08,
 
+	/// Bit count operations, unary. clz and ctz of zero are 64
+	POPCNT_OPCODE	= 0x09,
+	CLZ_OPCODE	= 0x0A,
+	CTZ_OPCODE	= 0x0B,
+	/// Reverses the byte order, unary operation
+	BSWAP_OPCODE	= 0x0C,
+	/// Rotations, triple-register operations. The count is taken modulo 64
+	ROL_OPCODE	= 0x0D,
+	ROR_OPCODE	= 0x0E,
+
 	OR_OPCODE	= 0x10,
 	XOR_OPCODE	= 0x11,
 	AND_OPCODE	= 0x12,
@@ -306,18 +447,93 @@ enum spu_directive_opcodes {
 	LDM_OPCODE	= 0x16,
 	STM_OPCODE	= 0x17,
 
+	/**
+	 * Bit operations on the RAM, bset Raddr Rbit.
+	 * The bit Rbit counts from the bit 0 of the word at Raddr,
+	 * so it is the bit Rbit % 64 of the word Raddr + Rbit / 64.
+	 * btst compares the bit with 1, so jmp.eq jumps if it is set.
+	 */
+	BSET_OPCODE	= 0x18,
+	BCLR_OPCODE	= 0x19,
+	BTST_OPCODE	= 0x1A,
+
+	/**
+	 * Bulk operations on RAM words, triple-register layout:
+	 * mset Raddr Rvalue Rlen, mcpy Rdst Rsrc Rlen, mcmp Rl Rr Rlen.
+	 * Ranges may overlap. mcmp sets the flags like cmp
+	 * of the first pair of different words.
+	 */
+	MSET_OPCODE	= 0x1B,
+	MCPY_OPCODE	= 0x1C,
+	MCMP_OPCODE	= 0x1D,
+
+	/// Immediate operation
+	ADDI_OPCODE	= 0x30,
+	/// Immediate operation
+	SUBI_OPCODE	= 0x31,
+	/// Immediate operation
+	MULI_OPCODE	= 0x32,
+	/// Immediate operation, the shift is 0..63
+	SHRI_OPCODE	= 0x33,
+	/// Immediate operation, the shift is 0..63
+	SHLI_OPCODE	= 0x34,
+	/// Immediate operation, the immediate is sign-extended
+	ANDI_OPCODE	= 0x35,
+#define IMM_INTEGER_BLEN (10)
+
 	/// Single-register operation
 	PUSH_OPCODE	= 0x20,
 	/// Single-register operation
 	POP_OPCODE	= 0x21,
 
+	/**
+	 * Vector operations on int64_t arrays in RAM.
+	 * vlen Rn sets the number of elements for the next ones.
+	 *
+	 * Triple-register: vadd Rdst Rl Rr stores op(Rl[i], Rr[i]) to Rdst[i],
+	 * where registers hold the RAM addresses of the arrays. Rdst may be
+	 * the same array as a source, but must not partially overlap it.
+	 *
+	 * vdot Rd Rl Rr puts the dot product to Rd, vsum Rd Rn puts
+	 * the sum of the array to Rd.
+	 */
+	VLEN_OPCODE	= 0x40,
+	VADD_OPCODE	= 0x41,
+	VSUB_OPCODE	= 0x42,
+	VMUL_OPCODE	= 0x43,
+	VMIN_OPCODE	= 0x44,
+	VMAX_OPCODE	= 0x45,
+	VDOT_OPCODE	= 0x46,
+	VSUM_OPCODE	= 0x47,
+
 	/// Single-register operation
 	INPUT_OPCODE	= 0x50,
 	/// Single-register operation
 	PRINT_OPCODE	= 0x51,
+	/**
+	 * Reads and prints the register as double, single-register operations.
+	 * fprint writes 17 significant digits, finput reads the same double back.
+	 */
+	FINPUT_OPCODE	= 0x52,
+	FPRINT_OPCODE	= 0x53,
+	/**
+	 * Block I/O between host streams and the RAM, triple-register layout:
+	 * read Rn Rstream Raddr reads Rn bytes to the RAM from the word Raddr,
+	 * write Rn Rstream Raddr writes them. Rn gets the number of bytes
+	 * moved, read moves less only at the end of the stream.
+	 */
+	READ_OPCODE	= 0x54,
+	WRITE_OPCODE	= 0x55,
 
 
 	RET_OPCODE	= 0x60,
+	/**
+	 * Jumps and calls to the absolute instruction address in the register,
+	 * single-register operations. Addresses come from ldc .label
+	 * or from the jump tables put by .jtable
+	 */
+	JMPR_OPCODE	= 0x61,
+	CALLR_OPCODE	= 0x62,
 
 	// Returns screen height and width
 	SCRHW_OPCODE	= 0x65,
@@ -325,6 +541,35 @@ enum spu_directive_opcodes {
 
 	/// Compares two registers
 	CMP_OPCODE	= 0x70,
+	/// Compares the register with the immediate, layout like immediate operations
+	CMPI_OPCODE	= 0x71,
+	/// Moves Rn to Rd if the condition holds, has syntax: cmov.cond Rd Rn
+	CMOV_OPCODE	= 0x72,
+	/// Sets Rd to 1 if the condition holds and to 0 otherwise: set.cond Rd
+	SET_OPCODE	= 0x73,
+#define COND_BLEN (3)
+
+	/**
+	 * IEEE-754 double operations, registers hold the bits of doubles.
+	 * Constants are loaded with ldc.f Rd $1.5
+	 *
+	 * Triple-register: fadd, fsub, fmul and fdiv.
+	 *
+	 * Unary: fsqrt, itof converts the integer to double, ftoi truncates
+	 * the double to integer and fails if it does not fit.
+	 *
+	 * fcmp Rl Rr sets the flags like cmp, NaN operands set only
+	 * the overflow flag. Such operands are unordered, only the neq
+	 * condition of jmp, cmov and set holds after them.
+	 */
+	FADD_OPCODE	= 0x80,
+	FSUB_OPCODE	= 0x81,
+	FMUL_OPCODE	= 0x82,
+	FDIV_OPCODE	= 0x83,
+	FSQRT_OPCODE	= 0x84,
+	FCMP_OPCODE	= 0x85,
+	ITOF_OPCODE	= 0x86,
+	FTOI_OPCODE	= 0x87,
 
 	/// No-args operation
 	DUMP_OPCODE	= 0xFE,
@@ -345,11 +590,14 @@ struct spu_instr_data {
 
 	spu_register_num_t rsrc1;
 	spu_register_num_t rsrc2;
+	// Index shift of memory operands, position of bit fields
+	uint8_t shift;
 
 	union {
 		uint32_t unum;
 		int32_t snum;
 		int32_t jmp_position;
+		uint32_t condition;
 	};
 };
 
@@ -358,11 +606,23 @@ typedef int (*exec_instruction_fn)(struct spu_context *ctx, struct spu_instr_dat
 
 struct translating_context;
 
+/**
+ * @brief A token of the assembler source
+ *
+ * Points directly into the mapped source text, which is never modified,
+ * so the token is not NUL-terminated.
+ */
+struct asm_token {
+	const char *str;
+	size_t len;
+};
+
 struct asm_instruction {
 	size_t n_args;
-	char *argsptrs[MAX_INSTR_ARGS];
+	struct asm_token args[MAX_INSTR_ARGS];
 	const struct op_cmd *op_cmd;
-	const char *op_arg;
+	// Argument after the point, like condition in jmp.eq
+	struct asm_token op_arg;
 
 	int is_label;
 	int is_empty;
@@ -400,6 +660,11 @@ DECLARE_OP_LAYOUT(noarg);
 DECLARE_OP_LAYOUT(ldc);
 DECLARE_OP_LAYOUT(mov);
 DECLARE_OP_LAYOUT(jmp);
+DECLARE_OP_LAYOUT(reg_imm);
+DECLARE_OP_LAYOUT(mem);
+DECLARE_OP_LAYOUT(cond);
+DECLARE_OP_LAYOUT(regmask);
+DECLARE_OP_LAYOUT(bitfield);
 
 struct op_cmd {
 	const char *cmd_name;
@@ -414,15 +679,31 @@ struct op_cmd {
 OP_EXEC_FN(mov_exec);
 OP_EXEC_FN(ldc_exec);
 OP_EXEC_FN(ldp_exec);
+OP_EXEC_FN(ldk_exec);
 OP_EXEC_FN(jmp_exec);
 OP_EXEC_FN(call_exec);
+OP_EXEC_FN(loop_exec);
+OP_EXEC_FN(jmpl_exec);
 OP_EXEC_FN(ret_exec);
+OP_EXEC_FN(jmpr_exec);
 OP_EXEC_FN(rpush_pop_exec);
+OP_EXEC_FN(rpush_pop_mask_exec);
 OP_EXEC_FN(simple_io_exec);
 OP_EXEC_FN(cmp_exec);
 OP_EXEC_FN(arithm_binary_exec);
 OP_EXEC_FN(arithm_unary_exec);
+OP_EXEC_FN(arithm_imm_exec);
+OP_EXEC_FN(cmpi_exec);
+OP_EXEC_FN(bitfield_exec);
+OP_EXEC_FN(cond_exec);
 OP_EXEC_FN(ram_exec);
+OP_EXEC_FN(ram_indexed_exec);
+OP_EXEC_FN(ram_byte_exec);
+OP_EXEC_FN(ram_bit_exec);
+OP_EXEC_FN(ram_bulk_exec);
+OP_EXEC_FN(ram_stream_exec);
+OP_EXEC_FN(vector_exec);
+OP_EXEC_FN(float_exec);
 OP_EXEC_FN(noarg_exec);
 OP_EXEC_FN(scrhw_exec);
 OP_EXEC_FN(draw_exec);
@@ -442,13 +723,25 @@ static const struct op_cmd op_table[] = {
 	OP_CMD_ENTRY("mov",	MOV_OPCODE,	&opl_mov,		arithm_unary_exec),
 	OP_CMD_ENTRY("ldc",	LDC_OPCODE,	&opl_ldc,		ldc_exec),
 	OP_CMD_ENTRY("ldp",	LDP_OPCODE,	&opl_ldc,		ldp_exec),
+	OP_CMD_ENTRY("ldk",	LDK_OPCODE,	&opl_ldc,		ldk_exec),
 	OP_CMD_ENTRY("jmp",	JMP_OPCODE,	&opl_jmp, 		jmp_exec),
 	OP_CMD_ENTRY("call",	CALL_OPCODE,	&opl_jmp,		call_exec),
+	OP_CMD_ENTRY("loop",	LOOP_OPCODE,	&opl_jmp,		loop_exec),
+	OP_CMD_ENTRY("jmpl",	JMPL_OPCODE,	&opl_jmp,		jmpl_exec),
+	OP_CMD_ENTRY("calll",	CALLL_OPCODE,	&opl_jmp,		jmpl_exec),
 	OP_CMD_ENTRY("ret",	RET_OPCODE,	&opl_noarg,		ret_exec),
+	OP_CMD_ENTRY("jmpr",	JMPR_OPCODE,	&opl_single_reg,	jmpr_exec),
+	OP_CMD_ENTRY("callr",	CALLR_OPCODE,	&opl_single_reg,	jmpr_exec),
 	OP_CMD_ENTRY("push",	PUSH_OPCODE,	&opl_single_reg,	rpush_pop_exec),
 	OP_CMD_ENTRY("pop",	POP_OPCODE,	&opl_single_reg,	rpush_pop_exec),
+	OP_CMD_ENTRY("pushm",	PUSHM_OPCODE,	&opl_regmask,		rpush_pop_mask_exec),
+	OP_CMD_ENTRY("popm",	POPM_OPCODE,	&opl_regmask,		rpush_pop_mask_exec),
 	OP_CMD_ENTRY("input",	INPUT_OPCODE,	&opl_single_reg,	simple_io_exec),
 	OP_CMD_ENTRY("print",	PRINT_OPCODE,	&opl_single_reg,	simple_io_exec),
+	OP_CMD_ENTRY("finput",	FINPUT_OPCODE,	&opl_single_reg,	float_exec),
+	OP_CMD_ENTRY("fprint",	FPRINT_OPCODE,	&opl_single_reg,	float_exec),
+	OP_CMD_ENTRY("read",	READ_OPCODE,	&opl_triple_reg,	ram_stream_exec),
+	OP_CMD_ENTRY("write",	WRITE_OPCODE,	&opl_triple_reg,	ram_stream_exec),
 	OP_CMD_ENTRY("cmp",	CMP_OPCODE,	&opl_double_reg,	cmp_exec),
 	OP_CMD_ENTRY("add",	ADD_OPCODE,	&opl_triple_reg,	arithm_binary_exec),
 	OP_CMD_ENTRY("mul",	MUL_OPCODE,	&opl_triple_reg,	arithm_binary_exec),
@@ -460,9 +753,54 @@ static const struct op_cmd op_table[] = {
 	OP_CMD_ENTRY("or", 	OR_OPCODE,	&opl_triple_reg,	arithm_binary_exec),
 	OP_CMD_ENTRY("xor",	XOR_OPCODE,	&opl_triple_reg,	arithm_binary_exec),
 	OP_CMD_ENTRY("and",	AND_OPCODE,	&opl_triple_reg,	arithm_binary_exec),
+	OP_CMD_ENTRY("addi",	ADDI_OPCODE,	&opl_reg_imm,		arithm_imm_exec),
+	OP_CMD_ENTRY("subi",	SUBI_OPCODE,	&opl_reg_imm,		arithm_imm_exec),
+	OP_CMD_ENTRY("muli",	MULI_OPCODE,	&opl_reg_imm,		arithm_imm_exec),
+	OP_CMD_ENTRY("shri",	SHRI_OPCODE,	&opl_reg_imm,		arithm_imm_exec),
+	OP_CMD_ENTRY("shli",	SHLI_OPCODE,	&opl_reg_imm,		arithm_imm_exec),
+	OP_CMD_ENTRY("andi",	ANDI_OPCODE,	&opl_reg_imm,		arithm_imm_exec),
+	OP_CMD_ENTRY("cmpi",	CMPI_OPCODE,	&opl_reg_imm,		cmpi_exec),
+	OP_CMD_ENTRY("cmov",	CMOV_OPCODE,	&opl_cond,		cond_exec),
+	OP_CMD_ENTRY("set",	SET_OPCODE,	&opl_cond,		cond_exec),
 	OP_CMD_ENTRY("ldm",	LDM_OPCODE,	&opl_double_reg,	ram_exec),
 	OP_CMD_ENTRY("stm",	STM_OPCODE,	&opl_double_reg,	ram_exec),
+	OP_CMD_ENTRY("ldx",	LDX_OPCODE,	&opl_mem,		ram_indexed_exec),
+	OP_CMD_ENTRY("stx",	STX_OPCODE,	&opl_mem,		ram_indexed_exec),
+	OP_CMD_ENTRY("ldb",	LDB_OPCODE,	&opl_mem,		ram_byte_exec),
+	OP_CMD_ENTRY("stb",	STB_OPCODE,	&opl_mem,		ram_byte_exec),
+	OP_CMD_ENTRY("ldw",	LDW_OPCODE,	&opl_mem,		ram_byte_exec),
+	OP_CMD_ENTRY("stw",	STW_OPCODE,	&opl_mem,		ram_byte_exec),
+	OP_CMD_ENTRY("bset",	BSET_OPCODE,	&opl_double_reg,	ram_bit_exec),
+	OP_CMD_ENTRY("bclr",	BCLR_OPCODE,	&opl_double_reg,	ram_bit_exec),
+	OP_CMD_ENTRY("btst",	BTST_OPCODE,	&opl_double_reg,	ram_bit_exec),
+	OP_CMD_ENTRY("mset",	MSET_OPCODE,	&opl_triple_reg,	ram_bulk_exec),
+	OP_CMD_ENTRY("mcpy",	MCPY_OPCODE,	&opl_triple_reg,	ram_bulk_exec),
+	OP_CMD_ENTRY("mcmp",	MCMP_OPCODE,	&opl_triple_reg,	ram_bulk_exec),
+	OP_CMD_ENTRY("vlen",	VLEN_OPCODE,	&opl_single_reg,	vector_exec),
+	OP_CMD_ENTRY("vadd",	VADD_OPCODE,	&opl_triple_reg,	vector_exec),
+	OP_CMD_ENTRY("vsub",	VSUB_OPCODE,	&opl_triple_reg,	vector_exec),
+	OP_CMD_ENTRY("vmul",	VMUL_OPCODE,	&opl_triple_reg,	vector_exec),
+	OP_CMD_ENTRY("vmin",	VMIN_OPCODE,	&opl_triple_reg,	vector_exec),
+	OP_CMD_ENTRY("vmax",	VMAX_OPCODE,	&opl_triple_reg,	vector_exec),
+	OP_CMD_ENTRY("vdot",	VDOT_OPCODE,	&opl_triple_reg,	vector_exec),
+	OP_CMD_ENTRY("vsum",	VSUM_OPCODE,	&opl_double_reg,	vector_exec),
+	OP_CMD_ENTRY("fadd",	FADD_OPCODE,	&opl_triple_reg,	float_exec),
+	OP_CMD_ENTRY("fsub",	FSUB_OPCODE,	&opl_triple_reg,	float_exec),
+	OP_CMD_ENTRY("fmul",	FMUL_OPCODE,	&opl_triple_reg,	float_exec),
+	OP_CMD_ENTRY("fdiv",	FDIV_OPCODE,	&opl_triple_reg,	float_exec),
+	OP_CMD_ENTRY("fsqrt",	FSQRT_OPCODE,	&opl_double_reg,	float_exec),
+	OP_CMD_ENTRY("fcmp",	FCMP_OPCODE,	&opl_double_reg,	float_exec),
+	OP_CMD_ENTRY("itof",	ITOF_OPCODE,	&opl_double_reg,	float_exec),
+	OP_CMD_ENTRY("ftoi",	FTOI_OPCODE,	&opl_double_reg,	float_exec),
 	OP_CMD_ENTRY("sqrt",	SQRT_OPCODE,	&opl_double_reg,	arithm_unary_exec),
+	OP_CMD_ENTRY("popcnt",	POPCNT_OPCODE,	&opl_double_reg,	arithm_unary_exec),
+	OP_CMD_ENTRY("clz",	CLZ_OPCODE,	&opl_double_reg,	arithm_unary_exec),
+	OP_CMD_ENTRY("ctz",	CTZ_OPCODE,	&opl_double_reg,	arithm_unary_exec),
+	OP_CMD_ENTRY("bswap",	BSWAP_OPCODE,	&opl_double_reg,	arithm_unary_exec),
+	OP_CMD_ENTRY("rol",	ROL_OPCODE,	&opl_triple_reg,	arithm_binary_exec),
+	OP_CMD_ENTRY("ror",	ROR_OPCODE,	&opl_triple_reg,	arithm_binary_exec),
+	OP_CMD_ENTRY("bfx",	BFX_OPCODE,	&opl_bitfield,		bitfield_exec),
+	OP_CMD_ENTRY("bfi",	BFI_OPCODE,	&opl_bitfield,		bitfield_exec),
 	OP_CMD_ENTRY("not",	NOT_OPCODE,	&opl_double_reg,	arithm_unary_exec),
 	OP_CMD_ENTRY("scrhw",	SCRHW_OPCODE,	&opl_double_reg,	scrhw_exec),
 	OP_CMD_ENTRY("draw",	DRAW_OPCODE,	&opl_single_reg,	draw_exec),
@@ -473,6 +811,6 @@ static const struct op_cmd op_table[] = {
 
 void init_op_cmd_opcode_table(void);
 const struct op_cmd *find_op_cmd_opcode(unsigned int opcode, int is_directive);
-const struct op_cmd *find_op_cmd(const char *cmd_name);
+const struct op_cmd *find_op_cmd(const char *cmd_name, size_t cmd_len);
 
 #endif /* SPU_ASM_H */
@@ -0,0 +1,69 @@
+/**
+ * @file
+ *
+ * @brief Buffered I/O of the SPU programs
+ *
+ * Numbers are parsed and formatted by hand over large buffers of
+ * the context, without stdio locking and locales. The output is written
+ * out when the buffer is full, before the input is read and when the
+ * program stops, so prompts are seen before the program waits for input.
+ *
+ * read and write move blocks of bytes between the RAM and host streams:
+ * 0, 1 and 2 are stdin, stdout and stderr, files opened by the runner
+ * get the next numbers. Standard streams share the buffers with print
+ * and input, so the order of the data is kept.
+ */
+
+#ifndef SPU_IO_H
+#define SPU_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define SPU_IO_BUFSIZE (1 << 16)
+#define SPU_IO_MAX_STREAMS (16)
+
+enum spu_stream_mode {
+	SPU_STREAM_CLOSED	= 0,
+	SPU_STREAM_READ		= 1,
+	SPU_STREAM_WRITE	= 2,
+};
+
+struct spu_io {
+	// Read by the file descriptor, stdio buffer of the stream is not used
+	FILE *in_stream;
+	char *in_buf;
+	size_t in_pos;
+	size_t in_len;
+	int in_eof;
+
+	// Stdio buffer of the stream is flushed before the own one
+	FILE *out_stream;
+	char *out_buf;
+	size_t out_len;
+
+	// File descriptors of the streams, indexed by the stream number
+	int stream_fds[SPU_IO_MAX_STREAMS];
+	// enum spu_stream_mode
+	uint8_t stream_modes[SPU_IO_MAX_STREAMS];
+	size_t n_streams;
+};
+
+int spu_io_init(struct spu_io *io, FILE *in_stream, FILE *out_stream);
+int spu_io_destroy(struct spu_io *io);
+
+int spu_io_flush(struct spu_io *io);
+int spu_io_write(struct spu_io *io, const char *buf, size_t len);
+int spu_io_print_int(struct spu_io *io, int64_t value);
+
+int spu_io_read_int(struct spu_io *io, int64_t *value);
+int spu_io_read_double(struct spu_io *io, double *value);
+
+int spu_io_open(struct spu_io *io, const char *filename, int mode, size_t *stream);
+int spu_io_read_stream(struct spu_io *io, size_t stream,
+		       char *buf, size_t len, size_t *n_read);
+int spu_io_write_stream(struct spu_io *io, size_t stream,
+			const char *buf, size_t len);
+
+#endif /* SPU_IO_H */
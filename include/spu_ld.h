@@ -0,0 +1,19 @@
+/**
+ * @file
+ *
+ * @brief spu-ld - linker of SPU objects
+ *
+ * Concatenates code, data and const sections of the objects in the order
+ * of arguments, so the program starts from the first object code.
+ * Global symbols are visible across objects, relocations are
+ * resolved against them or against the local symbols of the object.
+ */
+
+#ifndef SPU_LD_H
+#define SPU_LD_H
+
+#include <stdio.h>
+
+int spu_ld_link(const char *const *filenames, size_t n_files, FILE *out_stream);
+
+#endif /* SPU_LD_H */
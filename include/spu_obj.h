@@ -0,0 +1,117 @@
+/**
+ * @file
+ *
+ * @brief SPU object file format
+ *
+ * Both relocatable objects produced by the translator and programs
+ * linked by spu-ld are stored in this format:
+ *
+ * ```
+ * |--------|--------------|---------------|--------------|--------------|-------------|
+ * | header | data section | const section | code section | symbol table | relocations |
+ * |--------|--------------|---------------|--------------|--------------|-------------|
+ * ```
+ *
+ * Every part starts on the 8-byte boundary.
+ *
+ * The code section is loaded to ip 0, the data section is loaded
+ * to the address 0 of the SPU RAM. The const section is the pool of
+ * wide constants, it is read by ldk and is not addressable as RAM.
+ *
+ * Program can be executed only if it has no relocations.
+ *
+ * A file which does not start with the magic is treated as the raw
+ * stream of instructions. The magic starts with the zero byte, which
+ * is the invalid opcode, so raw programs never start with it.
+ */
+
+#ifndef SPU_OBJ_H
+#define SPU_OBJ_H
+
+#include <stdio.h>
+
+#include "spu_asm.h"
+
+/// "\0SPU" in the little-endian
+#define SPU_OBJ_MAGIC	(0x55505300)
+#define SPU_OBJ_VERSION	(2)
+
+enum spu_obj_section {
+	SPU_SECTION_UNDEF	= 0,
+	SPU_SECTION_CODE	= 1,
+	SPU_SECTION_DATA	= 2,
+	SPU_SECTION_CONST	= 3,
+};
+
+enum spu_obj_symbol_flags {
+	SPU_SYMBOL_GLOBAL	= 1 << 0,
+};
+
+enum spu_obj_reloc_type {
+	/// Relative jump offset to the symbol, like in jmp and call
+	SPU_RELOC_PCREL		= 1,
+	/// Address of the symbol in its section, like in ldc
+	SPU_RELOC_ABS		= 2,
+	/// Index of the constant in the const section of the object,
+	/// it is in the addend, the symbol is not used
+	SPU_RELOC_CONST		= 3,
+	/// Address of the symbol in its section stored to the data word,
+	/// like in .jtable, the offset is the index of the word
+	SPU_RELOC_DATA		= 4,
+};
+
+struct spu_obj_header {
+	uint32_t magic;
+	uint32_t version;
+	/// Number of instructions in the code section
+	uint32_t n_code;
+	/// Number of 8-byte words in the data section
+	uint32_t n_data;
+	uint32_t n_symbols;
+	uint32_t n_relocs;
+	/// Number of 8-byte words in the const section
+	uint32_t n_consts;
+	uint32_t reserved;
+};
+
+struct spu_obj_symbol {
+	/// Not NUL-terminated if the name is LABEL_MAX_LEN long
+	char name[LABEL_MAX_LEN];
+	uint32_t section;
+	uint32_t flags;
+	/// Position of the symbol in its section
+	uint64_t value;
+};
+
+struct spu_obj_reloc {
+	/// Index of the patched instruction in the code section,
+	/// or of the word in the data section
+	uint32_t offset;
+	uint32_t symbol;
+	uint32_t type;
+	int32_t addend;
+};
+
+struct spu_obj {
+	struct spu_obj_header header;
+
+	spu_instruction_t *code;
+	spu_data_t *data;
+	spu_data_t *consts;
+	struct spu_obj_symbol *symbols;
+	struct spu_obj_reloc *relocs;
+
+	/// Holds sections of the object read from the file
+	char *buf;
+};
+
+int spu_obj_is_object(const char *buf, size_t buflen);
+int spu_obj_parse(struct spu_obj *obj, char *buf, size_t buflen);
+int spu_obj_read(struct spu_obj *obj, const char *filename);
+int spu_obj_write(const struct spu_obj *obj, FILE *out_stream);
+int spu_obj_destroy(struct spu_obj *obj);
+
+int spu_obj_patch(spu_instruction_t *instr, int64_t value);
+int spu_obj_patch_pool_ref(spu_instruction_t *instr, uint32_t pool_index);
+
+#endif /* SPU_OBJ_H */
@@ -0,0 +1,57 @@
+/**
+ * @file
+ *
+ * @brief Execution profile of SPU programs
+ *
+ * The runner counts how many times every instruction was executed
+ * and how many times it transferred control not to the next one.
+ * The translator uses the profile to optimize the same program.
+ *
+ * The profile is the text file:
+ *
+ * ```
+ * spu-profile <version> <number of instructions> <code hash>
+ * <ip> <count> <taken>
+ * ...
+ * ```
+ *
+ * Instructions which were never executed are omitted.
+ *
+ * The code hash tells the program the profile belongs to. It is the hash
+ * of the opcodes only: the translator knows them before jumps are
+ * resolved and constants are pooled, so long jumps and ldk are hashed
+ * as jmp, call and ldc.
+ */
+
+#ifndef SPU_PROFILE_H
+#define SPU_PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "spu_asm.h"
+
+#define SPU_PROFILE_VERSION (2)
+#define SPU_PROFILE_HASH_INIT (0xcbf29ce484222325ULL)
+
+struct spu_profile {
+	size_t n_code;
+	uint64_t code_hash;
+
+	// Times the instruction was executed
+	uint64_t *counts;
+	// Times the instruction was followed by not the next one
+	uint64_t *taken;
+};
+
+int spu_profile_init(struct spu_profile *profile, size_t n_code);
+void spu_profile_destroy(struct spu_profile *profile);
+
+int spu_profile_write(const struct spu_profile *profile, FILE *out_stream);
+int spu_profile_read(struct spu_profile *profile, const char *filename);
+
+uint64_t spu_profile_hash_opcode(uint64_t hash, uint32_t opcode, int is_directive);
+int spu_profile_hash_code(const spu_instruction_t *code, size_t n_code, uint64_t *hash);
+
+#endif /* SPU_PROFILE_H */
@@ -0,0 +1,43 @@
+/**
+ * @file
+ *
+ * @brief Host kernels of the SPU vector instructions
+ *
+ * Every kernel set computes the same results, the best one supported
+ * by the host CPU is chosen at run time. Arithmetic wraps around.
+ */
+
+#ifndef SPU_VECTOR_H
+#define SPU_VECTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum spu_vec_isa {
+	SPU_VEC_SCALAR	= 0,
+	SPU_VEC_AVX2	= 1,
+	SPU_VEC_AVX512	= 2,
+	SPU_VEC_N_ISA,
+};
+
+typedef void (*spu_vec_binary_fn)(int64_t *dst, const int64_t *lhs,
+				  const int64_t *rhs, size_t len);
+typedef int64_t (*spu_vec_dot_fn)(const int64_t *lhs, const int64_t *rhs, size_t len);
+typedef int64_t (*spu_vec_sum_fn)(const int64_t *src, size_t len);
+
+struct spu_vec_kernels {
+	const char *name;
+
+	spu_vec_binary_fn add;
+	spu_vec_binary_fn sub;
+	spu_vec_binary_fn mul;
+	spu_vec_binary_fn min;
+	spu_vec_binary_fn max;
+	spu_vec_dot_fn dot;
+	spu_vec_sum_fn sum;
+};
+
+const struct spu_vec_kernels *spu_vec_kernels_get(enum spu_vec_isa isa);
+const struct spu_vec_kernels *spu_vec_kernels_best(void);
+
+#endif /* SPU_VECTOR_H */
@@ -3,28 +3,91 @@
 
 #include "spu_asm.h"
 #include "pvector.h"
+#include "arena.h"
 
+#define ASM_NO_LABEL (UINT32_MAX)
+
+// Label flag known only to the translator, next to enum spu_obj_symbol_flags
+#define ASM_LABEL_INLINE (1 << 7)
+// The address of the label is stored in the data section by .jtable
+#define ASM_LABEL_JTABLE (1 << 6)
+
+/**
+ * @brief Interned label
+ *
+ * The name points into the mapped source text.
+ */
 struct label_instance {
-	char label[LABEL_MAX_LEN];
+	const char *name;
+	uint32_t len;
+	uint32_t hash;
+	// Position in the label section, -1 if the label is not defined yet
 	ssize_t instruction_ptr;
+	// enum spu_obj_section
+	uint8_t section;
+	// enum spu_obj_symbol_flags
+	uint8_t flags;
+};
+
+/**
+ * @brief Open-addressing hash table of labels
+ *
+ * Labels are identified by dense ids, the slots store id + 1
+ * (0 for the empty slot).
+ */
+struct label_table {
+	struct label_instance *labels;
+	uint32_t *slots;
+	uint32_t n_labels;
+	uint32_t n_slots;
+};
+
+/**
+ * @brief Data word holding the address of the label
+ */
+struct asm_data_ref {
+	// Index of the word in the data section of the chunk
+	uint32_t offset;
+	uint32_t label_id;
+};
+
+/**
+ * @brief Assembler intermediate representation of an instruction
+ */
+struct asm_ir_instr {
+	struct spu_instr_data data;
+	// Interned label operand, resolved after all labels are known
+	uint32_t label_id;
+	uint32_t nline;
+	// Position in the unoptimized program, the profile is indexed by it
+	uint32_t prof_id;
 };
 
 struct translating_context {
-	// Prepared assembler instructions
-	struct pvector asm_instr_arr;
+	// Holds the IR and the label table
+	struct arena arena;
+
+	struct asm_ir_instr *ir;
+	size_t n_ir;
+
+	// Initialized data section, of type spu_data_t
+	struct pvector data;
+
+	// Pool of constants wider than ldc, of type spu_data_t
+	struct pvector consts;
 
-	// An array with binary instructions
-	struct pvector bin_instr_arr;	
+	// Label addresses in the data section, of type asm_data_ref
+	struct pvector data_refs;
 
-	size_t n_instruction;
+	// enum spu_obj_section, where the next instruction or data goes
+	int section;
 
 	FILE *out_stream;
 
-	// Table of labels
-	// Of type label_instance
-	struct pvector labels_table;
+	struct label_table labels;
 
-	int second_compilation;
+	// Label referenced by the last parsed instruction
+	uint32_t label_ref;
 };
 
 #endif /* TRANSLATOR_H */
@@ -10,7 +10,10 @@
 #include <stdint.h>
 #include "spu_asm.h"
 
-int parse_register(const char *str, spu_register_num_t *regptr);
-int parse_literal_number(const char *str, int32_t *num);
+int parse_integer(const char *str, size_t len, int64_t *num);
+int parse_register(const struct asm_token *tok, spu_register_num_t *regptr);
+int parse_literal_number(const struct asm_token *tok, int32_t *num);
+int parse_literal_number64(const struct asm_token *tok, int64_t *num);
+int parse_literal_double(const struct asm_token *tok, double *num);
 
 #endif /* TRANSLATOR_PARSERS_H */
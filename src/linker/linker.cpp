@@ -0,0 +1,60 @@
+/**
+ * @file
+ *
+ * @brief spu-ld - linker of SPU objects
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "spu_ld.h"
+
+static void print_usage(const char *progname) {
+	eprintf("Usage: %s [-o out.o] file.o...\n", progname);
+}
+
+int main(int argc, char *argv[]) {
+	const char *out_filename = "a.out";
+	FILE *out_stream = NULL;
+	int opt = 0;
+	int ret = EXIT_SUCCESS;
+
+	while ((opt = getopt(argc, argv, "o:")) != -1) {
+		switch (opt) {
+			case 'o':
+				out_filename = optarg;
+				break;
+			default:
+				print_usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (optind == argc) {
+		log_error("No input files");
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!(out_stream = fopen(out_filename, "wb"))) {
+		log_error("Unable to open %s", out_filename);
+		return EXIT_FAILURE;
+	}
+
+	if (spu_ld_link((const char *const *)(argv + optind),
+			(size_t)(argc - optind), out_stream)) {
+		log_error("Linking failure");
+		ret = EXIT_FAILURE;
+	}
+
+	if (fclose(out_stream)) {
+		ret = EXIT_FAILURE;
+	}
+
+	if (ret) {
+		remove(out_filename);
+	}
+
+	return ret;
+}
@@ -0,0 +1,373 @@
+/**
+ * @file
+ *
+ * @brief Linking of SPU objects
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "types.h"
+#include "spu.h"
+#include "spu_ld.h"
+#include "spu_obj.h"
+#include "translator.h"
+#include "jmp_opl.h"
+
+struct ld_input {
+	const char *filename;
+	struct spu_obj obj;
+
+	size_t code_base;
+	size_t data_base;
+	size_t const_base;
+};
+
+struct ld_context {
+	struct ld_input *inputs;
+	size_t n_inputs;
+
+	size_t n_code;
+	size_t n_data;
+	size_t n_consts;
+	// Jumps may become long ones, each takes a pool entry
+	size_t max_consts;
+
+	struct arena arena;
+	struct label_table globals;
+
+	spu_instruction_t *code;
+	spu_data_t *data;
+	spu_data_t *consts;
+};
+
+static size_t symbol_name_len(const struct spu_obj_symbol *symbol) {
+	assert (symbol);
+
+	return strnlen(symbol->name, LABEL_MAX_LEN);
+}
+
+static int collect_globals(struct ld_context *ld) {
+	assert (ld);
+
+	int ret = S_OK;
+
+	for (size_t i = 0; i < ld->n_inputs; i++) {
+		struct ld_input *input = &ld->inputs[i];
+
+		for (uint32_t j = 0; j < input->obj.header.n_symbols; j++) {
+			const struct spu_obj_symbol *symbol = &input->obj.symbols[j];
+			uint32_t id = 0;
+
+			if (	symbol->section == SPU_SECTION_UNDEF ||
+				!(symbol->flags & SPU_SYMBOL_GLOBAL)) {
+				continue;
+			}
+
+			_CT_CHECKED(intern_label(&ld->globals, &ld->arena,
+				symbol->name, symbol_name_len(symbol), &id));
+
+			struct label_instance *global = &ld->globals.labels[id];
+
+			if (global->instruction_ptr != -1) {
+				log_error("%s: symbol %.*s is already defined",
+					input->filename, (int)global->len, global->name);
+				_CT_FAIL();
+			}
+
+			size_t base = (symbol->section == SPU_SECTION_DATA) ?
+					input->data_base : input->code_base;
+
+			global->instruction_ptr = (ssize_t)(base + symbol->value);
+			global->section = (uint8_t)symbol->section;
+			global->flags = SPU_SYMBOL_GLOBAL;
+		}
+	}
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+/**
+ * Finds the position of the symbol in the linked program.
+ */
+static int resolve_symbol(struct ld_context *ld, const struct ld_input *input,
+			  const struct spu_obj_symbol *symbol,
+			  int *section, size_t *position) {
+	assert (ld);
+	assert (input);
+	assert (symbol);
+	assert (section);
+	assert (position);
+
+	if (symbol->section != SPU_SECTION_UNDEF) {
+		*section = (int)symbol->section;
+		*position = symbol->value + ((symbol->section == SPU_SECTION_DATA) ?
+					input->data_base : input->code_base);
+
+		return S_OK;
+	}
+
+	uint32_t id = 0;
+
+	if (intern_label(&ld->globals, &ld->arena,
+			 symbol->name, symbol_name_len(symbol), &id)) {
+		return S_FAIL;
+	}
+
+	const struct label_instance *global = &ld->globals.labels[id];
+
+	if (global->instruction_ptr == -1) {
+		log_error("%s: undefined symbol %.*s", input->filename,
+			  (int)symbol_name_len(symbol), symbol->name);
+		return S_FAIL;
+	}
+
+	*section = global->section;
+	*position = (size_t)global->instruction_ptr;
+
+	return S_OK;
+}
+
+static int apply_relocations(struct ld_context *ld) {
+	assert (ld);
+
+	int ret = S_OK;
+
+	for (size_t i = 0; i < ld->n_inputs; i++) {
+		struct ld_input *input = &ld->inputs[i];
+
+		for (uint32_t j = 0; j < input->obj.header.n_relocs; j++) {
+			const struct spu_obj_reloc *reloc = &input->obj.relocs[j];
+			const struct spu_obj_symbol *symbol = NULL;
+			size_t instr_ptr = input->code_base + reloc->offset;
+			size_t position = 0;
+			int section = 0;
+			int64_t value = 0;
+
+			if (reloc->type == SPU_RELOC_CONST) {
+				value = (int64_t)input->const_base + reloc->addend;
+
+				if (spu_obj_patch(&ld->code[instr_ptr], value)) {
+					log_error("%s: the constant pool is too big",
+						  input->filename);
+					_CT_FAIL();
+				}
+				continue;
+			}
+
+			symbol = &input->obj.symbols[reloc->symbol];
+			_CT_CHECKED(resolve_symbol(ld, input, symbol, &section, &position));
+
+			if (reloc->type == SPU_RELOC_DATA) {
+				if (section != SPU_SECTION_CODE) {
+					log_error("%s: jump table entry %.*s is a data symbol",
+						input->filename,
+						(int)symbol_name_len(symbol),
+						symbol->name);
+					_CT_FAIL();
+				}
+
+				ld->data[input->data_base + reloc->offset] =
+					(spu_data_t)position + reloc->addend;
+				continue;
+			}
+
+			switch (reloc->type) {
+				case SPU_RELOC_PCREL:
+					if (section != SPU_SECTION_CODE) {
+						log_error("%s: jump to the data symbol %.*s",
+							input->filename,
+							(int)symbol_name_len(symbol),
+							symbol->name);
+						_CT_FAIL();
+					}
+
+					value = (int64_t)position - (int64_t)instr_ptr - 1;
+					break;
+				case SPU_RELOC_ABS:
+					value = (int64_t)position;
+					break;
+				default:
+					log_error("%s: unknown relocation type <%u>",
+						  input->filename, reloc->type);
+					_CT_FAIL();
+			}
+
+			value += reloc->addend;
+
+			// Jumps to far symbols and far addresses take the value from the pool
+			if (value < LDC_INTEGER_MIN || value > LDC_INTEGER_MAX) {
+				if (spu_obj_patch_pool_ref(&ld->code[instr_ptr],
+							   (uint32_t)ld->n_consts)) {
+					log_error("%s: unable to relocate %.*s",
+						input->filename,
+						(int)symbol_name_len(symbol), symbol->name);
+					_CT_FAIL();
+				}
+
+				ld->consts[ld->n_consts++] = value;
+				continue;
+			}
+
+			if (spu_obj_patch(&ld->code[instr_ptr], value)) {
+				log_error("%s: unable to relocate %.*s",
+					input->filename,
+					(int)symbol_name_len(symbol), symbol->name);
+				_CT_FAIL();
+			}
+		}
+	}
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+static int write_executable(struct ld_context *ld, FILE *out_stream) {
+	assert (ld);
+	assert (out_stream);
+
+	int ret = S_OK;
+	struct spu_obj obj = {{0}};
+	uint32_t n_symbols = 0;
+
+	struct spu_obj_symbol *symbols = (struct spu_obj_symbol *)arena_calloc(
+		&ld->arena, ld->globals.n_labels, sizeof(struct spu_obj_symbol));
+	if (!symbols) {
+		_CT_FAIL();
+	}
+
+	// Only global symbols are kept, all of them are defined now
+	for (uint32_t id = 0; id < ld->globals.n_labels; id++) {
+		const struct label_instance *global = &ld->globals.labels[id];
+		struct spu_obj_symbol *symbol = &symbols[n_symbols];
+
+		if (global->instruction_ptr == -1) {
+			continue;
+		}
+
+		memcpy(symbol->name, global->name, global->len);
+		symbol->section = global->section;
+		symbol->flags = SPU_SYMBOL_GLOBAL;
+		symbol->value = (uint64_t)global->instruction_ptr;
+
+		n_symbols++;
+	}
+
+	obj = (struct spu_obj) {
+		.header = {
+			.magic = SPU_OBJ_MAGIC,
+			.version = SPU_OBJ_VERSION,
+			.n_code = (uint32_t)ld->n_code,
+			.n_data = (uint32_t)ld->n_data,
+			.n_symbols = n_symbols,
+			.n_relocs = 0,
+			.n_consts = (uint32_t)ld->n_consts,
+			.reserved = 0,
+		},
+		.code = ld->code,
+		.data = ld->data,
+		.consts = ld->consts,
+		.symbols = symbols,
+		.relocs = NULL,
+		.buf = NULL,
+	};
+
+	_CT_CHECKED(spu_obj_write(&obj, out_stream));
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+/**
+ * Links the objects in the order of filenames and writes the program.
+ */
+int spu_ld_link(const char *const *filenames, size_t n_files, FILE *out_stream) {
+	assert (filenames);
+	assert (out_stream);
+
+	int ret = S_OK;
+
+	struct ld_context ld = {
+		.inputs = NULL,
+		.n_inputs = 0,
+		.n_code = 0,
+		.n_data = 0,
+		.n_consts = 0,
+		.max_consts = 0,
+		.arena = {0},
+		.globals = {0},
+		.code = NULL,
+		.data = NULL,
+		.consts = NULL,
+	};
+
+	_CT_CHECKED(arena_init(&ld.arena, 0));
+
+	ld.inputs = (struct ld_input *)calloc(n_files, sizeof(struct ld_input));
+	if (!ld.inputs) {
+		_CT_FAIL();
+	}
+
+	for (; ld.n_inputs < n_files; ld.n_inputs++) {
+		struct ld_input *input = &ld.inputs[ld.n_inputs];
+
+		input->filename = filenames[ld.n_inputs];
+		_CT_CHECKED(spu_obj_read(&input->obj, input->filename));
+
+		input->code_base = ld.n_code;
+		input->data_base = ld.n_data;
+		input->const_base = ld.n_consts;
+		ld.n_code += input->obj.header.n_code;
+		ld.n_data += input->obj.header.n_data;
+		ld.n_consts += input->obj.header.n_consts;
+
+		for (uint32_t j = 0; j < input->obj.header.n_relocs; j++) {
+			ld.max_consts += (input->obj.relocs[j].type == SPU_RELOC_PCREL ||
+					  input->obj.relocs[j].type == SPU_RELOC_ABS);
+		}
+	}
+
+	ld.max_consts += ld.n_consts;
+
+	if (	ld.n_code > UINT32_MAX || ld.n_data > RAM_SIZE ||
+		ld.n_consts > (1 << (LDC_INTEGER_BLEN - 1))) {
+		log_error("The linked program is too big");
+		_CT_FAIL();
+	}
+
+	ld.code = (spu_instruction_t *)arena_alloc(&ld.arena,
+				sizeof(spu_instruction_t) * ld.n_code);
+	ld.data = (spu_data_t *)arena_alloc(&ld.arena,
+				sizeof(spu_data_t) * ld.n_data);
+	ld.consts = (spu_data_t *)arena_alloc(&ld.arena,
+				sizeof(spu_data_t) * ld.max_consts);
+	if (!ld.code || !ld.data || !ld.consts) {
+		_CT_FAIL();
+	}
+
+	for (size_t i = 0; i < ld.n_inputs; i++) {
+		struct ld_input *input = &ld.inputs[i];
+
+		memcpy(ld.code + input->code_base, input->obj.code,
+		       sizeof(spu_instruction_t) * input->obj.header.n_code);
+		memcpy(ld.data + input->data_base, input->obj.data,
+		       sizeof(spu_data_t) * input->obj.header.n_data);
+		memcpy(ld.consts + input->const_base, input->obj.consts,
+		       sizeof(spu_data_t) * input->obj.header.n_consts);
+	}
+
+	_CT_CHECKED(collect_globals(&ld));
+	_CT_CHECKED(apply_relocations(&ld));
+	_CT_CHECKED(write_executable(&ld, out_stream));
+
+_CT_EXIT_POINT:
+	for (size_t i = 0; i < ld.n_inputs; i++) {
+		spu_obj_destroy(&ld.inputs[i].obj);
+	}
+	free(ld.inputs);
+	arena_destroy(&ld.arena);
+
+	return ret;
+}
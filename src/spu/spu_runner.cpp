@@ -5,17 +5,111 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
 
 #include "spu.h"
+#include "spu_profile.h"
+#include "translator_parsers.h"
 
+#define SPU_MAX_MAPS (16)
 
-static int run_spu(const char *in_filename) {
+struct spu_map_option {
+	const char *filename;
+	size_t addr;
+	int readonly;
+};
+
+struct spu_run_options {
+	// Where to write the execution profile, NULL if not needed
+	const char *profile_filename;
+
+	// Files for read and write instructions, numbered after stderr
+	const char *stream_filenames[SPU_IO_MAX_STREAMS];
+	int stream_modes[SPU_IO_MAX_STREAMS];
+	size_t n_streams;
+
+	// Files mapped into the RAM, later ones over the earlier
+	struct spu_map_option maps[SPU_MAX_MAPS];
+	size_t n_maps;
+};
+
+/**
+ * Parses file@addr[:ro], the file name is cut in place.
+ */
+static int parse_map_option(char *arg, struct spu_map_option *map) {
+	char *at = strrchr(arg, '@');
+	int64_t addr = 0;
+	size_t addr_len = 0;
+
+	if (!at || at == arg) {
+		return S_FAIL;
+	}
+
+	addr_len = strlen(at + 1);
+	map->readonly = 0;
+	if (addr_len > 3 && !strcmp(at + 1 + addr_len - 3, ":ro")) {
+		map->readonly = 1;
+		addr_len -= 3;
+	}
+
+	if (parse_integer(at + 1, addr_len, &addr) || addr < 0) {
+		return S_FAIL;
+	}
+
+	*at = '\0';
+	map->filename = arg;
+	map->addr = (size_t)addr;
+
+	return S_OK;
+}
+
+static int write_profile(const struct spu_profile *profile, const char *filename) {
+	int ret = S_OK;
+
+	FILE *out_stream = fopen(filename, "w");
+	if (!out_stream) {
+		log_error("Unable to open %s", filename);
+		return S_FAIL;
+	}
+
+	ret = spu_profile_write(profile, out_stream);
+
+	if (fclose(out_stream)) {
+		ret = S_FAIL;
+	}
+
+	return ret;
+}
+
+static int run_spu(const char *in_filename, const struct spu_run_options *options) {
 	SPUCreate(ctx);
 
 	int ret = S_OK;
+	struct spu_profile profile = {0};
 
 	_CT_CHECKED(SPULoadBinary(&ctx, in_filename));
 
+	for (size_t i = 0; i < options->n_streams; i++) {
+		size_t stream = 0;
+
+		_CT_CHECKED(spu_io_open(&ctx.io, options->stream_filenames[i],
+					options->stream_modes[i], &stream));
+	}
+
+	for (size_t i = 0; i < options->n_maps; i++) {
+		_CT_CHECKED(SPUMapFile(&ctx, options->maps[i].filename,
+				       options->maps[i].addr, options->maps[i].readonly));
+	}
+
+	if (options->profile_filename) {
+		_CT_CHECKED(spu_profile_init(&profile, ctx.instr_bufsize));
+		_CT_CHECKED(spu_profile_hash_code(ctx.instr_buf, ctx.instr_bufsize,
+						  &profile.code_hash));
+		ctx.profile = &profile;
+	}
+
 	if ((ret = SPUExecute(&ctx))) {
 		SPUDump(&ctx, stderr);
 
@@ -23,24 +117,92 @@ static int run_spu(const char *in_filename) {
 		ret = S_OK;
 	}
 
+	// The profile of the crashed program is still useful
+	if (options->profile_filename) {
+		_CT_CHECKED(write_profile(&profile, options->profile_filename));
+	}
 
 _CT_EXIT_POINT:
+	spu_profile_destroy(&profile);
 	SPUDtor(&ctx);
 	return ret;
 }
 
-int main(int argc, const char *argv[]) {
+static void print_usage(const char *progname) {
+	eprintf("Usage: %s [-p profile] [-r file] [-w file] "
+		"[--map file@addr[:ro]] [file.o]\n"
+		"\t-p\twrite the execution profile for translator -P\n"
+		"\t-r\topen the file for read, streams are numbered from 3\n"
+		"\t-w\topen the file for write, in the order of options\n"
+		"\t--map\tmap the file into the RAM from the page-aligned word addr,\n"
+		"\t\tread-only with :ro, otherwise writes go to the file\n",
+		progname);
+}
+
+int main(int argc, char *argv[]) {
 	const char *binary_filename = "example.o";
+	int opt = 0;
+
+	struct spu_run_options options = {
+		.profile_filename = NULL,
+		.stream_filenames = {0},
+		.stream_modes = {0},
+		.n_streams = 0,
+		.maps = {{0}},
+		.n_maps = 0,
+	};
+
+	static const struct option long_options[] = {
+		{"map", required_argument, NULL, 'm'},
+		{0},
+	};
+
+	while ((opt = getopt_long(argc, argv, "p:r:w:", long_options, NULL)) != -1) {
+		switch (opt) {
+			case 'p':
+				options.profile_filename = optarg;
+				break;
+			case 'r':
+			case 'w':
+				// Standard streams take the first numbers
+				if (options.n_streams == SPU_IO_MAX_STREAMS - 3) {
+					log_error("Too many streams");
+					return EXIT_FAILURE;
+				}
+
+				options.stream_filenames[options.n_streams] = optarg;
+				options.stream_modes[options.n_streams++] =
+					(opt == 'r') ? SPU_STREAM_READ : SPU_STREAM_WRITE;
+				break;
+			case 'm':
+				if (options.n_maps == SPU_MAX_MAPS) {
+					log_error("Too many mapped files");
+					return EXIT_FAILURE;
+				}
+
+				if (parse_map_option(optarg, &options.maps[options.n_maps])) {
+					log_error("Invalid mapping <%s>, expected file@addr[:ro]",
+						  optarg);
+					return EXIT_FAILURE;
+				}
+
+				options.n_maps++;
+				break;
+			default:
+				print_usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
 
-	if (argc < 2) {
-	} else if (argc == 2) {
-		binary_filename = argv[1];
-	} else {
+	if (optind == argc - 1) {
+		binary_filename = argv[optind];
+	} else if (optind != argc) {
 		log_error("Invalid args");
+		print_usage(argv[0]);
 		return EXIT_FAILURE;
 	}
 
-	if (run_spu(binary_filename)) {
+	if (run_spu(binary_filename, &options)) {
 		return EXIT_FAILURE;
 	}
 
@@ -0,0 +1,114 @@
+/**
+ * @file
+ *
+ * @brief Bump allocator
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "arena.h"
+
+struct arena_block {
+	struct arena_block *next;
+	size_t size;
+	size_t used;
+	unsigned char data[] __attribute__((aligned(ARENA_ALIGNMENT)));
+};
+
+int arena_init(struct arena *arena, size_t block_size) {
+	assert (arena);
+
+	*arena = (struct arena) {
+		.head = NULL,
+		.block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE,
+	};
+
+	return S_OK;
+}
+
+static struct arena_block *arena_new_block(struct arena *arena, size_t size) {
+	assert (arena);
+
+	if (size < arena->block_size) {
+		size = arena->block_size;
+	}
+
+	struct arena_block *block = (struct arena_block *)
+		malloc(sizeof(struct arena_block) + size);
+	if (!block) {
+		return NULL;
+	}
+
+	block->size = size;
+	block->used = 0;
+
+	// Oversized blocks are filled by a single allocation, so they are
+	// linked after the head to keep allocating from the current block
+	if (size > arena->block_size && arena->head) {
+		block->next = arena->head->next;
+		arena->head->next = block;
+	} else {
+		block->next = arena->head;
+		arena->head = block;
+	}
+
+	return block;
+}
+
+void *arena_alloc(struct arena *arena, size_t size) {
+	assert (arena);
+
+	size_t aligned_size = (size + ARENA_ALIGNMENT - 1) &
+				~(size_t)(ARENA_ALIGNMENT - 1);
+	if (aligned_size < size) {
+		return NULL;
+	}
+
+	struct arena_block *block = arena->head;
+
+	if (!block || block->size - block->used < aligned_size) {
+		if (!(block = arena_new_block(arena, aligned_size))) {
+			return NULL;
+		}
+	}
+
+	void *ptr = block->data + block->used;
+	block->used += aligned_size;
+
+	return ptr;
+}
+
+void *arena_calloc(struct arena *arena, size_t n_el, size_t el_size) {
+	assert (arena);
+
+	if (el_size && n_el > SIZE_MAX / el_size) {
+		return NULL;
+	}
+
+	void *ptr = arena_alloc(arena, n_el * el_size);
+	if (ptr) {
+		memset(ptr, 0, n_el * el_size);
+	}
+
+	return ptr;
+}
+
+int arena_destroy(struct arena *arena) {
+	assert (arena);
+
+	struct arena_block *block = arena->head;
+
+	while (block) {
+		struct arena_block *next = block->next;
+		free(block);
+		block = next;
+	}
+
+	arena->head = NULL;
+
+	return S_OK;
+}
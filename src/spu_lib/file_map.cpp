@@ -0,0 +1,74 @@
+/**
+ * @file
+ *
+ * @brief Read-only memory mapping of host files
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "types.h"
+#include "file_map.h"
+
+int file_map_open(struct file_map *map, const char *filename) {
+	assert (map);
+	assert (filename);
+
+	int ret = S_OK;
+	struct stat st = {0};
+	void *data = NULL;
+
+	*map = (struct file_map) {
+		.data = NULL,
+		.len = 0,
+	};
+
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		log_error("Unable to open file %s", filename);
+		return S_FAIL;
+	}
+
+	if (fstat(fd, &st) || st.st_size < 0) {
+		log_error("Unable to stat file %s", filename);
+		_CT_FAIL();
+	}
+
+	// mmap does not accept empty mappings
+	if (st.st_size == 0) {
+		goto _CT_EXIT_POINT;
+	}
+
+	data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		log_error("Unable to map file %s", filename);
+		_CT_FAIL();
+	}
+
+	// The file is scanned once from the beginning to the end
+	madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	map->data = (const char *)data;
+	map->len = (size_t)st.st_size;
+
+_CT_EXIT_POINT:
+	close(fd);
+	return ret;
+}
+
+int file_map_close(struct file_map *map) {
+	assert (map);
+
+	if (map->data) {
+		munmap((void *)(uintptr_t)map->data, map->len);
+	}
+
+	map->data = NULL;
+	map->len = 0;
+
+	return S_OK;
+}
@@ -0,0 +1,72 @@
+#include <assert.h>
+#include "spu_asm.h"
+#include "spu_bit_ops.h"
+#include "opls.h"
+#include "translator_parsers.h"
+
+#define BITFIELD_SRC_POS	(FREGISTER_BIT_LEN)
+#define BITFIELD_POS_POS	(BITFIELD_SRC_POS + REGISTER_BIT_LEN)
+#define BITFIELD_LEN_POS	(BITFIELD_POS_POS + BITFIELD_BLEN)
+
+DEFINE_BINARY_PARSER(bitfield, {
+	_CT_CHECKED(instr_get_register(&instr_data->rdest, bin_instr,
+				0, USE_R_HEAD_BIT));
+	_CT_CHECKED(instr_get_register(&instr_data->rsrc1, bin_instr,
+				BITFIELD_SRC_POS, NO_R_HEAD_BIT));
+	{
+		uint32_t unum = 0;
+		_CT_CHECKED(instr_get_bitfield(&unum, BITFIELD_BLEN,
+					bin_instr, BITFIELD_POS_POS));
+		instr_data->shift = (uint8_t)unum;
+
+		_CT_CHECKED(instr_get_bitfield(&unum, BITFIELD_BLEN,
+					bin_instr, BITFIELD_LEN_POS));
+		instr_data->unum = unum + 1;
+	}
+
+	_CT_CHECKED(get_raw_opcode(&instr_data->opcode, bin_instr));
+});
+
+DEFINE_BINARY_WRITER(bitfield, {
+
+	_CT_CHECKED(instr_set_register(instr_data->rdest, bin_instr,
+				0, USE_R_HEAD_BIT));
+	_CT_CHECKED(instr_set_register(instr_data->rsrc1, bin_instr,
+				BITFIELD_SRC_POS, NO_R_HEAD_BIT));
+	_CT_CHECKED(instr_set_bitfield(instr_data->shift, BITFIELD_BLEN,
+				bin_instr, BITFIELD_POS_POS));
+	_CT_CHECKED(instr_set_bitfield(instr_data->unum - 1, BITFIELD_BLEN,
+				bin_instr, BITFIELD_LEN_POS));
+
+	_CT_CHECKED(set_raw_opcode(instr_data->opcode, bin_instr));
+});
+
+DEFINE_ASM_PARSER(bitfield, {
+	int32_t pos = 0;
+	int32_t len = 0;
+
+	if (asm_instr->n_args != 1 + 4) {
+		_CT_FAIL();
+	}
+
+	_CT_CHECKED(parse_register(&asm_instr->args[1], &instr_data->rdest));
+	_CT_CHECKED(parse_register(&asm_instr->args[2], &instr_data->rsrc1));
+	_CT_CHECKED(parse_literal_number(&asm_instr->args[3], &pos));
+	_CT_CHECKED(parse_literal_number(&asm_instr->args[4], &len));
+
+	if (pos < 0 || len < 1 || pos + len > 64) {
+		log_error("bit field <%d, %d> does not fit in the register", pos, len);
+		_CT_FAIL();
+	}
+
+	instr_data->shift = (uint8_t)pos;
+	instr_data->unum = (uint32_t)len;
+});
+
+DEFINE_ASM_WRITER(bitfield, {
+	status = fprintf(out_stream, "%s r%d r%d $%d $%u", op_cmd->cmd_name,
+			instr_data->rdest, instr_data->rsrc1,
+			instr_data->shift, instr_data->unum);
+});
+
+DEFINE_OP_LAYOUT(bitfield, 0);
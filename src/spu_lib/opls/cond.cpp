@@ -0,0 +1,69 @@
+#include <assert.h>
+#include "spu_asm.h"
+#include "spu_bit_ops.h"
+#include "opls.h"
+#include "translator_parsers.h"
+#include "jmp_opl.h"
+
+#define COND_POS (FREGISTER_BIT_LEN + REGISTER_BIT_LEN)
+
+DEFINE_BINARY_PARSER(cond, {
+	_CT_CHECKED(directive_get_register(&instr_data->rdest, bin_instr,
+				0, USE_R_HEAD_BIT));
+	_CT_CHECKED(directive_get_register(&instr_data->rsrc1, bin_instr,
+				FREGISTER_BIT_LEN, NO_R_HEAD_BIT));
+	_CT_CHECKED(directive_get_bitfield(&instr_data->condition, COND_BLEN,
+				bin_instr, COND_POS));
+
+	_CT_CHECKED(get_directive_opcode(&instr_data->opcode, bin_instr));
+});
+
+DEFINE_BINARY_WRITER(cond, {
+
+	_CT_CHECKED(directive_set_register(instr_data->rdest, bin_instr,
+				0, USE_R_HEAD_BIT));
+	_CT_CHECKED(directive_set_register(instr_data->rsrc1, bin_instr,
+				FREGISTER_BIT_LEN, NO_R_HEAD_BIT));
+	_CT_CHECKED(directive_set_bitfield(instr_data->condition, COND_BLEN,
+				bin_instr, COND_POS));
+
+	_CT_CHECKED(set_directive_opcode(instr_data->opcode, bin_instr));
+});
+
+DEFINE_ASM_PARSER(cond, {
+	size_t n_regs = (instr_data->opcode == CMOV_OPCODE) ? 2 : 1;
+	spu_register_num_t condition = UNCONDITIONAL_JMP;
+
+	if (asm_instr->n_args != 1 + n_regs) {
+		_CT_FAIL();
+	}
+
+	_CT_CHECKED(parse_register(&asm_instr->args[1], &instr_data->rdest));
+
+	instr_data->rsrc1 = 0;
+	if (n_regs == 2) {
+		_CT_CHECKED(parse_register(&asm_instr->args[2], &instr_data->rsrc1));
+	}
+
+	// Without a condition it would be just mov or ldc
+	if (	parse_jmp_condition(asm_instr, &condition) ||
+		condition == UNCONDITIONAL_JMP) {
+		log_error("Invalid condition <%.*s>",
+			  (int)asm_instr->op_arg.len, asm_instr->op_arg.str);
+		_CT_FAIL();
+	}
+
+	instr_data->condition = condition;
+});
+
+DEFINE_ASM_WRITER(cond, {
+	status = fprintf(out_stream, "%s.%s r%d", op_cmd->cmd_name,
+			jmp_condition_name(instr_data->condition),
+			instr_data->rdest);
+
+	if (instr_data->opcode == CMOV_OPCODE) {
+		fprintf(out_stream, " r%d", instr_data->rsrc1);
+	}
+});
+
+DEFINE_OP_LAYOUT(cond, 1);
@@ -5,6 +5,8 @@
 #include "opls.h"
 #include "translator_parsers.h"
 #include "translator.h"
+#include "spu_obj.h"
+#include "jmp_opl.h"
 
 DEFINE_BINARY_PARSER(jmp, {
 	_CT_CHECKED(instr_get_register(&instr_data->jmp_condition, bin_instr,
@@ -30,66 +32,144 @@ DEFINE_BINARY_WRITER(jmp, {
 	_CT_CHECKED(set_raw_opcode(instr_data->opcode, bin_instr));
 });
 
-static struct label_instance *find_label(struct translating_context *ctx,
-					 const char *label_name) {
-	assert (ctx);
-	assert (label_name);
+static uint32_t hash_label(const char *name, size_t len) {
+	uint32_t hash = 5381;
 
-	for (size_t i = 0; i < ctx->labels_table.len; i++) {
-		struct label_instance *flabel = NULL;
-		if (pvector_get(&(ctx->labels_table), i, (void **)&flabel)) {
-			return NULL;
-		}
+	for (size_t i = 0; i < len; i++)
+		/* hash * 33 + c */
+		hash = ((hash << 5) + hash) + (uint8_t)name[i];
 
-		if (!strcmp(flabel->label, label_name)) {
-			return flabel;
-		}
+	return hash;
+}
+
+#define LABEL_TABLE_MIN_SLOTS (64)
+
+static int grow_label_table(struct label_table *table, struct arena *arena) {
+	assert (table);
+	assert (arena);
+
+	uint32_t n_slots = table->n_slots ? table->n_slots * 2 : LABEL_TABLE_MIN_SLOTS;
+
+	// Labels array is half of the slots, so the load factor stays under 1/2
+	struct label_instance *labels = (struct label_instance *)arena_alloc(
+			arena, sizeof(struct label_instance) * (n_slots / 2));
+	uint32_t *slots = (uint32_t *)arena_calloc(arena, n_slots, sizeof(uint32_t));
+
+	if (!labels || !slots) {
+		return S_FAIL;
 	}
 
-	return NULL;
-}
+	if (table->n_labels) {
+		memcpy(labels, table->labels,
+		       sizeof(struct label_instance) * table->n_labels);
+	}
 
-static int parse_jmp_position(	const struct asm_instruction *asm_instr,
-				const char *jmp_str, int32_t *jmp_arg) {
-	assert (asm_instr);
-	assert (jmp_str);
-	assert (jmp_arg);
+	for (uint32_t id = 0; id < table->n_labels; id++) {
+		uint32_t slot = labels[id].hash & (n_slots - 1);
 
-	int ret = S_OK;
+		while (slots[slot]) {
+			slot = (slot + 1) & (n_slots - 1);
+		}
 
-	int32_t relative_jmp = 0;
+		slots[slot] = id + 1;
+	}
 
-	if (*jmp_str == '.') {
-		struct label_instance *label_inst = find_label(asm_instr->ctx, jmp_str);
-		if (!label_inst) {
-			size_t label_len = strlen(jmp_str);
-			struct label_instance label = {{0}};
+	// Old arrays stay in the arena until it is destroyed
+	table->labels = labels;
+	table->slots = slots;
+	table->n_slots = n_slots;
 
-			if (label_len > LABEL_MAX_LEN) {
-				log_error("Invalid label: %s", jmp_str);
-				_CT_FAIL();
-			}
+	return S_OK;
+}
 
-			memcpy(label.label, jmp_str, label_len);
-			label.instruction_ptr = -1;
+/**
+ * Returns the id of the label, adding it to the table
+ * as undefined if it is not there yet.
+ */
+int intern_label(struct label_table *table, struct arena *arena,
+		 const char *name, size_t len, uint32_t *label_id) {
+	assert (table);
+	assert (arena);
+	assert (name);
+	assert (label_id);
+
+	if (len > LABEL_MAX_LEN) {
+		log_error("Label %.*s is too long: maximum size is %d",
+			(int)len, name, LABEL_MAX_LEN);
+		return S_FAIL;
+	}
+
+	if ((table->n_labels + 1) * 2 > table->n_slots &&
+	    grow_label_table(table, arena)) {
+		return S_FAIL;
+	}
 
+	uint32_t hash = hash_label(name, len);
+	uint32_t slot = hash & (table->n_slots - 1);
+
+	while (table->slots[slot]) {
+		uint32_t id = table->slots[slot] - 1;
+		struct label_instance *label = &table->labels[id];
+
+		if (label->hash == hash && label->len == len &&
+		    !memcmp(label->name, name, len)) {
+			*label_id = id;
 			return S_OK;
 		}
 
-		if (asm_instr->ctx->second_compilation && label_inst->instruction_ptr == -1) {
-			log_error("Undefined label: %s", jmp_str);
-			_CT_FAIL();
-		}
+		slot = (slot + 1) & (table->n_slots - 1);
+	}
+
+	uint32_t id = table->n_labels++;
 
-		int32_t absolute_ptr = (int32_t)label_inst->instruction_ptr;
-		int32_t current_ptr = (int32_t)asm_instr->ctx->n_instruction;
-		int32_t relative_ptr = absolute_ptr - current_ptr - 1;
+	table->labels[id] = (struct label_instance) {
+		.name = name,
+		.len = (uint32_t)len,
+		.hash = hash,
+		.instruction_ptr = -1,
+		.section = SPU_SECTION_UNDEF,
+		.flags = 0,
+	};
+	table->slots[slot] = id + 1;
 
-		relative_jmp = relative_ptr;
-	} else if (*jmp_str == '$') {
+	*label_id = id;
+
+	return S_OK;
+}
+
+static uint32_t long_jmp_opcode(uint32_t opcode) {
+	switch (opcode) {
+		case JMP_OPCODE:
+			return JMPL_OPCODE;
+		case CALL_OPCODE:
+			return CALLL_OPCODE;
+		default:
+			return 0;
+	}
+}
+
+/**
+ * Parses the jump target. The offset too long for the instruction
+ * is put into the constant pool and the jump becomes the long one.
+ */
+static int parse_jmp_position(	const struct asm_instruction *asm_instr,
+				const struct asm_token *jmp_tok,
+				struct spu_instr_data *instr_data) {
+	assert (asm_instr);
+	assert (jmp_tok);
+	assert (instr_data);
+
+	int ret = S_OK;
+
+	int32_t relative_jmp = 0;
+
+	if (jmp_tok->len > 0 && *jmp_tok->str == '.') {
+		// The offset is known only when all labels are defined
+		_CT_CHECKED(parse_label_ref(asm_instr, jmp_tok));
+	} else if (jmp_tok->len > 0 && *jmp_tok->str == '$') {
 		int32_t number = 0;
 
-		_CT_CHECKED(parse_literal_number(jmp_str, &number));
+		_CT_CHECKED(parse_literal_number(jmp_tok, &number));
 
 		relative_jmp = number;
 	} else {
@@ -97,63 +177,160 @@ static int parse_jmp_position(	const struct asm_instruction *asm_instr,
 	}
 
 	if (test_integer_bounds(relative_jmp, JMP_INTEGER_BLEN)) {
-		log_error("jump number <%d> is too long", relative_jmp);
-		_CT_FAIL();
+		if (!long_jmp_opcode(instr_data->opcode)) {
+			log_error("jump number <%d> is too long", relative_jmp);
+			_CT_FAIL();
+		}
+
+		_CT_CHECKED(push_pool_constant(asm_instr->ctx, relative_jmp,
+					       &relative_jmp));
+		instr_data->opcode = long_jmp_opcode(instr_data->opcode);
 	}
 	
-	*jmp_arg = relative_jmp;
+	instr_data->jmp_position = relative_jmp;
 
 _CT_EXIT_POINT:
 	return ret;
 }
 
-int process_label(struct asm_instruction *asm_instr) {
+/**
+ * Remembers the label operand of the instruction being parsed.
+ */
+int parse_label_ref(const struct asm_instruction *asm_instr,
+		    const struct asm_token *label_tok) {
 	assert (asm_instr);
+	assert (label_tok);
 
-	int ret = S_OK;
-	char *label_name = asm_instr->argsptrs[0];
-	size_t label_len = strlen(label_name);
-	struct label_instance label = {{0}};
-	struct label_instance *found_label = NULL;
+	struct translating_context *ctx = asm_instr->ctx;
 
-	if (asm_instr->ctx->second_compilation) {
-		return S_OK;
+	if (label_tok->len < LABEL_MIN_LEN || *label_tok->str != '.') {
+		log_error("Invalid label: %.*s", (int)label_tok->len, label_tok->str);
+		return S_FAIL;
 	}
 
-	size_t instr_ptr = asm_instr->ctx->n_instruction;
+	return intern_label(&ctx->labels, &ctx->arena,
+			    label_tok->str, label_tok->len, &ctx->label_ref);
+}
+
+int process_label(struct asm_instruction *asm_instr) {
+	assert (asm_instr);
+
+	int ret = S_OK;
+	const char *label_name = asm_instr->args[0].str;
+	size_t label_len = asm_instr->args[0].len;
+	struct translating_context *ctx = asm_instr->ctx;
+	uint32_t label_id = 0;
+
+	size_t instr_ptr = (ctx->section == SPU_SECTION_DATA) ?
+				ctx->data.len : ctx->n_ir;
 
 	if (	asm_instr->n_args != 1 || 
 		*label_name != '.' || 
 		// label_min_len + ':'
 		label_len < LABEL_MIN_LEN + 1) {
-		log_error("Invalid label: %s", label_name);
+		log_error("Invalid label: %.*s", (int)label_len, label_name);
 		_CT_FAIL();
 	}
 
 	if (label_name[label_len - 1] == ':') {
-		label_name[label_len - 1] = '\0';
 		label_len--;
 	}
 
-	if (label_len > LABEL_MAX_LEN) {
-		log_error("Label %s is too long: maximum size is %d",
-			label_name, LABEL_MAX_LEN);
+	_CT_CHECKED(intern_label(&ctx->labels, &ctx->arena,
+				 label_name, label_len, &label_id));
+
+	if (ctx->labels.labels[label_id].instruction_ptr != -1) {
+		log_error("Label %.*s is already used",
+			  (int)label_len, label_name);
 		_CT_FAIL();
 	}
 
-	if ((found_label = find_label(asm_instr->ctx, label_name))) {
-		if (found_label->instruction_ptr != -1) {
-			log_error("Label %s is already used", label_name);
+	ctx->labels.labels[label_id].instruction_ptr = (ssize_t)instr_ptr;
+	ctx->labels.labels[label_id].section = (uint8_t)ctx->section;
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+static int label_ref_type(const struct spu_instr_data *instr_data) {
+	assert (instr_data);
+
+	if (instr_data->layout == &opl_jmp) {
+		return SPU_RELOC_PCREL;
+	}
+
+	return SPU_RELOC_ABS;
+}
+
+/**
+ * Replaces label references in the IR with relative jump offsets
+ * and label addresses.
+ *
+ * The IR is a part of the program starting from the base instruction,
+ * label ids refer to the labels table of the whole program.
+ *
+ * If relocs vector is passed, the program is relocatable: references
+ * to undefined labels and all the addresses are left for the linker.
+ */
+int resolve_label_refs(struct asm_ir_instr *ir, size_t n_ir, size_t base,
+		       const struct label_table *labels, struct pvector *relocs) {
+	assert (ir || n_ir == 0);
+	assert (labels);
+
+	int ret = S_OK;
+
+	for (size_t i = 0; i < n_ir; i++) {
+		struct asm_ir_instr *ir_instr = &ir[i];
+
+		if (ir_instr->label_id == ASM_NO_LABEL) {
+			continue;
+		}
+
+		const struct label_instance *label = &labels->labels[ir_instr->label_id];
+		int ref_type = label_ref_type(&ir_instr->data);
+		int64_t value = 0;
+
+		if (label->instruction_ptr == -1 && !relocs) {
+			log_error("Undefined label %.*s on line #%u",
+				  (int)label->len, label->name, ir_instr->nline + 1);
+			_CT_FAIL();
+		}
+
+		if (ref_type == SPU_RELOC_PCREL && label->section == SPU_SECTION_DATA) {
+			log_error("Jump to the data label %.*s on line #%u",
+				  (int)label->len, label->name, ir_instr->nline + 1);
 			_CT_FAIL();
+		}
+
+		if (relocs && (label->instruction_ptr == -1 || ref_type == SPU_RELOC_ABS)) {
+			struct spu_obj_reloc reloc = {
+				.offset = (uint32_t)(base + i),
+				.symbol = ir_instr->label_id,
+				.type = (uint32_t)ref_type,
+				.addend = 0,
+			};
+
+			_CT_FAIL_NONZERO(pvector_push_back(relocs, &reloc));
+
+			ir_instr->data.snum = 0;
+			continue;
+		}
+
+		if (ref_type == SPU_RELOC_PCREL) {
+			value = (int64_t)label->instruction_ptr - (int64_t)(base + i) - 1;
 		} else {
-			found_label->instruction_ptr = (ssize_t)instr_ptr;
+			value = (int64_t)label->instruction_ptr;
 		}
-	}
 
-	memcpy(label.label, label_name, label_len);
-	label.instruction_ptr = (ssize_t)instr_ptr;
+		if (	value < INT32_MIN || value > INT32_MAX ||
+			test_integer_bounds((int32_t)value, JMP_INTEGER_BLEN)) {
+			log_error("label offset <%ld> on line #%u is too long",
+				  value, ir_instr->nline + 1);
+			_CT_FAIL();
+		}
 
-	_CT_FAIL_NONZERO(pvector_push_back(&asm_instr->ctx->labels_table, &label));
+		ir_instr->data.snum = (int32_t)value;
+	}
 
 _CT_EXIT_POINT:
 	return ret;
@@ -172,20 +349,26 @@ static const struct jmp_cond_mapping {
 	{0},
 };
 
-static int parse_jmp_condition(const struct asm_instruction *asm_instr,
-			       spu_register_num_t *jmp_condition) {
+/**
+ * Parses the condition after the point, like in jmp.eq.
+ * No condition means the unconditional jump.
+ */
+int parse_jmp_condition(const struct asm_instruction *asm_instr,
+			spu_register_num_t *jmp_condition) {
 	assert (asm_instr);
 	assert (jmp_condition);
 
-	if (!asm_instr->op_arg) {
+	if (!asm_instr->op_arg.str) {
 		*jmp_condition = UNCONDITIONAL_JMP;
 		return S_OK;
 	}
 
 	const struct jmp_cond_mapping *jmp_mp = jmp_conditions;
+	const struct asm_token *cond = &asm_instr->op_arg;
 
 	while (jmp_mp->jmp_cond_name != NULL) {
-		if (!strcmp(jmp_mp->jmp_cond_name, asm_instr->op_arg)) {
+		if (!strncmp(jmp_mp->jmp_cond_name, cond->str, cond->len) &&
+		    jmp_mp->jmp_cond_name[cond->len] == '\0') {
 			*jmp_condition = (uint8_t)jmp_mp->condition;
 			return S_OK;
 		}
@@ -195,37 +378,56 @@ static int parse_jmp_condition(const struct asm_instruction *asm_instr,
 	return S_FAIL;
 }
 
+const char *jmp_condition_name(uint32_t condition) {
+	for (const struct jmp_cond_mapping *jmp_mp = jmp_conditions;
+	     jmp_mp->jmp_cond_name != NULL; jmp_mp++) {
+		if ((uint32_t)jmp_mp->condition == condition) {
+			return jmp_mp->jmp_cond_name;
+		}
+	}
+
+	return "unknown_cond";
+}
+
 DEFINE_ASM_PARSER(jmp, {
-	if (asm_instr->n_args != 1 + 1) {
+	// Long forms are chosen by the translator from the offset
+	if (	instr_data->opcode == JMPL_OPCODE ||
+		instr_data->opcode == CALLL_OPCODE) {
+		log_error("%s is written as %s", asm_instr->op_cmd->cmd_name,
+			  instr_data->opcode == JMPL_OPCODE ? "jmp" : "call");
 		_CT_FAIL();
 	}
 
-	char *jmp_str = asm_instr->argsptrs[1];
+	if (instr_data->opcode == LOOP_OPCODE) {
+		if (asm_instr->n_args != 1 + 2 || asm_instr->op_arg.str) {
+			_CT_FAIL();
+		}
+
+		_CT_CHECKED(parse_register(&asm_instr->args[1], &instr_data->rdest));
+		_CT_CHECKED(parse_jmp_position(asm_instr, &asm_instr->args[2],
+					       instr_data));
+	} else {
+		if (asm_instr->n_args != 1 + 1) {
+			_CT_FAIL();
+		}
 
-	_CT_CHECKED(parse_jmp_condition(asm_instr, &instr_data->jmp_condition));
-	_CT_CHECKED(parse_jmp_position(asm_instr, jmp_str, &instr_data->jmp_position));
+		_CT_CHECKED(parse_jmp_condition(asm_instr, &instr_data->jmp_condition));
+		_CT_CHECKED(parse_jmp_position(asm_instr, &asm_instr->args[1],
+					       instr_data));
+	}
 });
 
 DEFINE_ASM_WRITER(jmp, {
-	if (!instr_data->jmp_condition) {
+	if (instr_data->opcode == LOOP_OPCODE) {
+		status = fprintf(out_stream, "%s r%d $%d", op_cmd->cmd_name,
+			instr_data->rdest, instr_data->jmp_position);
+	} else if (!instr_data->jmp_condition) {
 		status = fprintf(out_stream, "%s $%d", op_cmd->cmd_name,
 			instr_data->jmp_position);
 	} else {
-		const char *jmp_condition_name = "unknown_cond";
-
-		const struct jmp_cond_mapping *jmp_mp = jmp_conditions;
-
-		while (jmp_mp->jmp_cond_name != NULL) {
-			if (jmp_mp->condition == instr_data->jmp_condition) {
-				jmp_condition_name = jmp_mp->jmp_cond_name;
-			}
-			jmp_mp++;
-		}
-
 		status = fprintf(out_stream, "%s.%s $%d", op_cmd->cmd_name,
-			jmp_condition_name,
+			jmp_condition_name(instr_data->jmp_condition),
 			instr_data->jmp_position);
-
 	}
 });
 
@@ -1,8 +1,10 @@
 #include <assert.h>
+#include <string.h>
 #include "spu_asm.h"
 #include "spu_bit_ops.h"
 #include "opls.h"
 #include "translator_parsers.h"
+#include "jmp_opl.h"
 
 DEFINE_BINARY_PARSER(ldc, {
 	_CT_CHECKED(instr_get_register(&instr_data->rdest, bin_instr,
@@ -33,21 +35,74 @@ DEFINE_BINARY_WRITER(ldc, {
 });
 
 
+/**
+ * Puts the constant into the pool of the chunk being parsed,
+ * the pools of all chunks are merged after parsing.
+ */
+int push_pool_constant(struct translating_context *ctx,
+		       int64_t value, int32_t *index) {
+	assert (ctx);
+	assert (index);
+
+	if (ctx->consts.len >= (1 << (LDC_INTEGER_BLEN - 1))) {
+		log_error("Too many wide constants");
+		return S_FAIL;
+	}
+
+	*index = (int32_t)ctx->consts.len;
+
+	return pvector_push_back(&ctx->consts, &value) ? S_FAIL : S_OK;
+}
+
 DEFINE_ASM_PARSER(ldc, {
 	if (asm_instr->n_args != 1 + 2) {
 		_CT_FAIL();
 	}
 
-	_CT_CHECKED(parse_register(asm_instr->argsptrs[1], &instr_data->rdest));
-	_CT_CHECKED(parse_literal_number(asm_instr->argsptrs[2], &instr_data->snum));
+	_CT_CHECKED(parse_register(&asm_instr->args[1], &instr_data->rdest));
 
-	if (test_integer_bounds(instr_data->snum, LDC_INTEGER_BLEN)) {
-		log_error("number <%s> is too long", asm_instr->argsptrs[2]);
-		_CT_FAIL();
+	// ldc loads the address of the label, it is known after linking
+	if (asm_instr->op_cmd->opcode == LDC_OPCODE &&
+	    asm_instr->args[2].len > 0 && *asm_instr->args[2].str == '.') {
+		_CT_CHECKED(parse_label_ref(asm_instr, &asm_instr->args[2]));
+		instr_data->snum = 0;
+	} else {
+		int64_t value = 0;
+		int is_short = 0;
+
+		// ldc.f loads the bits of the double
+		if (	asm_instr->op_arg.len == 1 && *asm_instr->op_arg.str == 'f' &&
+			asm_instr->op_cmd->opcode == LDC_OPCODE) {
+			double num = 0;
+
+			_CT_CHECKED(parse_literal_double(&asm_instr->args[2], &num));
+			memcpy(&value, &num, sizeof(value));
+		} else if (asm_instr->op_arg.len) {
+			log_error("Invalid modifier <%.*s>",
+				  (int)asm_instr->op_arg.len, asm_instr->op_arg.str);
+			_CT_FAIL();
+		} else {
+			_CT_CHECKED(parse_literal_number64(&asm_instr->args[2], &value));
+		}
+
+		is_short = value >= INT32_MIN && value <= INT32_MAX &&
+			   !test_integer_bounds((int32_t)value, LDC_INTEGER_BLEN);
+
+		if (is_short && asm_instr->op_cmd->opcode != LDK_OPCODE) {
+			instr_data->snum = (int32_t)value;
+		} else if (asm_instr->op_cmd->opcode == LDP_OPCODE) {
+			log_error("number <%.*s> is too long",
+				  (int)asm_instr->args[2].len, asm_instr->args[2].str);
+			_CT_FAIL();
+		} else {
+			// Wider constants are loaded from the pool by the index
+			_CT_CHECKED(push_pool_constant(asm_instr->ctx, value,
+						       &instr_data->snum));
+			instr_data->opcode = LDK_OPCODE;
+		}
 	}
 });
 
-
 DEFINE_ASM_WRITER(ldc, {
 	status = fprintf(out_stream, "%s r%d $%d", op_cmd->cmd_name,
 			instr_data->rdest, instr_data->snum);
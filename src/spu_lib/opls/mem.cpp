@@ -0,0 +1,139 @@
+#include <assert.h>
+#include "spu_asm.h"
+#include "spu_bit_ops.h"
+#include "opls.h"
+#include "translator_parsers.h"
+
+#define MEM_BASE_POS	(FREGISTER_BIT_LEN)
+#define MEM_INDEX_POS	(MEM_BASE_POS + REGISTER_BIT_LEN)
+#define MEM_SHIFT_POS	(MEM_INDEX_POS + REGISTER_BIT_LEN)
+#define MEM_DISP_POS	(MEM_SHIFT_POS + MEM_SHIFT_BLEN)
+
+DEFINE_BINARY_PARSER(mem, {
+	_CT_CHECKED(instr_get_register(&instr_data->rdest, bin_instr,
+				0, USE_R_HEAD_BIT));
+	_CT_CHECKED(instr_get_register(&instr_data->rsrc1, bin_instr,
+				MEM_BASE_POS, NO_R_HEAD_BIT));
+	_CT_CHECKED(instr_get_register(&instr_data->rsrc2, bin_instr,
+				MEM_INDEX_POS, NO_R_HEAD_BIT));
+	{
+		uint32_t unum = 0;
+		_CT_CHECKED(instr_get_bitfield(&unum, MEM_SHIFT_BLEN,
+					bin_instr, MEM_SHIFT_POS));
+		instr_data->shift = (uint8_t)unum;
+
+		_CT_CHECKED(instr_get_bitfield(&unum, MEM_DISP_BLEN,
+					bin_instr, MEM_DISP_POS));
+		instr_data->snum = bit_extend_signed(unum, MEM_DISP_BLEN);
+	}
+
+	_CT_CHECKED(get_raw_opcode(&instr_data->opcode, bin_instr));
+});
+
+DEFINE_BINARY_WRITER(mem, {
+
+	_CT_CHECKED(instr_set_register(instr_data->rdest, bin_instr,
+				0, USE_R_HEAD_BIT));
+	_CT_CHECKED(instr_set_register(instr_data->rsrc1, bin_instr,
+				MEM_BASE_POS, NO_R_HEAD_BIT));
+	_CT_CHECKED(instr_set_register(instr_data->rsrc2, bin_instr,
+				MEM_INDEX_POS, NO_R_HEAD_BIT));
+	_CT_CHECKED(instr_set_bitfield(instr_data->shift, MEM_SHIFT_BLEN,
+				bin_instr, MEM_SHIFT_POS));
+	_CT_CHECKED(instr_set_bitfield((uint32_t)instr_data->snum, MEM_DISP_BLEN,
+				bin_instr, MEM_DISP_POS));
+
+	_CT_CHECKED(set_raw_opcode(instr_data->opcode, bin_instr));
+});
+
+/**
+ * Parses the index scale after the point, like in ldx.8
+ */
+static int parse_mem_scale(const struct asm_token *scale_tok, uint8_t *shift) {
+	assert (scale_tok);
+	assert (shift);
+
+	int64_t scale = 0;
+
+	if (parse_integer(scale_tok->str, scale_tok->len, &scale)) {
+		return S_FAIL;
+	}
+
+	for (uint8_t i = 0; i < (1 << MEM_SHIFT_BLEN); i++) {
+		if (scale == 1 << i) {
+			*shift = i;
+			return S_OK;
+		}
+	}
+
+	return S_FAIL;
+}
+
+DEFINE_ASM_PARSER(mem, {
+	size_t arg = 3;
+
+	if (asm_instr->n_args < 1 + 2 || asm_instr->n_args > 1 + 5) {
+		_CT_FAIL();
+	}
+
+	_CT_CHECKED(parse_register(&asm_instr->args[1], &instr_data->rsrc1));
+	_CT_CHECKED(parse_register(&asm_instr->args[2], &instr_data->rdest));
+
+	instr_data->rsrc2 = MEM_NO_INDEX;
+	instr_data->shift = 0;
+	instr_data->snum = 0;
+
+	if (arg < asm_instr->n_args && *asm_instr->args[arg].str == 'r') {
+		_CT_CHECKED(parse_register(&asm_instr->args[arg], &instr_data->rsrc2));
+		arg++;
+	}
+
+	if (arg < asm_instr->n_args) {
+		_CT_CHECKED(parse_literal_number(&asm_instr->args[arg], &instr_data->snum));
+		arg++;
+	}
+
+	// ldx rb rd ri $shift $disp is not the syntax, the scale is the suffix
+	if (arg < asm_instr->n_args && *asm_instr->args[arg].str == '$') {
+		log_error("Unexpected operand <%.*s>, the index scale is written as %s.N",
+			  (int)asm_instr->args[arg].len, asm_instr->args[arg].str,
+			  asm_instr->op_cmd->cmd_name);
+		_CT_FAIL();
+	}
+
+	if (arg != asm_instr->n_args) {
+		_CT_FAIL();
+	}
+
+	if (test_integer_bounds(instr_data->snum, MEM_DISP_BLEN)) {
+		log_error("displacement <%d> is too long", instr_data->snum);
+		_CT_FAIL();
+	}
+
+	if (asm_instr->op_arg.len) {
+		if (	instr_data->rsrc2 == MEM_NO_INDEX ||
+			parse_mem_scale(&asm_instr->op_arg, &instr_data->shift)) {
+			log_error("Invalid index scale <%.*s>",
+				  (int)asm_instr->op_arg.len, asm_instr->op_arg.str);
+			_CT_FAIL();
+		}
+	}
+});
+
+DEFINE_ASM_WRITER(mem, {
+	status = fprintf(out_stream, "%s", op_cmd->cmd_name);
+
+	if (instr_data->shift) {
+		fprintf(out_stream, ".%d", 1 << instr_data->shift);
+	}
+
+	fprintf(out_stream, " r%d r%d", instr_data->rsrc1, instr_data->rdest);
+
+	if (instr_data->rsrc2 != MEM_NO_INDEX) {
+		fprintf(out_stream, " r%d", instr_data->rsrc2);
+	}
+
+	fprintf(out_stream, " $%d", instr_data->snum);
+});
+
+DEFINE_OP_LAYOUT(mem, 0);
@@ -27,8 +27,8 @@ DEFINE_ASM_PARSER(mov, {
 		_CT_FAIL();
 	}
 
-	_CT_CHECKED(parse_register(asm_instr->argsptrs[1], &instr_data->rdest));
-	_CT_CHECKED(parse_register(asm_instr->argsptrs[2], &instr_data->rsrc1));
+	_CT_CHECKED(parse_register(&asm_instr->args[1], &instr_data->rdest));
+	_CT_CHECKED(parse_register(&asm_instr->args[2], &instr_data->rsrc1));
 });
 
 
@@ -0,0 +1,58 @@
+#include <assert.h>
+#include "spu_asm.h"
+#include "spu_bit_ops.h"
+#include "opls.h"
+#include "translator_parsers.h"
+
+DEFINE_BINARY_PARSER(reg_imm, {
+	_CT_CHECKED(directive_get_register(&instr_data->rdest, bin_instr,
+				0, USE_R_HEAD_BIT));
+	{
+		uint32_t unum = 0;
+		_CT_CHECKED(directive_get_bitfield(&unum, IMM_INTEGER_BLEN,
+					bin_instr, FREGISTER_BIT_LEN));
+
+		instr_data->snum = bit_extend_signed(unum, IMM_INTEGER_BLEN);
+	}
+
+	_CT_CHECKED(get_directive_opcode(&instr_data->opcode, bin_instr));
+});
+
+DEFINE_BINARY_WRITER(reg_imm, {
+
+	_CT_CHECKED(directive_set_register(instr_data->rdest, bin_instr,
+				0, USE_R_HEAD_BIT));
+	_CT_CHECKED(directive_set_bitfield((uint32_t)instr_data->snum,
+				IMM_INTEGER_BLEN, bin_instr, FREGISTER_BIT_LEN));
+
+	_CT_CHECKED(set_directive_opcode(instr_data->opcode, bin_instr));
+});
+
+DEFINE_ASM_PARSER(reg_imm, {
+	if (asm_instr->n_args != 1 + 2) {
+		_CT_FAIL();
+	}
+
+	_CT_CHECKED(parse_register(&asm_instr->args[1], &instr_data->rdest));
+	_CT_CHECKED(parse_literal_number(&asm_instr->args[2], &instr_data->snum));
+
+	if (test_integer_bounds(instr_data->snum, IMM_INTEGER_BLEN)) {
+		log_error("immediate <%.*s> is too long",
+			  (int)asm_instr->args[2].len, asm_instr->args[2].str);
+		_CT_FAIL();
+	}
+
+	if (	(instr_data->opcode == SHLI_OPCODE ||
+		 instr_data->opcode == SHRI_OPCODE) &&
+		(instr_data->snum < 0 || instr_data->snum >= 64)) {
+		log_error("shift <%d> is out of range", instr_data->snum);
+		_CT_FAIL();
+	}
+});
+
+DEFINE_ASM_WRITER(reg_imm, {
+	status = fprintf(out_stream, "%s r%d $%d", op_cmd->cmd_name,
+			instr_data->rdest, instr_data->snum);
+});
+
+DEFINE_OP_LAYOUT(reg_imm, 1);
@@ -0,0 +1,54 @@
+#include <assert.h>
+#include "spu_asm.h"
+#include "spu_bit_ops.h"
+#include "opls.h"
+#include "translator_parsers.h"
+
+DEFINE_BINARY_PARSER(regmask, {
+	_CT_CHECKED(instr_get_bitfield(&instr_data->unum, REGMASK_BLEN,
+				bin_instr, 0));
+
+	_CT_CHECKED(get_raw_opcode(&instr_data->opcode, bin_instr));
+});
+
+DEFINE_BINARY_WRITER(regmask, {
+
+	_CT_CHECKED(instr_set_bitfield(instr_data->unum, REGMASK_BLEN,
+				bin_instr, 0));
+
+	_CT_CHECKED(set_raw_opcode(instr_data->opcode, bin_instr));
+});
+
+DEFINE_ASM_PARSER(regmask, {
+	if (asm_instr->n_args < 1 + 1) {
+		_CT_FAIL();
+	}
+
+	instr_data->unum = 0;
+
+	for (size_t i = 1; i < asm_instr->n_args; i++) {
+		spu_register_num_t reg = 0;
+
+		_CT_CHECKED(parse_register(&asm_instr->args[i], &reg));
+
+		if (reg >= REGMASK_BLEN || (instr_data->unum & (1u << reg))) {
+			log_error("Invalid register <%.*s> in the list",
+				  (int)asm_instr->args[i].len, asm_instr->args[i].str);
+			_CT_FAIL();
+		}
+
+		instr_data->unum |= 1u << reg;
+	}
+});
+
+DEFINE_ASM_WRITER(regmask, {
+	status = fprintf(out_stream, "%s", op_cmd->cmd_name);
+
+	for (unsigned reg = 0; reg < REGMASK_BLEN; reg++) {
+		if (instr_data->unum & (1u << reg)) {
+			fprintf(out_stream, " r%u", reg);
+		}
+	}
+});
+
+DEFINE_OP_LAYOUT(regmask, 0);
@@ -23,7 +23,7 @@ DEFINE_ASM_PARSER(single_reg, {
 		_CT_FAIL();
 	}
 
-	_CT_CHECKED(parse_register(asm_instr->argsptrs[1], &instr_data->rdest));
+	_CT_CHECKED(parse_register(&asm_instr->args[1], &instr_data->rdest));
 });
 
 
@@ -6,6 +6,11 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "spu_asm.h"
 
@@ -13,6 +18,7 @@
 #include "spu_bit_ops.h"
 #include "spu_debug.h"
 #include "spu_asm.h"
+#include "spu_obj.h"
 
 #ifdef _DEBUG
 #define DEBUG_INSTRUCTIONS
@@ -30,9 +36,18 @@ int SPUCtor(struct spu_context *ctx) {
 		.ip = 0,
 		.stack = {0},
 		.screen_height = SCREEN_HEIGHT,
-		.screen_width = SCREEN_WIDTH
+		.screen_width = SCREEN_WIDTH,
+		.consts = NULL,
+		.n_consts = 0,
+		.vlen = 0,
+		.vec_kernels = spu_vec_kernels_best(),
+		.profile = NULL,
 	};
 
+	if (spu_io_init(&ctx->io, stdin, stdout)) {
+		return S_FAIL;
+	}
+
 	if (pvector_init(&ctx->stack, sizeof(spu_data_t))) {
 		return S_FAIL;
 	}
@@ -41,10 +56,14 @@ int SPUCtor(struct spu_context *ctx) {
 		return S_FAIL;
 	}
 
-	ctx->ram = malloc(RAM_SIZE);
-	if (!ctx->ram) {
+	// RAM is addressed by 8-byte words. It is mapped, so host files
+	// can be mapped over its pages
+	void *ram = mmap(NULL, RAM_SIZE * sizeof(*ctx->ram), PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ram == MAP_FAILED) {
 		return S_FAIL;
 	}
+	ctx->ram = (int64_t *)ram;
 
 	init_op_cmd_opcode_table();
 
@@ -60,31 +79,169 @@ int SPUDtor(struct spu_context *ctx) {
 
 	pvector_destroy(&ctx->stack);
 	pvector_destroy(&ctx->call_stack);
-	free(ctx->ram);
+	// Unmaps the files mapped over the RAM too, shared ones are written back
+	if (ctx->ram) {
+		munmap(ctx->ram, RAM_SIZE * sizeof(*ctx->ram));
+		ctx->ram = NULL;
+	}
+	free(ctx->consts);
 
-	return S_OK;
+	return spu_io_destroy(&ctx->io);
+}
+
+static int SPULoadObject(struct spu_context *ctx, char *buf, size_t buflen) {
+	assert (ctx);
+	assert (buf);
+
+	int ret = S_OK;
+	struct spu_obj obj = {{0}};
+	spu_instruction_t *instr_buf = NULL;
+	spu_data_t *consts = NULL;
+
+	if (spu_obj_parse(&obj, buf, buflen)) {
+		free(buf);
+		return S_FAIL;
+	}
+
+	if (obj.header.n_relocs) {
+		log_error("The object has unresolved relocations, link it with spu-ld");
+		_CT_FAIL();
+	}
+
+	if (obj.header.n_data > RAM_SIZE) {
+		log_error("The data section does not fit into the RAM");
+		_CT_FAIL();
+	}
+
+	instr_buf = (spu_instruction_t *)calloc(obj.header.n_code + 1,
+						sizeof(spu_instruction_t));
+	consts = (spu_data_t *)calloc(obj.header.n_consts + 1, sizeof(spu_data_t));
+	if (!instr_buf || !consts) {
+		free(instr_buf);
+		free(consts);
+		_CT_FAIL();
+	}
+
+	memcpy(instr_buf, obj.code, obj.header.n_code * sizeof(spu_instruction_t));
+	memcpy(consts, obj.consts, obj.header.n_consts * sizeof(spu_data_t));
+	memcpy(ctx->ram, obj.data, obj.header.n_data * sizeof(spu_data_t));
+
+	ctx->consts = consts;
+	ctx->n_consts = obj.header.n_consts;
+	ctx->instr_buf = instr_buf;
+	ctx->instr_bufsize = obj.header.n_code;
+	ctx->ip = 0;
+
+_CT_EXIT_POINT:
+	spu_obj_destroy(&obj);
+	return ret;
 }
 
 int SPULoadBinary(struct spu_context *ctx, const char *filename) {
 	assert (ctx);
 	assert (filename);
 
-	spu_instruction_t *instr_buf = NULL;
-	size_t instr_bufsize = 0;
+	char *buf = NULL;
+	size_t buflen = 0;
 	int ret = S_OK;
 
-	_CT_CHECKED(read_file(filename, (char **)&instr_buf, &instr_bufsize));
+	_CT_CHECKED(read_file(filename, &buf, &buflen));
 
-	instr_bufsize /= sizeof(spu_instruction_t);
+	if (spu_obj_is_object(buf, buflen)) {
+		return SPULoadObject(ctx, buf, buflen);
+	}
 
-	ctx->instr_buf = instr_buf;
-	ctx->instr_bufsize = instr_bufsize;
+	// Raw stream of instructions
+	ctx->instr_buf = (spu_instruction_t *)(void *)buf;
+	ctx->instr_bufsize = buflen / sizeof(spu_instruction_t);
 	ctx->ip = 0;
 
 _CT_EXIT_POINT:
 	return ret;
 }
 
+static void SPUSetPagesReadonly(struct spu_context *ctx,
+				size_t first_page, size_t n_pages, int readonly) {
+	assert (ctx);
+	assert (first_page + n_pages <= RAM_N_PAGES);
+
+	for (size_t page = first_page; page < first_page + n_pages; page++) {
+		uint64_t bit = (uint64_t)1 << (page % 64);
+
+		if (readonly) {
+			ctx->ro_pages[page / 64] |= bit;
+		} else {
+			ctx->ro_pages[page / 64] &= ~bit;
+		}
+	}
+
+	ctx->n_ro_pages = 0;
+	for (size_t i = 0; i < RAM_N_PAGES / 64; i++) {
+		ctx->n_ro_pages += (size_t)__builtin_popcountll(ctx->ro_pages[i]);
+	}
+}
+
+/**
+ * Maps the host file over the RAM from the word addr, which must be
+ * aligned to the page. Writes to the read-only mapping fault the SPU,
+ * writes to the other one go to the file.
+ */
+int SPUMapFile(struct spu_context *ctx, const char *filename,
+	       size_t addr, int readonly) {
+	assert (ctx);
+	assert (filename);
+
+	int ret = S_OK;
+	struct stat st = {0};
+	size_t host_page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t map_len = 0;
+	void *data = NULL;
+
+	int fd = open(filename, readonly ? O_RDONLY : O_RDWR);
+	if (fd < 0) {
+		log_error("Unable to open file %s", filename);
+		return S_FAIL;
+	}
+
+	if (fstat(fd, &st) || st.st_size < 0) {
+		log_error("Unable to stat file %s", filename);
+		_CT_FAIL();
+	}
+
+	if (	addr % RAM_PAGE_WORDS || (addr * sizeof(*ctx->ram)) % host_page ||
+		addr > RAM_SIZE ||
+		(size_t)st.st_size > (RAM_SIZE - addr) * sizeof(*ctx->ram)) {
+		log_error("File %s does not fit into the RAM from <%zu>, "
+			  "the address must be aligned to %zu words", filename, addr,
+			  host_page / sizeof(*ctx->ram));
+		_CT_FAIL();
+	}
+
+	// mmap does not accept empty mappings
+	if (st.st_size == 0) {
+		goto _CT_EXIT_POINT;
+	}
+
+	// Up to the page end, the bytes past the end of file are zeros
+	map_len = ((size_t)st.st_size + host_page - 1) / host_page * host_page;
+
+	data = mmap(ctx->ram + addr, map_len,
+		    readonly ? PROT_READ : PROT_READ | PROT_WRITE,
+		    (readonly ? MAP_PRIVATE : MAP_SHARED) | MAP_FIXED, fd, 0);
+	if (data == MAP_FAILED) {
+		log_error("Unable to map file %s", filename);
+		_CT_FAIL();
+	}
+
+	SPUSetPagesReadonly(ctx, addr / RAM_PAGE_WORDS,
+			    (map_len / sizeof(*ctx->ram) + RAM_PAGE_WORDS - 1) /
+				RAM_PAGE_WORDS, readonly);
+
+_CT_EXIT_POINT:
+	close(fd);
+	return ret;
+}
+
 int SPUExecuteInstruction(struct spu_context *ctx, struct spu_instruction instr) {
 	assert (ctx);
 
@@ -109,6 +266,7 @@ int SPUExecuteInstruction(struct spu_context *ctx, struct spu_instruction instr)
 	_CT_CHECKED(op_cmd->layout->parse_bin_fn(&instr, &instr_data));
 
 #ifdef DEBUG_INSTRUCTIONS
+	_CT_CHECKED(spu_io_flush(&ctx->io));
 	fprintf(stdout, "Executing <");
 	_CT_CHECKED(op_cmd->layout->write_asm_fn(&instr_data, stdout));
 	fprintf(stdout, ">\n");
@@ -120,7 +278,44 @@ _CT_EXIT_POINT:
 	return ret;
 }
 
-int SPUExecute(struct spu_context *ctx) {
+/**
+ * Same as SPUExecute, but counts executed instructions and
+ * control transfers. Kept apart so the plain loop does not pay for it.
+ */
+static int SPUExecuteProfiled(struct spu_context *ctx) {
+	assert (ctx);
+	assert (ctx->profile);
+
+	int ret = S_OK;
+	struct spu_profile *profile = ctx->profile;
+
+	assert (profile->n_code >= ctx->instr_bufsize);
+
+	while (ctx->ip < ctx->instr_bufsize) {
+		size_t ip = ctx->ip;
+		struct spu_instruction instr = {
+			.instruction = ctx->instr_buf[ip]
+		};
+		ctx->ip++;
+
+		ret = SPUExecuteInstruction(ctx, instr);
+
+		profile->counts[ip]++;
+		if (ctx->ip != ip + 1) {
+			profile->taken[ip]++;
+		}
+
+		if (ret < 0) {
+			return S_FAIL;
+		} else if (ret > 0) {
+			return S_OK;
+		}
+	}
+
+	return S_OK;
+}
+
+static int SPUExecuteLoop(struct spu_context *ctx) {
 	assert (ctx);
 
 	int ret = S_OK;
@@ -142,6 +337,19 @@ int SPUExecute(struct spu_context *ctx) {
 	return S_OK;
 }
 
+int SPUExecute(struct spu_context *ctx) {
+	assert (ctx);
+
+	int ret = ctx->profile ? SPUExecuteProfiled(ctx) : SPUExecuteLoop(ctx);
+
+	// The output of the crashed program is written out too
+	if (spu_io_flush(&ctx->io)) {
+		ret = S_FAIL;
+	}
+
+	return ret;
+}
+
 // Dumps first n registers
 #define N_DUMPED_REGISTERS (6)
 
@@ -151,6 +359,9 @@ int SPUDump(struct spu_context *ctx, FILE *out_stream) {
 
 #define DPRINT(...) fprintf(out_stream, __VA_ARGS__)
 
+	// Keeps the order with the buffered output of the program
+	spu_io_flush(&ctx->io);
+
 	DPRINT(	"SPU Core Dumped: {\n\n" );
 	for (size_t i = 0; i < N_DUMPED_REGISTERS; i++) {
 		DPRINT("r%zu:\t<0x", i);
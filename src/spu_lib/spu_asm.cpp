@@ -129,11 +129,12 @@ const struct op_cmd *find_op_cmd(const char *cmd_name) {
 */
 
 // /*
-const struct op_cmd *find_op_cmd(const char *cmd_name) {
+const struct op_cmd *find_op_cmd(const char *cmd_name, size_t cmd_len) {
 	const struct op_cmd *op_cmd_ptr = op_table;
 
 	while (op_cmd_ptr->cmd_name != NULL) {
-		if (!strcmp(cmd_name, op_cmd_ptr->cmd_name)) {
+		if (!strncmp(cmd_name, op_cmd_ptr->cmd_name, cmd_len) &&
+		    op_cmd_ptr->cmd_name[cmd_len] == '\0') {
 			return op_cmd_ptr;
 		}
 		op_cmd_ptr++;
@@ -28,10 +28,17 @@ OP_EXEC_FN(ldp_exec) {
 	return S_OK;
 }
 
-OP_EXEC_FN(cmp_exec) {
-	int64_t lnum = ctx->registers[instr.rdest];
-	int64_t rnum = ctx->registers[instr.rsrc1];
+OP_EXEC_FN(ldk_exec) {
+	if (instr.snum < 0 || (size_t) instr.snum >= ctx->n_consts) {
+		return S_FAIL;
+	}
+
+	ctx->registers[instr.rdest] = ctx->consts[instr.snum];
+
+	return S_OK;
+}
 
+static void set_cmp_flags(struct spu_context *ctx, int64_t lnum, int64_t rnum) {
 	ctx->RFLAGS = 0;
 
 	if (lnum == rnum) {
@@ -40,6 +47,16 @@ OP_EXEC_FN(cmp_exec) {
 	if (lnum < rnum) {
 		ctx->RFLAGS |= CMP_SIGN_FLAG;
 	}
+}
+
+OP_EXEC_FN(cmp_exec) {
+	set_cmp_flags(ctx, ctx->registers[instr.rdest], ctx->registers[instr.rsrc1]);
+
+	return S_OK;
+}
+
+OP_EXEC_FN(cmpi_exec) {
+	set_cmp_flags(ctx, ctx->registers[instr.rdest], instr.snum);
 
 	return S_OK;
 }
@@ -65,18 +82,51 @@ _CT_EXIT_POINT:
 	return ret;
 }
 
-OP_EXEC_FN(simple_io_exec) {
+OP_EXEC_FN(rpush_pop_mask_exec) {
 	int ret = S_OK;
+	uint32_t mask = instr.unum;
 
 	switch (instr.opcode) {
-		case INPUT_OPCODE:
-			if (scanf("%ld", &ctx->registers[instr.rdest]) != 1) {
+		case PUSHM_OPCODE:
+			for (; mask; mask &= mask - 1) {
+				unsigned reg = (unsigned)__builtin_ctz(mask);
+
+				_CT_FAIL_NONZERO(pvector_push_back(
+					&ctx->stack, &(ctx->registers[reg])));
+			}
+
+			break;
+		case POPM_OPCODE:
+			// Nothing is popped if the stack is too short
+			if (ctx->stack.len < (size_t)__builtin_popcount(mask)) {
 				_CT_FAIL();
 			}
 
+			for (; mask; mask &= ~(1u << (31 - __builtin_clz(mask)))) {
+				unsigned reg = (unsigned)(31 - __builtin_clz(mask));
+
+				_CT_FAIL_NONZERO(pvector_pop_back(
+					&ctx->stack, &(ctx->registers[reg])));
+			}
+
+			break;
+		default:
+			_CT_FAIL();
+	}
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+OP_EXEC_FN(simple_io_exec) {
+	int ret = S_OK;
+
+	switch (instr.opcode) {
+		case INPUT_OPCODE:
+			_CT_CHECKED(spu_io_read_int(&ctx->io, &ctx->registers[instr.rdest]));
 			break;
 		case PRINT_OPCODE:
-			printf("%ld\n", ctx->registers[instr.rdest]);
+			_CT_CHECKED(spu_io_print_int(&ctx->io, ctx->registers[instr.rdest]));
 			break;
 
 		default:
@@ -117,6 +167,23 @@ OP_EXEC_FN(arithm_unary_exec) {
 		case NOT_OPCODE:
 			ctx->registers[instr.rdest] = ~(ctx->registers[instr.rsrc1]);
 			break;
+		case POPCNT_OPCODE:
+			ctx->registers[instr.rdest] =
+				__builtin_popcountll((uint64_t)ctx->registers[instr.rsrc1]);
+			break;
+		// Builtins are undefined for zero, the SPU defines them as 64
+		case CLZ_OPCODE:
+			ctx->registers[instr.rdest] = ctx->registers[instr.rsrc1] ?
+				__builtin_clzll((uint64_t)ctx->registers[instr.rsrc1]) : 64;
+			break;
+		case CTZ_OPCODE:
+			ctx->registers[instr.rdest] = ctx->registers[instr.rsrc1] ?
+				__builtin_ctzll((uint64_t)ctx->registers[instr.rsrc1]) : 64;
+			break;
+		case BSWAP_OPCODE:
+			ctx->registers[instr.rdest] = (int64_t)
+				__builtin_bswap64((uint64_t)ctx->registers[instr.rsrc1]);
+			break;
 		default:
 			return S_FAIL;
 	}
@@ -144,13 +211,30 @@ OP_EXEC_FN(arithm_binary_exec) {
 		case SHL_OPCODE:
 			ctx->registers[instr.rdest] = 
 			(int64_t) ((uint64_t) ctx->registers[instr.rsrc1] << 
-					(uint64_t) ctx->registers[instr.rsrc2]);
+					((uint64_t) ctx->registers[instr.rsrc2] & 63));
 			break;
 		case SHR_OPCODE:
 			ctx->registers[instr.rdest] = 
 			(int64_t) ((uint64_t) ctx->registers[instr.rsrc1] >>
-					(uint64_t) ctx->registers[instr.rsrc2]);
+					((uint64_t) ctx->registers[instr.rsrc2] & 63));
+			break;
+		// Compilers turn these into the host rotate instructions
+		case ROL_OPCODE: {
+			uint64_t value = (uint64_t) ctx->registers[instr.rsrc1];
+			uint64_t count = (uint64_t) ctx->registers[instr.rsrc2] & 63;
+
+			ctx->registers[instr.rdest] =
+				(int64_t) ((value << count) | (value >> ((64 - count) & 63)));
+			break;
+		}
+		case ROR_OPCODE: {
+			uint64_t value = (uint64_t) ctx->registers[instr.rsrc1];
+			uint64_t count = (uint64_t) ctx->registers[instr.rsrc2] & 63;
+
+			ctx->registers[instr.rdest] =
+				(int64_t) ((value >> count) | (value << ((64 - count) & 63)));
 			break;
+		}
 		case DIV_OPCODE:
 			if (ctx->registers[instr.rsrc2] == 0) {
 				return S_FAIL;
@@ -175,3 +259,57 @@ OP_EXEC_FN(arithm_binary_exec) {
 
 	return S_OK;
 }
+
+OP_EXEC_FN(bitfield_exec) {
+	uint64_t src = (uint64_t) ctx->registers[instr.rsrc1];
+	uint64_t dst = (uint64_t) ctx->registers[instr.rdest];
+	uint64_t mask = (instr.unum >= 64) ? UINT64_MAX : ((uint64_t)1 << instr.unum) - 1;
+
+	if (instr.unum == 0 || instr.shift + instr.unum > 64) {
+		return S_FAIL;
+	}
+
+	switch (instr.opcode) {
+		case BFX_OPCODE:
+			ctx->registers[instr.rdest] = (int64_t) ((src >> instr.shift) & mask);
+			break;
+		case BFI_OPCODE:
+			mask <<= instr.shift;
+			ctx->registers[instr.rdest] =
+				(int64_t) ((dst & ~mask) | ((src << instr.shift) & mask));
+			break;
+		default:
+			return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+OP_EXEC_FN(arithm_imm_exec) {
+	spu_data_t *reg = &ctx->registers[instr.rdest];
+
+	switch (instr.opcode) {
+		case ADDI_OPCODE:
+			*reg = (int64_t) ((uint64_t) *reg + (uint64_t) instr.snum);
+			break;
+		case SUBI_OPCODE:
+			*reg = (int64_t) ((uint64_t) *reg - (uint64_t) instr.snum);
+			break;
+		case MULI_OPCODE:
+			*reg = (int64_t) ((uint64_t) *reg * (uint64_t) instr.snum);
+			break;
+		case SHRI_OPCODE:
+			*reg = (int64_t) ((uint64_t) *reg >> (instr.unum & 63));
+			break;
+		case SHLI_OPCODE:
+			*reg = (int64_t) ((uint64_t) *reg << (instr.unum & 63));
+			break;
+		case ANDI_OPCODE:
+			*reg &= instr.snum;
+			break;
+		default:
+			return S_FAIL;
+	}
+
+	return S_OK;
+}
@@ -0,0 +1,101 @@
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include "spu_asm.h"
+#include "spu.h"
+
+// fprint writes 17 significant digits, enough to read the same double back,
+// the sign, the point, the exponent and the newline
+#define FPRINT_MAX_LEN (32)
+
+// Registers keep the bits of doubles, memcpy is the defined way to reinterpret them
+static double reg_to_double(spu_data_t value) {
+	double num = 0;
+
+	memcpy(&num, &value, sizeof(num));
+
+	return num;
+}
+
+static spu_data_t double_to_reg(double num) {
+	spu_data_t value = 0;
+
+	memcpy(&value, &num, sizeof(value));
+
+	return value;
+}
+
+static void set_fcmp_flags(struct spu_context *ctx, double lnum, double rnum) {
+	ctx->RFLAGS = 0;
+
+	if (isunordered(lnum, rnum)) {
+		ctx->RFLAGS |= CMP_OVERFLOW_FLAG;
+		return;
+	}
+
+	if (!isless(lnum, rnum) && !isgreater(lnum, rnum)) {
+		ctx->RFLAGS |= CMP_EQ_FLAG;
+	}
+	if (isless(lnum, rnum)) {
+		ctx->RFLAGS |= CMP_SIGN_FLAG;
+	}
+}
+
+OP_EXEC_FN(float_exec) {
+	spu_data_t *dst = &ctx->registers[instr.rdest];
+	double lnum = reg_to_double(ctx->registers[instr.rsrc1]);
+	double rnum = reg_to_double(ctx->registers[instr.rsrc2]);
+
+	switch (instr.opcode) {
+		case FADD_OPCODE:
+			*dst = double_to_reg(lnum + rnum);
+			break;
+		case FSUB_OPCODE:
+			*dst = double_to_reg(lnum - rnum);
+			break;
+		case FMUL_OPCODE:
+			*dst = double_to_reg(lnum * rnum);
+			break;
+		case FDIV_OPCODE:
+			*dst = double_to_reg(lnum / rnum);
+			break;
+		case FSQRT_OPCODE:
+			*dst = double_to_reg(sqrt(lnum));
+			break;
+		case FCMP_OPCODE:
+			set_fcmp_flags(ctx, reg_to_double(*dst), lnum);
+			break;
+		case ITOF_OPCODE:
+			*dst = double_to_reg((double)ctx->registers[instr.rsrc1]);
+			break;
+		case FTOI_OPCODE:
+			// The conversion of out of range values is undefined
+			if (!(lnum >= -0x1p63 && lnum < 0x1p63)) {
+				return S_FAIL;
+			}
+
+			*dst = (spu_data_t)lnum;
+			break;
+		case FINPUT_OPCODE:
+			if (spu_io_read_double(&ctx->io, &lnum)) {
+				return S_FAIL;
+			}
+
+			*dst = double_to_reg(lnum);
+			break;
+		case FPRINT_OPCODE: {
+			char text[FPRINT_MAX_LEN] = {0};
+			int len = snprintf(text, sizeof(text), "%.17g\n", reg_to_double(*dst));
+
+			if (len < 0 || (size_t)len >= sizeof(text) ||
+			    spu_io_write(&ctx->io, text, (size_t)len)) {
+				return S_FAIL;
+			}
+			break;
+		}
+		default:
+			return S_FAIL;
+	}
+
+	return S_OK;
+}
@@ -6,11 +6,14 @@ static inline int do_conditional_jump(
 	struct spu_context *ctx, int condition) {
 	assert (ctx);
 
+	// Set by fcmp of NaN, unordered values are neither equal, less nor greater
+	int unordered = (ctx->RFLAGS & CMP_OVERFLOW_FLAG) != 0;
+
 	switch (condition) {
 		case UNCONDITIONAL_JMP:
 			break;
 		case EQUALS_JMP:
-			if (!(ctx->RFLAGS & CMP_EQ_FLAG)) {
+			if (unordered || !(ctx->RFLAGS & CMP_EQ_FLAG)) {
 				return 0;
 			}
 			break;
@@ -20,24 +23,24 @@ static inline int do_conditional_jump(
 			}
 			break;
 		case GREATER_EQUALS_JMP:
-			if ((ctx->RFLAGS & CMP_SIGN_FLAG)) {
+			if (unordered || (ctx->RFLAGS & CMP_SIGN_FLAG)) {
 				return 0;
 			}
 			break;
 		case GREATER_JMP:
-			if ((ctx->RFLAGS & CMP_SIGN_FLAG) ||
+			if (unordered || (ctx->RFLAGS & CMP_SIGN_FLAG) ||
 			    (ctx->RFLAGS & CMP_EQ_FLAG)) {
 				return 0;
 			}
 			break;
 		case LESS_EQUALS_JMP:
-			if (!(ctx->RFLAGS & CMP_SIGN_FLAG) &&
-			    !(ctx->RFLAGS & CMP_EQ_FLAG)) {
+			if (unordered || (!(ctx->RFLAGS & CMP_SIGN_FLAG) &&
+					  !(ctx->RFLAGS & CMP_EQ_FLAG))) {
 				return 0;
 			}
 			break;
 		case LESS_JMP:
-			if (!(ctx->RFLAGS & CMP_SIGN_FLAG)) {
+			if (unordered || !(ctx->RFLAGS & CMP_SIGN_FLAG)) {
 				return 0;
 			}
 			break;
@@ -49,10 +52,12 @@ static inline int do_conditional_jump(
 }
 
 
-OP_EXEC_FN(jmp_exec) {
-	int64_t new_ip = (int64_t)ctx->ip + instr.jmp_position;
+static int jump_relative(struct spu_context *ctx, int64_t offset, int condition) {
+	assert (ctx);
+
+	int64_t new_ip = (int64_t)ctx->ip + offset;
 
-	int status = do_conditional_jump(ctx, instr.jmp_condition);
+	int status = do_conditional_jump(ctx, condition);
 	if (status < 0) {
 		return S_FAIL;
 	} else if (status > 0) {
@@ -67,6 +72,40 @@ OP_EXEC_FN(jmp_exec) {
 	return S_OK;
 }
 
+OP_EXEC_FN(jmp_exec) {
+	return jump_relative(ctx, instr.jmp_position, instr.jmp_condition);
+}
+
+OP_EXEC_FN(cond_exec) {
+	int status = do_conditional_jump(ctx, (int)instr.condition);
+
+	if (status < 0) {
+		return S_FAIL;
+	}
+
+	if (instr.opcode == SET_OPCODE) {
+		ctx->registers[instr.rdest] = status;
+	} else if (status > 0) {
+		ctx->registers[instr.rdest] = ctx->registers[instr.rsrc1];
+	}
+
+	return S_OK;
+}
+
+OP_EXEC_FN(loop_exec) {
+	// The counter wraps around like the other arithmetic
+	ctx->registers[instr.rdest] =
+		(int64_t)((uint64_t)ctx->registers[instr.rdest] - 1);
+
+	if (ctx->registers[instr.rdest] == 0) {
+		return S_OK;
+	}
+
+	instr.jmp_condition = UNCONDITIONAL_JMP;
+
+	return jmp_exec(ctx, instr);
+}
+
 OP_EXEC_FN(call_exec) {
 	int ret = S_OK;
 
@@ -85,6 +124,56 @@ _CT_EXIT_POINT:
 	return ret;
 }
 
+OP_EXEC_FN(jmpr_exec) {
+	int ret = S_OK;
+	spu_data_t target = ctx->registers[instr.rdest];
+
+	if (target < 0 || (size_t)target >= ctx->instr_bufsize) {
+		log_error("invalid jump target <%ld>", target);
+		_CT_FAIL();
+	}
+
+	if (instr.opcode == CALLR_OPCODE) {
+		if (ctx->call_stack.len >= RET_STACK_MAX_SIZE) {
+			log_error("call stack overflow");
+			_CT_FAIL();
+		}
+
+		_CT_FAIL_NONZERO(
+			pvector_push_back(&ctx->call_stack, &ctx->ip));
+	}
+
+	ctx->ip = (size_t)target;
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+OP_EXEC_FN(jmpl_exec) {
+	int ret = S_OK;
+
+	if (instr.jmp_position < 0 || (size_t)instr.jmp_position >= ctx->n_consts) {
+		log_error("invalid jump offset index <%d>", instr.jmp_position);
+		_CT_FAIL();
+	}
+
+	if (instr.opcode == CALLL_OPCODE) {
+		if (ctx->call_stack.len >= RET_STACK_MAX_SIZE) {
+			log_error("call stack overflow");
+			_CT_FAIL();
+		}
+
+		_CT_FAIL_NONZERO(
+			pvector_push_back(&ctx->call_stack, &ctx->ip));
+	}
+
+	_CT_CHECKED(jump_relative(ctx, ctx->consts[instr.jmp_position],
+				  instr.jmp_condition));
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
 OP_EXEC_FN(ret_exec) {
 	int ret = S_OK;
 
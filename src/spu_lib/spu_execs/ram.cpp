@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <string.h>
 #include "spu_asm.h"
 #include "spu.h"
 #include "math.h"
@@ -12,6 +13,10 @@ OP_EXEC_FN(ram_exec) {
 
 	switch (instr.opcode) {
 		case STM_OPCODE:
+			if (!spu_ram_writable(ctx, (size_t) mem_idx, 1)) {
+				return S_FAIL;
+			}
+
 			// eprintf("%016lx\n", *sreg);
 			ctx->ram[mem_idx] = *sreg;
 			break;
@@ -26,6 +31,240 @@ OP_EXEC_FN(ram_exec) {
 	return S_OK;
 }
 
+/**
+ * Address of the memory operand Rb + (Ri << shift) + displacement,
+ * in words or in bytes depending on the instruction.
+ */
+static uint64_t mem_operand_addr(const struct spu_context *ctx,
+				 const struct spu_instr_data *instr) {
+	uint64_t addr = (uint64_t) ctx->registers[instr->rsrc1] + (uint64_t) instr->snum;
+
+	if (instr->rsrc2 != MEM_NO_INDEX) {
+		addr += (uint64_t) ctx->registers[instr->rsrc2] << instr->shift;
+	}
+
+	return addr;
+}
+
+OP_EXEC_FN(ram_indexed_exec) {
+	uint64_t mem_idx = mem_operand_addr(ctx, &instr);
+
+	if (mem_idx >= RAM_SIZE) {
+		return S_FAIL;
+	}
+
+	switch (instr.opcode) {
+		case STX_OPCODE:
+			if (!spu_ram_writable(ctx, mem_idx, 1)) {
+				return S_FAIL;
+			}
+
+			ctx->ram[mem_idx] = ctx->registers[instr.rdest];
+			break;
+		case LDX_OPCODE:
+			ctx->registers[instr.rdest] = ctx->ram[mem_idx];
+			break;
+		default:
+			return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+OP_EXEC_FN(ram_byte_exec) {
+	uint64_t byte_idx = mem_operand_addr(ctx, &instr);
+	uint8_t *bytes = (uint8_t *)ctx->ram;
+	int64_t *reg = &ctx->registers[instr.rdest];
+	int32_t word = 0;
+
+	// The range check does not overflow, RAM_SIZE is far from the limit
+	size_t access_len = (instr.opcode == LDB_OPCODE ||
+			     instr.opcode == STB_OPCODE) ? 1 : sizeof(word);
+	if (byte_idx >= RAM_SIZE * sizeof(*ctx->ram) ||
+	    RAM_SIZE * sizeof(*ctx->ram) - byte_idx < access_len) {
+		return S_FAIL;
+	}
+
+	if (	(instr.opcode == STB_OPCODE || instr.opcode == STW_OPCODE) &&
+		!spu_ram_writable(ctx, byte_idx / sizeof(*ctx->ram),
+				  (byte_idx + access_len - 1) / sizeof(*ctx->ram) -
+					byte_idx / sizeof(*ctx->ram) + 1)) {
+		return S_FAIL;
+	}
+
+	switch (instr.opcode) {
+		case LDB_OPCODE:
+			*reg = bytes[byte_idx];
+			break;
+		case STB_OPCODE:
+			bytes[byte_idx] = (uint8_t) *reg;
+			break;
+		case LDW_OPCODE:
+			memcpy(&word, bytes + byte_idx, sizeof(word));
+			*reg = word;
+			break;
+		case STW_OPCODE:
+			word = (int32_t) *reg;
+			memcpy(bytes + byte_idx, &word, sizeof(word));
+			break;
+		default:
+			return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+OP_EXEC_FN(ram_bit_exec) {
+	int64_t bit_idx = ctx->registers[instr.rsrc1];
+	int64_t mem_idx = ctx->registers[instr.rdest];
+
+	if (bit_idx < 0 || mem_idx < 0 || mem_idx >= RAM_SIZE ||
+	    bit_idx / 64 >= RAM_SIZE - mem_idx) {
+		return S_FAIL;
+	}
+
+	mem_idx += bit_idx / 64;
+	uint64_t mask = (uint64_t) 1 << (bit_idx % 64);
+
+	if (instr.opcode != BTST_OPCODE && !spu_ram_writable(ctx, (size_t) mem_idx, 1)) {
+		return S_FAIL;
+	}
+
+	uint64_t *word = (uint64_t *)&ctx->ram[mem_idx];
+
+	switch (instr.opcode) {
+		case BSET_OPCODE:
+			*word |= mask;
+			break;
+		case BCLR_OPCODE:
+			*word &= ~mask;
+			break;
+		case BTST_OPCODE:
+			ctx->RFLAGS = (*word & mask) ? CMP_EQ_FLAG : CMP_SIGN_FLAG;
+			break;
+		default:
+			return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+static int ram_range_valid(int64_t addr, int64_t len) {
+	return addr >= 0 && len >= 0 && addr <= RAM_SIZE && len <= RAM_SIZE - addr;
+}
+
+static void ram_fill(int64_t *dst, int64_t value, size_t len) {
+	uint8_t byte = (uint8_t) value;
+	int64_t pattern = 0;
+
+	memset(&pattern, byte, sizeof(pattern));
+
+	// Like zeroing, most fills repeat a single byte
+	if (pattern == value) {
+		memset(dst, byte, len * sizeof(*dst));
+		return;
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		dst[i] = value;
+	}
+}
+
+OP_EXEC_FN(ram_bulk_exec) {
+	int64_t dst_idx = ctx->registers[instr.rdest];
+	int64_t len = ctx->registers[instr.rsrc2];
+	int64_t src_idx = ctx->registers[instr.rsrc1];
+
+	if (!ram_range_valid(dst_idx, len)) {
+		return S_FAIL;
+	}
+
+	if (	instr.opcode != MCMP_OPCODE &&
+		!spu_ram_writable(ctx, (size_t) dst_idx, (size_t) len)) {
+		return S_FAIL;
+	}
+
+	switch (instr.opcode) {
+		case MSET_OPCODE:
+			ram_fill(ctx->ram + dst_idx, src_idx, (size_t) len);
+			return S_OK;
+		case MCPY_OPCODE:
+		case MCMP_OPCODE:
+			break;
+		default:
+			return S_FAIL;
+	}
+
+	if (!ram_range_valid(src_idx, len)) {
+		return S_FAIL;
+	}
+
+	const int64_t *lhs = ctx->ram + dst_idx;
+	const int64_t *rhs = ctx->ram + src_idx;
+
+	if (instr.opcode == MCPY_OPCODE) {
+		memmove(ctx->ram + dst_idx, rhs, (size_t) len * sizeof(*rhs));
+		return S_OK;
+	}
+
+	ctx->RFLAGS = CMP_EQ_FLAG;
+
+	if (memcmp(lhs, rhs, (size_t) len * sizeof(*lhs)) == 0) {
+		return S_OK;
+	}
+
+	for (int64_t i = 0; i < len; i++) {
+		if (lhs[i] != rhs[i]) {
+			ctx->RFLAGS = (lhs[i] < rhs[i]) ? CMP_SIGN_FLAG : 0;
+			break;
+		}
+	}
+
+	return S_OK;
+}
+
+OP_EXEC_FN(ram_stream_exec) {
+	int64_t len = ctx->registers[instr.rdest];
+	int64_t stream = ctx->registers[instr.rsrc1];
+	int64_t mem_idx = ctx->registers[instr.rsrc2];
+	size_t n_moved = (size_t) len;
+
+	// The whole range is checked once, the RAM is seen as bytes
+	if (	stream < 0 || len < 0 || mem_idx < 0 || mem_idx > RAM_SIZE ||
+		(uint64_t) len > (uint64_t) (RAM_SIZE - mem_idx) * sizeof(*ctx->ram)) {
+		return S_FAIL;
+	}
+
+	char *bytes = (char *)(ctx->ram + mem_idx);
+
+	if (	instr.opcode == READ_OPCODE &&
+		!spu_ram_writable(ctx, (size_t) mem_idx,
+				  ((size_t) len + sizeof(*ctx->ram) - 1) / sizeof(*ctx->ram))) {
+		return S_FAIL;
+	}
+
+	switch (instr.opcode) {
+		case READ_OPCODE:
+			if (spu_io_read_stream(&ctx->io, (size_t) stream,
+					       bytes, (size_t) len, &n_moved)) {
+				return S_FAIL;
+			}
+			break;
+		case WRITE_OPCODE:
+			if (spu_io_write_stream(&ctx->io, (size_t) stream,
+						bytes, (size_t) len)) {
+				return S_FAIL;
+			}
+			break;
+		default:
+			return S_FAIL;
+	}
+
+	ctx->registers[instr.rdest] = (int64_t) n_moved;
+
+	return S_OK;
+}
+
 OP_EXEC_FN(scrhw_exec) {
 	ctx->registers[instr.rdest] = (int64_t) ctx->screen_height;
 	ctx->registers[instr.rsrc1] = (int64_t) ctx->screen_width;
@@ -50,17 +289,15 @@ OP_EXEC_FN(draw_exec) {
 	for (size_t i = 0; i < scr_len; i++) {
 		char el = vmem[i];
 
-		if (i != 0 && i % ctx->screen_height == 0) {
-			printf("\n");
+		if (i != 0 && i % ctx->screen_height == 0 &&
+		    spu_io_write(&ctx->io, "\n", 1)) {
+			return S_FAIL;
 		}
 
-		if (el) {
-			printf("* ");
-		} else {
-			printf(". ");
+		if (spu_io_write(&ctx->io, el ? "* " : ". ", 2)) {
+			return S_FAIL;
 		}
 	}
-	printf("\n");
 	
-	return S_OK;
+	return spu_io_write(&ctx->io, "\n", 1);
 }
@@ -0,0 +1,79 @@
+#include <assert.h>
+#include "spu_asm.h"
+#include "spu.h"
+#include "spu_vector.h"
+
+/**
+ * Checks that the array of vlen elements is in the RAM.
+ */
+static int vector_valid(const struct spu_context *ctx, int64_t addr) {
+	return addr >= 0 && addr <= RAM_SIZE &&
+	       ctx->vlen <= (uint64_t)(RAM_SIZE - addr);
+}
+
+static int vectors_overlap(const struct spu_context *ctx,
+			   int64_t dst_addr, int64_t src_addr) {
+	uint64_t distance = (uint64_t)((dst_addr > src_addr) ?
+				dst_addr - src_addr : src_addr - dst_addr);
+
+	return dst_addr != src_addr && distance < ctx->vlen;
+}
+
+OP_EXEC_FN(vector_exec) {
+	const struct spu_vec_kernels *kernels = ctx->vec_kernels;
+	int64_t *regs = ctx->registers;
+	spu_vec_binary_fn binary_fn = NULL;
+
+	switch (instr.opcode) {
+		case VLEN_OPCODE:
+			if (regs[instr.rdest] < 0 || regs[instr.rdest] > RAM_SIZE) {
+				return S_FAIL;
+			}
+
+			ctx->vlen = (uint64_t)regs[instr.rdest];
+			return S_OK;
+		case VSUM_OPCODE:
+			if (!vector_valid(ctx, regs[instr.rsrc1])) {
+				return S_FAIL;
+			}
+
+			regs[instr.rdest] = kernels->sum(ctx->ram + regs[instr.rsrc1],
+							 ctx->vlen);
+			return S_OK;
+		case VDOT_OPCODE:
+			if (	!vector_valid(ctx, regs[instr.rsrc1]) ||
+				!vector_valid(ctx, regs[instr.rsrc2])) {
+				return S_FAIL;
+			}
+
+			regs[instr.rdest] = kernels->dot(ctx->ram + regs[instr.rsrc1],
+							 ctx->ram + regs[instr.rsrc2],
+							 ctx->vlen);
+			return S_OK;
+		case VADD_OPCODE:	binary_fn = kernels->add;	break;
+		case VSUB_OPCODE:	binary_fn = kernels->sub;	break;
+		case VMUL_OPCODE:	binary_fn = kernels->mul;	break;
+		case VMIN_OPCODE:	binary_fn = kernels->min;	break;
+		case VMAX_OPCODE:	binary_fn = kernels->max;	break;
+		default:
+			return S_FAIL;
+	}
+
+	int64_t dst_addr = regs[instr.rdest];
+	int64_t lhs_addr = regs[instr.rsrc1];
+	int64_t rhs_addr = regs[instr.rsrc2];
+
+	if (	!vector_valid(ctx, dst_addr) ||
+		!vector_valid(ctx, lhs_addr) ||
+		!vector_valid(ctx, rhs_addr) ||
+		vectors_overlap(ctx, dst_addr, lhs_addr) ||
+		vectors_overlap(ctx, dst_addr, rhs_addr) ||
+		!spu_ram_writable(ctx, (size_t)dst_addr, ctx->vlen)) {
+		return S_FAIL;
+	}
+
+	binary_fn(ctx->ram + dst_addr, ctx->ram + lhs_addr,
+		  ctx->ram + rhs_addr, ctx->vlen);
+
+	return S_OK;
+}
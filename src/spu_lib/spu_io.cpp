@@ -0,0 +1,433 @@
+/**
+ * @file
+ *
+ * @brief Buffered I/O of the SPU programs
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "spu_io.h"
+
+// Sign, 19 digits and the newline
+#define SPU_IO_MAX_INT_LEN (21)
+// Longest number accepted by finput
+#define SPU_IO_MAX_DOUBLE_LEN (64)
+
+int spu_io_init(struct spu_io *io, FILE *in_stream, FILE *out_stream) {
+	assert (io);
+	assert (in_stream);
+	assert (out_stream);
+
+	*io = (struct spu_io) {
+		.in_stream = in_stream,
+		.in_buf = (char *)malloc(SPU_IO_BUFSIZE),
+		.in_pos = 0,
+		.in_len = 0,
+		.in_eof = 0,
+		.out_stream = out_stream,
+		.out_buf = (char *)malloc(SPU_IO_BUFSIZE),
+		.out_len = 0,
+		.stream_fds = {0},
+		.stream_modes = {0},
+		.n_streams = 0,
+	};
+
+	io->stream_fds[STDIN_FILENO] = fileno(in_stream);
+	io->stream_modes[STDIN_FILENO] = SPU_STREAM_READ;
+	io->stream_fds[STDOUT_FILENO] = fileno(out_stream);
+	io->stream_modes[STDOUT_FILENO] = SPU_STREAM_WRITE;
+	io->stream_fds[STDERR_FILENO] = STDERR_FILENO;
+	io->stream_modes[STDERR_FILENO] = SPU_STREAM_WRITE;
+	io->n_streams = STDERR_FILENO + 1;
+
+	if (!io->in_buf || !io->out_buf) {
+		spu_io_destroy(io);
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+int spu_io_destroy(struct spu_io *io) {
+	assert (io);
+
+	int ret = S_OK;
+
+	if (io->out_buf) {
+		ret = spu_io_flush(io);
+	}
+
+	// Standard streams belong to the host
+	for (size_t i = STDERR_FILENO + 1; i < io->n_streams; i++) {
+		if (close(io->stream_fds[i])) {
+			ret = S_FAIL;
+		}
+	}
+	io->n_streams = 0;
+
+	free(io->in_buf);
+	free(io->out_buf);
+	io->in_buf = NULL;
+	io->out_buf = NULL;
+
+	return ret;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+	assert (buf || len == 0);
+
+	while (len) {
+		ssize_t written = write(fd, buf, len);
+
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return S_FAIL;
+		}
+
+		buf += written;
+		len -= (size_t)written;
+	}
+
+	return S_OK;
+}
+
+int spu_io_flush(struct spu_io *io) {
+	assert (io);
+
+	size_t len = io->out_len;
+
+	// Dumps and drawings go through stdio, they are written first
+	if (fflush(io->out_stream)) {
+		return S_FAIL;
+	}
+
+	io->out_len = 0;
+	if (write_all(fileno(io->out_stream), io->out_buf, len)) {
+		log_error("Unable to write the output");
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+int spu_io_write(struct spu_io *io, const char *buf, size_t len) {
+	assert (io);
+	assert (buf || len == 0);
+
+	if (io->out_len + len > SPU_IO_BUFSIZE && spu_io_flush(io)) {
+		return S_FAIL;
+	}
+
+	if (len > SPU_IO_BUFSIZE) {
+		return write_all(fileno(io->out_stream), buf, len);
+	}
+
+	memcpy(io->out_buf + io->out_len, buf, len);
+	io->out_len += len;
+
+	return S_OK;
+}
+
+/**
+ * Writes the number and the newline, like printf("%ld\n").
+ */
+int spu_io_print_int(struct spu_io *io, int64_t value) {
+	assert (io);
+
+	char digits[SPU_IO_MAX_INT_LEN] = {0};
+	size_t pos = sizeof(digits);
+	// Negation of INT64_MIN overflows, the magnitude is unsigned
+	uint64_t magnitude = (value < 0) ? 0 - (uint64_t)value : (uint64_t)value;
+
+	digits[--pos] = '\n';
+	do {
+		digits[--pos] = (char)('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude);
+
+	if (value < 0) {
+		digits[--pos] = '-';
+	}
+
+	return spu_io_write(io, digits + pos, sizeof(digits) - pos);
+}
+
+static int fill_input(struct spu_io *io) {
+	assert (io);
+
+	// The prompt is seen before the program waits for the input
+	if (spu_io_flush(io)) {
+		return S_FAIL;
+	}
+
+	io->in_pos = 0;
+	io->in_len = 0;
+
+	for (;;) {
+		ssize_t n_read = read(fileno(io->in_stream), io->in_buf, SPU_IO_BUFSIZE);
+
+		if (n_read < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (n_read <= 0) {
+			io->in_eof = 1;
+			return (n_read < 0) ? S_FAIL : S_OK;
+		}
+
+		io->in_len = (size_t)n_read;
+		return S_OK;
+	}
+}
+
+/**
+ * Returns the next input character without taking it, EOF at the end.
+ */
+static int peek_input(struct spu_io *io) {
+	assert (io);
+
+	if (io->in_pos == io->in_len) {
+		if (io->in_eof || fill_input(io) || io->in_len == 0) {
+			return EOF;
+		}
+	}
+
+	return (unsigned char)io->in_buf[io->in_pos];
+}
+
+// isspace depends on the locale
+static int is_space(int c) {
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static void skip_spaces(struct spu_io *io) {
+	assert (io);
+
+	int c = 0;
+
+	while ((c = peek_input(io)) != EOF && is_space(c)) {
+		io->in_pos++;
+	}
+}
+
+/**
+ * Reads the decimal number like scanf("%ld"),
+ * fails if there is no number or it does not fit.
+ */
+int spu_io_read_int(struct spu_io *io, int64_t *value) {
+	assert (io);
+	assert (value);
+
+	uint64_t magnitude = 0;
+	uint64_t limit = INT64_MAX;
+	size_t n_digits = 0;
+	int negative = 0;
+	int c = 0;
+
+	skip_spaces(io);
+
+	c = peek_input(io);
+	if (c == '-' || c == '+') {
+		negative = (c == '-');
+		io->in_pos++;
+		c = peek_input(io);
+	}
+
+	if (negative) {
+		limit = (uint64_t)INT64_MAX + 1;
+	}
+
+	for (; c >= '0' && c <= '9'; c = peek_input(io)) {
+		uint64_t digit = (uint64_t)(c - '0');
+
+		if (magnitude > (limit - digit) / 10) {
+			return S_FAIL;
+		}
+
+		magnitude = magnitude * 10 + digit;
+		n_digits++;
+		io->in_pos++;
+	}
+
+	if (n_digits == 0) {
+		return S_FAIL;
+	}
+
+	*value = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+
+	return S_OK;
+}
+
+/**
+ * Reads the whitespace separated double, strtod parses it.
+ */
+int spu_io_read_double(struct spu_io *io, double *value) {
+	assert (io);
+	assert (value);
+
+	char token[SPU_IO_MAX_DOUBLE_LEN + 1] = {0};
+	char *token_end = NULL;
+	size_t len = 0;
+	int c = 0;
+
+	skip_spaces(io);
+
+	while ((c = peek_input(io)) != EOF && !is_space(c)) {
+		if (len == SPU_IO_MAX_DOUBLE_LEN) {
+			return S_FAIL;
+		}
+
+		token[len++] = (char)c;
+		io->in_pos++;
+	}
+
+	if (len == 0) {
+		return S_FAIL;
+	}
+
+	*value = strtod(token, &token_end);
+
+	return (token_end == token + len) ? S_OK : S_FAIL;
+}
+
+/**
+ * Opens the host file for read or write instructions,
+ * the file being written is created or truncated.
+ */
+int spu_io_open(struct spu_io *io, const char *filename, int mode, size_t *stream) {
+	assert (io);
+	assert (filename);
+	assert (stream);
+
+	int fd = -1;
+
+	if (io->n_streams == SPU_IO_MAX_STREAMS) {
+		log_error("Too many streams, maximum is %d", SPU_IO_MAX_STREAMS);
+		return S_FAIL;
+	}
+
+	switch (mode) {
+		case SPU_STREAM_READ:
+			fd = open(filename, O_RDONLY | O_CLOEXEC);
+			break;
+		case SPU_STREAM_WRITE:
+			fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			break;
+		default:
+			return S_FAIL;
+	}
+
+	if (fd < 0) {
+		log_error("Unable to open file %s", filename);
+		return S_FAIL;
+	}
+
+	*stream = io->n_streams++;
+	io->stream_fds[*stream] = fd;
+	io->stream_modes[*stream] = (uint8_t)mode;
+
+	return S_OK;
+}
+
+static int stream_valid(const struct spu_io *io, size_t stream, int mode) {
+	assert (io);
+
+	if (stream >= io->n_streams || io->stream_modes[stream] != mode) {
+		log_error("Stream <%zu> is not open for %s", stream,
+			  (mode == SPU_STREAM_READ) ? "reading" : "writing");
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Reads len bytes, less only at the end of the stream.
+ * The rest of the input buffer goes first.
+ */
+int spu_io_read_stream(struct spu_io *io, size_t stream,
+		       char *buf, size_t len, size_t *n_read) {
+	assert (io);
+	assert (buf || len == 0);
+	assert (n_read);
+
+	size_t done = 0;
+
+	if (!stream_valid(io, stream, SPU_STREAM_READ)) {
+		return S_FAIL;
+	}
+
+	if (stream == STDIN_FILENO) {
+		done = io->in_len - io->in_pos;
+		if (done > len) {
+			done = len;
+		}
+
+		memcpy(buf, io->in_buf + io->in_pos, done);
+		io->in_pos += done;
+
+		if (done < len && !io->in_eof && spu_io_flush(io)) {
+			return S_FAIL;
+		}
+	}
+
+	while (done < len && !(stream == STDIN_FILENO && io->in_eof)) {
+		ssize_t n_bytes = read(io->stream_fds[stream], buf + done, len - done);
+
+		if (n_bytes < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (n_bytes < 0) {
+			log_error("Unable to read stream <%zu>", stream);
+			return S_FAIL;
+		}
+
+		if (n_bytes == 0) {
+			if (stream == STDIN_FILENO) {
+				io->in_eof = 1;
+			}
+			break;
+		}
+
+		done += (size_t)n_bytes;
+	}
+
+	*n_read = done;
+
+	return S_OK;
+}
+
+int spu_io_write_stream(struct spu_io *io, size_t stream,
+			const char *buf, size_t len) {
+	assert (io);
+	assert (buf || len == 0);
+
+	if (!stream_valid(io, stream, SPU_STREAM_WRITE)) {
+		return S_FAIL;
+	}
+
+	if (stream == STDOUT_FILENO) {
+		return spu_io_write(io, buf, len);
+	}
+
+	if (stream == STDERR_FILENO) {
+		fflush(stderr);
+	}
+
+	if (write_all(io->stream_fds[stream], buf, len)) {
+		log_error("Unable to write stream <%zu>", stream);
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
@@ -0,0 +1,278 @@
+/**
+ * @file
+ *
+ * @brief SPU object file format
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "ctio.h"
+#include "spu_asm.h"
+#include "spu_bit_ops.h"
+#include "spu_obj.h"
+
+#define SPU_OBJ_ALIGNMENT (8)
+
+static size_t obj_align(size_t size) {
+	return (size + SPU_OBJ_ALIGNMENT - 1) & ~(size_t)(SPU_OBJ_ALIGNMENT - 1);
+}
+
+int spu_obj_is_object(const char *buf, size_t buflen) {
+	assert (buf || buflen == 0);
+
+	uint32_t magic = 0;
+
+	if (buflen < sizeof(struct spu_obj_header)) {
+		return 0;
+	}
+
+	memcpy(&magic, buf, sizeof(magic));
+
+	return magic == SPU_OBJ_MAGIC;
+}
+
+/**
+ * Parses the object in the buffer. On success the object owns the buffer.
+ */
+int spu_obj_parse(struct spu_obj *obj, char *buf, size_t buflen) {
+	assert (obj);
+	assert (buf);
+
+	int ret = S_OK;
+	struct spu_obj_header header = {0};
+	size_t pos = 0;
+	size_t data_len = 0, consts_len = 0, code_len = 0, symbols_len = 0, relocs_len = 0;
+
+	if (!spu_obj_is_object(buf, buflen)) {
+		log_error("Not an SPU object");
+		_CT_FAIL();
+	}
+
+	memcpy(&header, buf, sizeof(header));
+
+	if (header.version != SPU_OBJ_VERSION) {
+		log_error("Unsupported object version <%u>", header.version);
+		_CT_FAIL();
+	}
+
+	data_len	= obj_align(header.n_data * sizeof(spu_data_t));
+	consts_len	= obj_align(header.n_consts * sizeof(spu_data_t));
+	code_len	= obj_align(header.n_code * sizeof(spu_instruction_t));
+	symbols_len	= obj_align(header.n_symbols * sizeof(struct spu_obj_symbol));
+	relocs_len	= obj_align(header.n_relocs * sizeof(struct spu_obj_reloc));
+
+	// Counts are 32-bit, so the sum does not overflow
+	if (obj_align(sizeof(header)) + data_len + consts_len + code_len +
+	    symbols_len + relocs_len > buflen) {
+		log_error("The object is truncated");
+		_CT_FAIL();
+	}
+
+	pos = obj_align(sizeof(header));
+
+	*obj = (struct spu_obj) {
+		.header		= header,
+		.code		= (spu_instruction_t *)(void *)(
+					buf + pos + data_len + consts_len),
+		.data		= (spu_data_t *)(void *)(buf + pos),
+		.consts		= (spu_data_t *)(void *)(buf + pos + data_len),
+		.symbols	= (struct spu_obj_symbol *)(void *)(
+					buf + pos + data_len + consts_len + code_len),
+		.relocs		= (struct spu_obj_reloc *)(void *)(
+					buf + pos + data_len + consts_len + code_len +
+					symbols_len),
+		.buf		= buf,
+	};
+
+	for (uint32_t i = 0; i < header.n_relocs; i++) {
+		const struct spu_obj_reloc *reloc = &obj->relocs[i];
+		int invalid = reloc->offset >= ((reloc->type == SPU_RELOC_DATA) ?
+						header.n_data : header.n_code);
+
+		if (reloc->type == SPU_RELOC_CONST) {
+			invalid |= reloc->addend < 0 ||
+				   (uint32_t)reloc->addend >= header.n_consts;
+		} else {
+			invalid |= reloc->symbol >= header.n_symbols;
+		}
+
+		if (invalid) {
+			log_error("Invalid relocation #%u", i);
+			_CT_FAIL();
+		}
+	}
+
+_CT_EXIT_POINT:
+	if (ret) {
+		obj->buf = NULL;
+	}
+	return ret;
+}
+
+int spu_obj_read(struct spu_obj *obj, const char *filename) {
+	assert (obj);
+	assert (filename);
+
+	int ret = S_OK;
+	char *buf = NULL;
+	size_t buflen = 0;
+
+	_CT_CHECKED(read_file(filename, &buf, &buflen));
+
+	if (spu_obj_parse(obj, buf, buflen)) {
+		log_error("Invalid object file %s", filename);
+		_CT_FAIL();
+	}
+
+	return S_OK;
+
+_CT_EXIT_POINT:
+	free(buf);
+	return ret;
+}
+
+static int write_part(const void *part, size_t len, FILE *out_stream) {
+	static const char padding[SPU_OBJ_ALIGNMENT] = {0};
+
+	if (len && fwrite(part, len, 1, out_stream) != 1) {
+		return S_FAIL;
+	}
+
+	size_t padding_len = obj_align(len) - len;
+
+	if (padding_len && fwrite(padding, padding_len, 1, out_stream) != 1) {
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+int spu_obj_write(const struct spu_obj *obj, FILE *out_stream) {
+	assert (obj);
+	assert (out_stream);
+
+	int ret = S_OK;
+	struct spu_obj_header header = obj->header;
+
+	header.magic = SPU_OBJ_MAGIC;
+	header.version = SPU_OBJ_VERSION;
+
+	_CT_CHECKED(write_part(&header, sizeof(header), out_stream));
+	_CT_CHECKED(write_part(obj->data,
+		header.n_data * sizeof(spu_data_t), out_stream));
+	_CT_CHECKED(write_part(obj->consts,
+		header.n_consts * sizeof(spu_data_t), out_stream));
+	_CT_CHECKED(write_part(obj->code,
+		header.n_code * sizeof(spu_instruction_t), out_stream));
+	_CT_CHECKED(write_part(obj->symbols,
+		header.n_symbols * sizeof(struct spu_obj_symbol), out_stream));
+	_CT_CHECKED(write_part(obj->relocs,
+		header.n_relocs * sizeof(struct spu_obj_reloc), out_stream));
+
+_CT_EXIT_POINT:
+	if (ret) {
+		log_error("Unable to write the object");
+	}
+	return ret;
+}
+
+int spu_obj_destroy(struct spu_obj *obj) {
+	assert (obj);
+
+	free(obj->buf);
+	obj->buf = NULL;
+
+	return S_OK;
+}
+
+/**
+ * Puts the resolved value into the relocated instruction.
+ * Both relative jumps and constants are stored in the number field.
+ */
+int spu_obj_patch(spu_instruction_t *instr, int64_t value) {
+	assert (instr);
+
+	int ret = S_OK;
+	struct spu_instruction bin_instr = { .instruction = *instr };
+	struct spu_instr_data instr_data = {0};
+	const struct op_cmd *op_cmd = NULL;
+	uint32_t opcode = bin_instr.opcode.code;
+	int is_directive = 0;
+
+	if (opcode == DIRECTIVE_OPCODE) {
+		is_directive = 1;
+		_CT_CHECKED(get_directive_opcode(&opcode, &bin_instr));
+	}
+
+	init_op_cmd_opcode_table();
+
+	op_cmd = find_op_cmd_opcode(opcode, is_directive);
+	if (!op_cmd) {
+		_CT_FAIL();
+	}
+
+	// Jump offsets and ldc constants have the same width
+	if (	value < INT32_MIN || value > INT32_MAX ||
+		test_integer_bounds((int32_t)value, LDC_INTEGER_BLEN)) {
+		log_error("relocated value <%ld> is too long", value);
+		_CT_FAIL();
+	}
+
+	_CT_CHECKED(op_cmd->layout->parse_bin_fn(&bin_instr, &instr_data));
+	instr_data.snum = (int32_t)value;
+	_CT_CHECKED(op_cmd->layout->write_bin_fn(&instr_data, &bin_instr));
+
+	*instr = bin_instr.instruction;
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+/**
+ * Turns the relocated instruction into the one taking the value from
+ * the constant pool entry: a jump or a call becomes the long one,
+ * ldc of the address becomes ldk.
+ */
+int spu_obj_patch_pool_ref(spu_instruction_t *instr, uint32_t pool_index) {
+	assert (instr);
+
+	int ret = S_OK;
+	struct spu_instruction bin_instr = { .instruction = *instr };
+	struct spu_instr_data instr_data = {0};
+	const struct op_layout *layout = &opl_jmp;
+	uint32_t pool_opcode = 0;
+
+	switch (bin_instr.opcode.code) {
+		case JMP_OPCODE:
+			pool_opcode = JMPL_OPCODE;
+			break;
+		case CALL_OPCODE:
+			pool_opcode = CALLL_OPCODE;
+			break;
+		case LDC_OPCODE:
+			pool_opcode = LDK_OPCODE;
+			layout = &opl_ldc;
+			break;
+		default:
+			_CT_FAIL();
+	}
+
+	// Both layouts keep the number in the same 20 bits
+	if (pool_index > (uint32_t)JMP_POSITION_MAX) {
+		_CT_FAIL();
+	}
+
+	_CT_CHECKED(layout->parse_bin_fn(&bin_instr, &instr_data));
+
+	instr_data.opcode = pool_opcode;
+	instr_data.snum = (int32_t)pool_index;
+	_CT_CHECKED(layout->write_bin_fn(&instr_data, &bin_instr));
+
+	*instr = bin_instr.instruction;
+
+_CT_EXIT_POINT:
+	return ret;
+}
@@ -0,0 +1,175 @@
+/**
+ * @file
+ *
+ * @brief Execution profile of SPU programs
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include "types.h"
+#include "spu_bit_ops.h"
+#include "spu_profile.h"
+
+#define SPU_PROFILE_MAGIC "spu-profile"
+#define FNV_PRIME (0x100000001b3ULL)
+
+int spu_profile_init(struct spu_profile *profile, size_t n_code) {
+	assert (profile);
+
+	profile->n_code = n_code;
+	profile->code_hash = SPU_PROFILE_HASH_INIT;
+	profile->counts = (uint64_t *)calloc(n_code + 1, sizeof(uint64_t));
+	profile->taken = (uint64_t *)calloc(n_code + 1, sizeof(uint64_t));
+
+	if (!profile->counts || !profile->taken) {
+		spu_profile_destroy(profile);
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+void spu_profile_destroy(struct spu_profile *profile) {
+	assert (profile);
+
+	free(profile->counts);
+	free(profile->taken);
+
+	profile->counts = NULL;
+	profile->taken = NULL;
+	profile->n_code = 0;
+}
+
+int spu_profile_write(const struct spu_profile *profile, FILE *out_stream) {
+	assert (profile);
+	assert (out_stream);
+
+	if (fprintf(out_stream, SPU_PROFILE_MAGIC " %d %zu %016" PRIx64 "\n",
+		    SPU_PROFILE_VERSION, profile->n_code, profile->code_hash) < 0) {
+		return S_FAIL;
+	}
+
+	for (size_t ip = 0; ip < profile->n_code; ip++) {
+		if (profile->counts[ip] == 0) {
+			continue;
+		}
+
+		if (fprintf(out_stream, "%zu %" PRIu64 " %" PRIu64 "\n", ip,
+			    profile->counts[ip], profile->taken[ip]) < 0) {
+			return S_FAIL;
+		}
+	}
+
+	return S_OK;
+}
+
+int spu_profile_read(struct spu_profile *profile, const char *filename) {
+	assert (profile);
+	assert (filename);
+
+	int ret = S_OK;
+	int version = 0;
+	size_t n_code = 0;
+	uint64_t code_hash = 0;
+	size_t ip = 0;
+	uint64_t count = 0;
+	uint64_t taken = 0;
+	int status = 0;
+
+	profile->n_code = 0;
+	profile->counts = profile->taken = NULL;
+
+	FILE *in_stream = fopen(filename, "r");
+	if (!in_stream) {
+		log_error("Unable to open the profile %s", filename);
+		return S_FAIL;
+	}
+
+	if (	fscanf(in_stream, SPU_PROFILE_MAGIC " %d", &version) != 1 ||
+		version != SPU_PROFILE_VERSION ||
+		fscanf(in_stream, "%zu %" SCNx64, &n_code, &code_hash) != 2) {
+		log_error("%s is not an SPU profile of version %d",
+			  filename, SPU_PROFILE_VERSION);
+		_CT_FAIL();
+	}
+
+	_CT_CHECKED(spu_profile_init(profile, n_code));
+	profile->code_hash = code_hash;
+
+	while ((status = fscanf(in_stream, "%zu %" SCNu64 " %" SCNu64,
+				&ip, &count, &taken)) == 3) {
+		if (ip >= n_code || taken > count) {
+			log_error("Invalid profile entry for ip %zu", ip);
+			_CT_FAIL();
+		}
+
+		profile->counts[ip] = count;
+		profile->taken[ip] = taken;
+	}
+
+	if (status != EOF) {
+		log_error("Invalid profile %s", filename);
+		_CT_FAIL();
+	}
+
+_CT_EXIT_POINT:
+	if (ret) {
+		spu_profile_destroy(profile);
+	}
+	fclose(in_stream);
+
+	return ret;
+}
+
+/**
+ * Adds the opcode of the next instruction to the FNV-1a hash of the code.
+ */
+uint64_t spu_profile_hash_opcode(uint64_t hash, uint32_t opcode, int is_directive) {
+	if (is_directive) {
+		opcode |= DIRECTIVE_OPCODE << 16;
+	} else if (opcode == JMPL_OPCODE) {
+		opcode = JMP_OPCODE;
+	} else if (opcode == CALLL_OPCODE) {
+		opcode = CALL_OPCODE;
+	} else if (opcode == LDK_OPCODE) {
+		opcode = LDC_OPCODE;
+	}
+
+	for (size_t i = 0; i < sizeof(opcode); i++) {
+		hash ^= (opcode >> (i * 8)) & 0xff;
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/**
+ * Hashes the code of the loaded program.
+ */
+int spu_profile_hash_code(const spu_instruction_t *code, size_t n_code, uint64_t *hash) {
+	assert (code || n_code == 0);
+	assert (hash);
+
+	*hash = SPU_PROFILE_HASH_INIT;
+
+	for (size_t i = 0; i < n_code; i++) {
+		struct spu_instruction instr = { .instruction = code[i] };
+		uint32_t opcode = instr.opcode.code;
+		int is_directive = 0;
+
+		if (opcode == DIRECTIVE_OPCODE) {
+			is_directive = 1;
+
+			if (get_directive_opcode(&opcode, &instr)) {
+				return S_FAIL;
+			}
+		}
+
+		*hash = spu_profile_hash_opcode(*hash, opcode, is_directive);
+	}
+
+	return S_OK;
+}
@@ -0,0 +1,299 @@
+/**
+ * @file
+ *
+ * @brief Host kernels of the SPU vector instructions
+ *
+ * SIMD kernels process whole registers and leave the tail
+ * to the scalar ones, AVX-512 kernels handle the tail with masks.
+ */
+
+#include <assert.h>
+
+#include "spu_vector.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SPU_VEC_X86
+#include <immintrin.h>
+#endif
+
+// Signed overflow is UB, the SPU arithmetic wraps around
+static int64_t wrap_add(int64_t lhs, int64_t rhs) {
+	return (int64_t)((uint64_t)lhs + (uint64_t)rhs);
+}
+
+static int64_t wrap_sub(int64_t lhs, int64_t rhs) {
+	return (int64_t)((uint64_t)lhs - (uint64_t)rhs);
+}
+
+static int64_t wrap_mul(int64_t lhs, int64_t rhs) {
+	return (int64_t)((uint64_t)lhs * (uint64_t)rhs);
+}
+
+#define DEFINE_SCALAR_BINARY(name, expr)					\
+static void scalar_##name(int64_t *dst, const int64_t *lhs,			\
+			  const int64_t *rhs, size_t len) {			\
+	for (size_t i = 0; i < len; i++) {					\
+		int64_t l = lhs[i];						\
+		int64_t r = rhs[i];						\
+		dst[i] = (expr);						\
+	}									\
+}
+
+DEFINE_SCALAR_BINARY(add, wrap_add(l, r))
+DEFINE_SCALAR_BINARY(sub, wrap_sub(l, r))
+DEFINE_SCALAR_BINARY(mul, wrap_mul(l, r))
+DEFINE_SCALAR_BINARY(min, (l < r) ? l : r)
+DEFINE_SCALAR_BINARY(max, (l > r) ? l : r)
+
+#undef DEFINE_SCALAR_BINARY
+
+static int64_t scalar_dot(const int64_t *lhs, const int64_t *rhs, size_t len) {
+	int64_t acc = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		acc = wrap_add(acc, wrap_mul(lhs[i], rhs[i]));
+	}
+
+	return acc;
+}
+
+static int64_t scalar_sum(const int64_t *src, size_t len) {
+	int64_t acc = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		acc = wrap_add(acc, src[i]);
+	}
+
+	return acc;
+}
+
+static const struct spu_vec_kernels scalar_kernels = {
+	.name	= "scalar",
+	.add	= scalar_add,
+	.sub	= scalar_sub,
+	.mul	= scalar_mul,
+	.min	= scalar_min,
+	.max	= scalar_max,
+	.dot	= scalar_dot,
+	.sum	= scalar_sum,
+};
+
+#ifdef SPU_VEC_X86
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+#define AVX2_LANES (sizeof(__m256i) / sizeof(int64_t))
+
+AVX2_TARGET static __m256i avx2_load(const int64_t *src) {
+	return _mm256_loadu_si256((const __m256i *)(const void *)src);
+}
+
+AVX2_TARGET static void avx2_store(int64_t *dst, __m256i value) {
+	_mm256_storeu_si256((__m256i *)(void *)dst, value);
+}
+
+// AVX2 has no 64-bit multiplication, it is put together from 32-bit halves
+AVX2_TARGET static __m256i avx2_mul_epi64(__m256i lhs, __m256i rhs) {
+	__m256i low = _mm256_mul_epu32(lhs, rhs);
+	__m256i cross = _mm256_add_epi64(
+		_mm256_mul_epu32(_mm256_srli_epi64(lhs, 32), rhs),
+		_mm256_mul_epu32(lhs, _mm256_srli_epi64(rhs, 32)));
+
+	return _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+}
+
+AVX2_TARGET static __m256i avx2_min_epi64(__m256i lhs, __m256i rhs) {
+	return _mm256_blendv_epi8(lhs, rhs, _mm256_cmpgt_epi64(lhs, rhs));
+}
+
+AVX2_TARGET static __m256i avx2_max_epi64(__m256i lhs, __m256i rhs) {
+	return _mm256_blendv_epi8(rhs, lhs, _mm256_cmpgt_epi64(lhs, rhs));
+}
+
+AVX2_TARGET static int64_t avx2_reduce_add(__m256i acc) {
+	int64_t lanes[AVX2_LANES] = {0};
+	int64_t sum = 0;
+
+	avx2_store(lanes, acc);
+	for (size_t i = 0; i < AVX2_LANES; i++) {
+		sum = wrap_add(sum, lanes[i]);
+	}
+
+	return sum;
+}
+
+#define DEFINE_AVX2_BINARY(name, op)						\
+AVX2_TARGET static void avx2_##name(int64_t *dst, const int64_t *lhs,		\
+				    const int64_t *rhs, size_t len) {		\
+	size_t i = 0;								\
+										\
+	for (; i + AVX2_LANES <= len; i += AVX2_LANES) {			\
+		avx2_store(dst + i, op(avx2_load(lhs + i), avx2_load(rhs + i))); \
+	}									\
+										\
+	scalar_##name(dst + i, lhs + i, rhs + i, len - i);			\
+}
+
+DEFINE_AVX2_BINARY(add, _mm256_add_epi64)
+DEFINE_AVX2_BINARY(sub, _mm256_sub_epi64)
+DEFINE_AVX2_BINARY(mul, avx2_mul_epi64)
+DEFINE_AVX2_BINARY(min, avx2_min_epi64)
+DEFINE_AVX2_BINARY(max, avx2_max_epi64)
+
+#undef DEFINE_AVX2_BINARY
+
+AVX2_TARGET static int64_t avx2_dot(const int64_t *lhs, const int64_t *rhs, size_t len) {
+	__m256i acc = _mm256_setzero_si256();
+	size_t i = 0;
+
+	for (; i + AVX2_LANES <= len; i += AVX2_LANES) {
+		acc = _mm256_add_epi64(acc,
+			avx2_mul_epi64(avx2_load(lhs + i), avx2_load(rhs + i)));
+	}
+
+	return wrap_add(avx2_reduce_add(acc), scalar_dot(lhs + i, rhs + i, len - i));
+}
+
+AVX2_TARGET static int64_t avx2_sum(const int64_t *src, size_t len) {
+	__m256i acc = _mm256_setzero_si256();
+	size_t i = 0;
+
+	for (; i + AVX2_LANES <= len; i += AVX2_LANES) {
+		acc = _mm256_add_epi64(acc, avx2_load(src + i));
+	}
+
+	return wrap_add(avx2_reduce_add(acc), scalar_sum(src + i, len - i));
+}
+
+static const struct spu_vec_kernels avx2_kernels = {
+	.name	= "avx2",
+	.add	= avx2_add,
+	.sub	= avx2_sub,
+	.mul	= avx2_mul,
+	.min	= avx2_min,
+	.max	= avx2_max,
+	.dot	= avx2_dot,
+	.sum	= avx2_sum,
+};
+
+#define AVX512_TARGET __attribute__((target("avx512f,avx512dq")))
+#define AVX512_LANES (sizeof(__m512i) / sizeof(int64_t))
+
+// Lanes of the last, possibly partial, register
+AVX512_TARGET static __mmask8 avx512_mask(size_t left) {
+	if (left >= AVX512_LANES) {
+		return (__mmask8)0xFF;
+	}
+
+	return (__mmask8)((1u << left) - 1);
+}
+
+// _mm512_reduce_add_epi64 adds the lanes as signed values, wrap around instead
+AVX512_TARGET static int64_t avx512_reduce_add(__m512i acc) {
+	int64_t lanes[AVX512_LANES] = {0};
+	int64_t sum = 0;
+
+	_mm512_storeu_si512((void *)lanes, acc);
+	for (size_t i = 0; i < AVX512_LANES; i++) {
+		sum = wrap_add(sum, lanes[i]);
+	}
+
+	return sum;
+}
+
+#define DEFINE_AVX512_BINARY(name, op)						\
+AVX512_TARGET static void avx512_##name(int64_t *dst, const int64_t *lhs,	\
+					const int64_t *rhs, size_t len) {	\
+	for (size_t i = 0; i < len; i += AVX512_LANES) {			\
+		__mmask8 mask = avx512_mask(len - i);				\
+		__m512i l = _mm512_maskz_loadu_epi64(mask, lhs + i);		\
+		__m512i r = _mm512_maskz_loadu_epi64(mask, rhs + i);		\
+										\
+		_mm512_mask_storeu_epi64(dst + i, mask, op(l, r));		\
+	}									\
+}
+
+DEFINE_AVX512_BINARY(add, _mm512_add_epi64)
+DEFINE_AVX512_BINARY(sub, _mm512_sub_epi64)
+DEFINE_AVX512_BINARY(mul, _mm512_mullo_epi64)
+DEFINE_AVX512_BINARY(min, _mm512_min_epi64)
+DEFINE_AVX512_BINARY(max, _mm512_max_epi64)
+
+#undef DEFINE_AVX512_BINARY
+
+AVX512_TARGET static int64_t avx512_dot(const int64_t *lhs, const int64_t *rhs,
+					size_t len) {
+	__m512i acc = _mm512_setzero_si512();
+
+	for (size_t i = 0; i < len; i += AVX512_LANES) {
+		__mmask8 mask = avx512_mask(len - i);
+
+		acc = _mm512_add_epi64(acc, _mm512_mullo_epi64(
+			_mm512_maskz_loadu_epi64(mask, lhs + i),
+			_mm512_maskz_loadu_epi64(mask, rhs + i)));
+	}
+
+	return avx512_reduce_add(acc);
+}
+
+AVX512_TARGET static int64_t avx512_sum(const int64_t *src, size_t len) {
+	__m512i acc = _mm512_setzero_si512();
+
+	for (size_t i = 0; i < len; i += AVX512_LANES) {
+		acc = _mm512_add_epi64(acc,
+			_mm512_maskz_loadu_epi64(avx512_mask(len - i), src + i));
+	}
+
+	return avx512_reduce_add(acc);
+}
+
+static const struct spu_vec_kernels avx512_kernels = {
+	.name	= "avx512",
+	.add	= avx512_add,
+	.sub	= avx512_sub,
+	.mul	= avx512_mul,
+	.min	= avx512_min,
+	.max	= avx512_max,
+	.dot	= avx512_dot,
+	.sum	= avx512_sum,
+};
+
+#endif /* SPU_VEC_X86 */
+
+/**
+ * Returns the kernels of the ISA, or NULL if the host CPU does not support it.
+ */
+const struct spu_vec_kernels *spu_vec_kernels_get(enum spu_vec_isa isa) {
+	switch (isa) {
+		case SPU_VEC_SCALAR:
+			return &scalar_kernels;
+#ifdef SPU_VEC_X86
+		case SPU_VEC_AVX2:
+			return __builtin_cpu_supports("avx2") ? &avx2_kernels : NULL;
+		case SPU_VEC_AVX512:
+			return (__builtin_cpu_supports("avx512f") &&
+				__builtin_cpu_supports("avx512dq")) ?
+					&avx512_kernels : NULL;
+#else
+		case SPU_VEC_AVX2:
+		case SPU_VEC_AVX512:
+			return NULL;
+#endif
+		case SPU_VEC_N_ISA:
+		default:
+			return NULL;
+	}
+}
+
+const struct spu_vec_kernels *spu_vec_kernels_best(void) {
+	for (int isa = SPU_VEC_N_ISA - 1; isa >= 0; isa--) {
+		const struct spu_vec_kernels *kernels =
+			spu_vec_kernels_get((enum spu_vec_isa)isa);
+
+		if (kernels) {
+			return kernels;
+		}
+	}
+
+	assert (0 && "scalar kernels are always there");
+	return &scalar_kernels;
+}
@@ -13,36 +13,107 @@
 #include "spu_asm.h"
 #include "translator_parsers.h"
 
+static inline int digit_value(char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
 /**
- * Parses a register.
- * Returns the number of register or -1 on error.
- */ 
-int parse_register(const char *str, spu_register_num_t *regptr) {
+ * Parses an integer from the not NUL-terminated string.
+ * Accepts the same notations as strtol with base 0.
+ */
+int parse_integer(const char *str, size_t len, int64_t *num) {
 	assert (str);
+	assert (num);
+
+	const char *end = str + len;
+	int negative = 0;
+	uint64_t base = 10;
+	uint64_t unum = 0;
+
+	if (str != end && (*str == '-' || *str == '+')) {
+		negative = (*str == '-');
+		str++;
+	}
+
+	if (end - str > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+		base = 16;
+		str += 2;
+	} else if (end - str > 1 && str[0] == '0') {
+		base = 8;
+		str++;
+	}
+
+	if (str == end) {
+		return S_FAIL;
+	}
+
+	for (; str != end; str++) {
+		int digit = digit_value(*str);
+		if (digit < 0 || (uint64_t)digit >= base) {
+			return S_FAIL;
+		}
+
+		if (unum > (UINT64_MAX - (uint64_t)digit) / base) {
+			return S_FAIL;
+		}
+		unum = unum * base + (uint64_t)digit;
+	}
+
+	if (negative) {
+		if (unum > (uint64_t)INT64_MAX + 1) {
+			return S_FAIL;
+		}
+		*num = (int64_t)(0 - unum);
+	} else {
+		if (unum > (uint64_t)INT64_MAX) {
+			return S_FAIL;
+		}
+		*num = (int64_t)unum;
+	}
+
+	return S_OK;
+}
+
+/**
+ * Parses a register token like r5 or rsp.
+ */ 
+int parse_register(const struct asm_token *tok, spu_register_num_t *regptr) {
+	assert (tok);
+	assert (regptr);
 
 	int ret = S_OK;
 
-	if (str[0] != 'r') {
+	if (tok->len < 2 || tok->str[0] != 'r') {
 		_CT_FAIL();
 	}
 
-	str++;
+	if (tok->len == strlen(REGISTER_RSP_NAME) &&
+	    !memcmp(tok->str, REGISTER_RSP_NAME, tok->len)) {
+		*regptr = REGISTER_RSP_CODE;
+		return S_OK;
+	}
 
 	{
-		char *endptr = NULL;
-		unsigned long rnum = strtoul(str, &endptr, 10);
-		if (!(*str != '\0' && *endptr == '\0')) {
-			str--;
+		uint64_t rnum = 0;
 
-			if (!strcmp(str, REGISTER_RSP_NAME)) {
-				return REGISTER_RSP_CODE;
+		for (size_t i = 1; i < tok->len; i++) {
+			int digit = digit_value(tok->str[i]);
+			if (digit < 0 || digit >= 10) {
+				_CT_FAIL();
 			}
 
-			_CT_FAIL();
-		}
+			rnum = rnum * 10 + (uint64_t)digit;
 
-		if (rnum >= N_GENERAL_REGISTERS) {
-			_CT_FAIL();
+			if (rnum >= N_GENERAL_REGISTERS) {
+				_CT_FAIL();
+			}
 		}
 
 		*regptr = (spu_register_num_t)rnum;
@@ -50,36 +121,85 @@ int parse_register(const char *str, spu_register_num_t *regptr) {
 
 _CT_EXIT_POINT:
 	if (ret) {
-		log_error("Error while parsing register <%s>", str);
+		log_error("Error while parsing register <%.*s>",
+			  (int)tok->len, tok->str);
 	}
 
 	return ret;
 }
 
-int parse_literal_number(const char *str, int32_t *num) {
-	assert (str);
+int parse_literal_number64(const struct asm_token *tok, int64_t *num) {
+	assert (tok);
 	assert (num);
 
 	int ret = S_OK;
 
-	if (*str != '$') {
+	if (tok->len < 1 || *tok->str != '$') {
 		_CT_FAIL();
 	}
-	str++;
 
-	{
-		char *endptr = NULL;
-		int32_t rnum = (int32_t)strtol(str, &endptr, 0);
-		if (!(*str != '\0' && *endptr == '\0')) {
-			_CT_FAIL();
-		}
+	if (parse_integer(tok->str + 1, tok->len - 1, num)) {
+		_CT_FAIL();
+	}
+
+_CT_EXIT_POINT:
+	if (ret) {
+		log_error("Error while parsing number <%.*s>",
+			  (int)tok->len, tok->str);
+	}
+	return ret;
+}
+
+int parse_literal_number(const struct asm_token *tok, int32_t *num) {
+	assert (tok);
+	assert (num);
+
+	int64_t rnum = 0;
+
+	if (parse_literal_number64(tok, &rnum)) {
+		return S_FAIL;
+	}
+
+	if (rnum < INT32_MIN || rnum > INT32_MAX) {
+		log_error("Number <%.*s> does not fit into 32 bits",
+			  (int)tok->len, tok->str);
+		return S_FAIL;
+	}
 
-		*num = rnum;
+	*num = (int32_t)rnum;
+
+	return S_OK;
+}
+
+#define MAX_DOUBLE_LITERAL_LEN (64)
+
+/**
+ * Parses the double literal, like $1.5 or $-2e10
+ */
+int parse_literal_double(const struct asm_token *tok, double *num) {
+	assert (tok);
+	assert (num);
+
+	int ret = S_OK;
+	// strtod needs the NUL-terminated string
+	char buf[MAX_DOUBLE_LITERAL_LEN + 1] = "";
+	char *end = NULL;
+
+	if (tok->len < 2 || *tok->str != '$' || tok->len - 1 > MAX_DOUBLE_LITERAL_LEN) {
+		_CT_FAIL();
+	}
+
+	memcpy(buf, tok->str + 1, tok->len - 1);
+	*num = strtod(buf, &end);
+
+	if (end != buf + tok->len - 1) {
+		_CT_FAIL();
 	}
 
 _CT_EXIT_POINT:
 	if (ret) {
-		log_error("Error while parsing number <%s>", str);
+		log_error("Error while parsing double <%.*s>",
+			  (int)tok->len, tok->str);
 	}
 	return ret;
 }
@@ -0,0 +1,166 @@
+/**
+ * @file
+ *
+ * @brief On-disk cache of assembled objects
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "types.h"
+#include "asm_cache.h"
+#include "spu_obj.h"
+
+#define FNV_OFFSET_BASIS (0xcbf29ce484222325ULL)
+#define FNV_PRIME (0x100000001b3ULL)
+
+/**
+ * FNV-1a hash of the text, salted with the options of the translation.
+ */
+uint64_t asm_cache_hash(const char *text, size_t len, uint64_t salt) {
+	assert (text || len == 0);
+
+	uint64_t hash = FNV_OFFSET_BASIS;
+
+	for (size_t i = 0; i < sizeof(salt); i++) {
+		hash ^= (salt >> (i * 8)) & 0xff;
+		hash *= FNV_PRIME;
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (uint8_t)text[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+int asm_cache_init(struct asm_cache *cache, const char *dir, uint64_t key) {
+	assert (cache);
+	assert (dir);
+
+	cache->dir = dir;
+	cache->key = key;
+	cache->tmp_stream = NULL;
+	cache->path = NULL;
+	cache->tmp_path = NULL;
+
+	if (asprintf(&cache->path, "%s/%016lx.o", dir, (unsigned long)key) < 0) {
+		cache->path = NULL;
+		return S_FAIL;
+	}
+
+	if (asprintf(&cache->tmp_path, "%s/tmp.XXXXXX", dir) < 0) {
+		cache->tmp_path = NULL;
+		asm_cache_destroy(cache);
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+/**
+ * Copies the cached object to out_stream if there is one.
+ * Broken entries are treated as missing.
+ */
+int asm_cache_fetch(struct asm_cache *cache, FILE *out_stream, int *hit) {
+	assert (cache);
+	assert (out_stream);
+	assert (hit);
+
+	int ret = S_OK;
+	struct spu_obj obj = {{0}};
+
+	*hit = 0;
+
+	if (access(cache->path, R_OK)) {
+		return S_OK;
+	}
+
+	if (spu_obj_read(&obj, cache->path)) {
+		log_error("Ignoring broken cache entry %s", cache->path);
+		return S_OK;
+	}
+
+	_CT_CHECKED(spu_obj_write(&obj, out_stream));
+	*hit = 1;
+
+_CT_EXIT_POINT:
+	spu_obj_destroy(&obj);
+
+	return ret;
+}
+
+/**
+ * Opens a temporary file in the cache directory. It becomes the entry
+ * only on commit, so concurrent translators never see a partial object.
+ */
+FILE *asm_cache_store_begin(struct asm_cache *cache) {
+	assert (cache);
+	assert (!cache->tmp_stream);
+
+	int fd = mkstemp(cache->tmp_path);
+	if (fd == -1) {
+		log_error("Unable to create a cache entry in %s: %s",
+			  cache->dir, strerror(errno));
+		return NULL;
+	}
+
+	cache->tmp_stream = fdopen(fd, "wb");
+	if (!cache->tmp_stream) {
+		close(fd);
+		unlink(cache->tmp_path);
+	}
+
+	return cache->tmp_stream;
+}
+
+int asm_cache_store_commit(struct asm_cache *cache) {
+	assert (cache);
+	assert (cache->tmp_stream);
+
+	int ret = S_OK;
+
+	if (fclose(cache->tmp_stream)) {
+		cache->tmp_stream = NULL;
+		unlink(cache->tmp_path);
+		return S_FAIL;
+	}
+	cache->tmp_stream = NULL;
+
+	if (rename(cache->tmp_path, cache->path)) {
+		log_error("Unable to store the cache entry %s: %s",
+			  cache->path, strerror(errno));
+		unlink(cache->tmp_path);
+		ret = S_FAIL;
+	}
+
+	return ret;
+}
+
+void asm_cache_store_abort(struct asm_cache *cache) {
+	assert (cache);
+
+	if (!cache->tmp_stream) {
+		return;
+	}
+
+	fclose(cache->tmp_stream);
+	cache->tmp_stream = NULL;
+	unlink(cache->tmp_path);
+}
+
+void asm_cache_destroy(struct asm_cache *cache) {
+	assert (cache);
+
+	asm_cache_store_abort(cache);
+
+	free(cache->path);
+	free(cache->tmp_path);
+	cache->path = NULL;
+	cache->tmp_path = NULL;
+}
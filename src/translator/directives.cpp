@@ -0,0 +1,196 @@
+/**
+ * @file
+ *
+ * @brief Assembler directives
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "types.h"
+#include "spu.h"
+#include "spu_obj.h"
+#include "translator.h"
+#include "translator_parsers.h"
+#include "asm_directives.h"
+#include "jmp_opl.h"
+
+static int section_directive(struct asm_instruction *asm_instr, int section) {
+	assert (asm_instr);
+
+	if (asm_instr->n_args != 1) {
+		return S_FAIL;
+	}
+
+	asm_instr->ctx->section = section;
+
+	return S_OK;
+}
+
+static int text_directive(struct asm_instruction *asm_instr) {
+	return section_directive(asm_instr, SPU_SECTION_CODE);
+}
+
+static int data_directive(struct asm_instruction *asm_instr) {
+	return section_directive(asm_instr, SPU_SECTION_DATA);
+}
+
+static int label_flag_directive(struct asm_instruction *asm_instr, uint8_t flag) {
+	assert (asm_instr);
+
+	int ret = S_OK;
+	struct translating_context *ctx = asm_instr->ctx;
+
+	if (asm_instr->n_args < 2) {
+		_CT_FAIL();
+	}
+
+	for (size_t i = 1; i < asm_instr->n_args; i++) {
+		_CT_CHECKED(parse_label_ref(asm_instr, &asm_instr->args[i]));
+
+		ctx->labels.labels[ctx->label_ref].flags |= flag;
+	}
+
+	ctx->label_ref = ASM_NO_LABEL;
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+static int global_directive(struct asm_instruction *asm_instr) {
+	return label_flag_directive(asm_instr, SPU_SYMBOL_GLOBAL);
+}
+
+static int inline_directive(struct asm_instruction *asm_instr) {
+	return label_flag_directive(asm_instr, ASM_LABEL_INLINE);
+}
+
+static int word_directive(struct asm_instruction *asm_instr) {
+	assert (asm_instr);
+
+	int ret = S_OK;
+	struct translating_context *ctx = asm_instr->ctx;
+
+	if (asm_instr->n_args < 2 || ctx->section != SPU_SECTION_DATA) {
+		_CT_FAIL();
+	}
+
+	for (size_t i = 1; i < asm_instr->n_args; i++) {
+		int64_t word = 0;
+
+		_CT_CHECKED(parse_literal_number64(&asm_instr->args[i], &word));
+		_CT_FAIL_NONZERO(pvector_push_back(&ctx->data, &word));
+	}
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+static int zero_directive(struct asm_instruction *asm_instr) {
+	assert (asm_instr);
+
+	int ret = S_OK;
+	struct translating_context *ctx = asm_instr->ctx;
+	int64_t n_words = 0;
+	spu_data_t zero = 0;
+
+	if (asm_instr->n_args != 2 || ctx->section != SPU_SECTION_DATA) {
+		_CT_FAIL();
+	}
+
+	_CT_CHECKED(parse_literal_number64(&asm_instr->args[1], &n_words));
+
+	if (n_words < 0 || n_words > RAM_SIZE) {
+		log_error("Invalid number of words <%ld>", n_words);
+		_CT_FAIL();
+	}
+
+	for (int64_t i = 0; i < n_words; i++) {
+		_CT_FAIL_NONZERO(pvector_push_back(&ctx->data, &zero));
+	}
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+/**
+ * Puts the jump table into the data section, the addresses
+ * of the code labels are stored when all labels are known.
+ */
+static int jtable_directive(struct asm_instruction *asm_instr) {
+	assert (asm_instr);
+
+	int ret = S_OK;
+	struct translating_context *ctx = asm_instr->ctx;
+	spu_data_t zero = 0;
+
+	if (asm_instr->n_args < 2 || ctx->section != SPU_SECTION_DATA) {
+		_CT_FAIL();
+	}
+
+	for (size_t i = 1; i < asm_instr->n_args; i++) {
+		_CT_CHECKED(parse_label_ref(asm_instr, &asm_instr->args[i]));
+
+		struct asm_data_ref ref = {
+			.offset = (uint32_t)ctx->data.len,
+			.label_id = ctx->label_ref,
+		};
+
+		ctx->labels.labels[ctx->label_ref].flags |= ASM_LABEL_JTABLE;
+
+		_CT_FAIL_NONZERO(pvector_push_back(&ctx->data_refs, &ref));
+		_CT_FAIL_NONZERO(pvector_push_back(&ctx->data, &zero));
+	}
+
+	ctx->label_ref = ASM_NO_LABEL;
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+static const struct asm_directive asm_directives[] = {
+	{".text",	text_directive},
+	{".data",	data_directive},
+	{".global",	global_directive},
+	{".inline",	inline_directive},
+	{".word",	word_directive},
+	{".zero",	zero_directive},
+	{".jtable",	jtable_directive},
+	{0},
+};
+
+const struct asm_directive *find_asm_directive(const struct asm_token *tok) {
+	assert (tok);
+
+	const struct asm_directive *directive = asm_directives;
+
+	while (directive->name != NULL) {
+		if (!strncmp(directive->name, tok->str, tok->len) &&
+		    directive->name[tok->len] == '\0') {
+			return directive;
+		}
+		directive++;
+	}
+
+	return NULL;
+}
+
+/**
+ * Returns the section selected by the directive,
+ * or SPU_SECTION_UNDEF if it is not a section directive.
+ */
+int asm_section_directive(const struct asm_token *tok) {
+	assert (tok);
+
+	const struct asm_directive *directive = find_asm_directive(tok);
+
+	if (!directive) {
+		return SPU_SECTION_UNDEF;
+	} else if (directive->fn == text_directive) {
+		return SPU_SECTION_CODE;
+	} else if (directive->fn == data_directive) {
+		return SPU_SECTION_DATA;
+	}
+
+	return SPU_SECTION_UNDEF;
+}
@@ -11,8 +11,11 @@
 #include "spu_bit_ops.h"
 
 #include "spu.h"
+#include "jmp_opl.h"
 
-static int disasm_instruction(struct spu_instruction *instr) {
+static int disasm_instruction(const struct spu_context *ctx,
+			      struct spu_instruction *instr) {
+	assert (ctx);
 	assert (instr);
 
 	uint32_t opcode = instr->opcode.code;
@@ -35,6 +38,32 @@ static int disasm_instruction(struct spu_instruction *instr) {
 	}
 
 	_CT_CHECKED(op_cmd->layout->parse_bin_fn(instr, &instr_data));
+
+	// Pool loads are printed as ldc, the translator turns them back
+	if (	op_cmd->opcode == LDK_OPCODE && !is_directive &&
+		instr_data.snum >= 0 && (size_t)instr_data.snum < ctx->n_consts) {
+		fprintf(stdout, "ldc r%d $%ld\n", instr_data.rdest,
+			ctx->consts[instr_data.snum]);
+		return S_OK;
+	}
+
+	// So are long jumps, with the offset from the pool
+	if (	(op_cmd->opcode == JMPL_OPCODE || op_cmd->opcode == CALLL_OPCODE) &&
+		!is_directive && instr_data.jmp_position >= 0 &&
+		(size_t)instr_data.jmp_position < ctx->n_consts) {
+		const char *cmd_name = (op_cmd->opcode == JMPL_OPCODE) ? "jmp" : "call";
+
+		if (instr_data.jmp_condition) {
+			fprintf(stdout, "%s.%s $%ld\n", cmd_name,
+				jmp_condition_name(instr_data.jmp_condition),
+				ctx->consts[instr_data.jmp_position]);
+		} else {
+			fprintf(stdout, "%s $%ld\n", cmd_name,
+				ctx->consts[instr_data.jmp_position]);
+		}
+		return S_OK;
+	}
+
 	_CT_CHECKED(op_cmd->layout->write_asm_fn(&instr_data, stdout));
 	fprintf(stdout, "\n");
 
@@ -51,7 +80,7 @@ static int disasm_loop(struct spu_context *ctx) {
 		};
 		ctx->ip++;
 
-		if (disasm_instruction(&instr)) {
+		if (disasm_instruction(ctx, &instr)) {
 			return S_FAIL;
 		}
 	}
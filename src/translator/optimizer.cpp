@@ -0,0 +1,1894 @@
+/**
+ * @file
+ *
+ * @brief Optimization passes of the assembler
+ */
+
+#include <string.h>
+#include <assert.h>
+
+#include "types.h"
+#include "spu_asm.h"
+#include "spu_obj.h"
+#include "translator.h"
+#include "asm_optimizer.h"
+
+#define REG_BIT(reg) ((uint32_t)1 << ((reg) & REGISTER_5BIT_MASK))
+#define ALL_REGS (UINT32_MAX)
+
+// Limits of the forward scans, so the passes stay linear
+#define MAX_JMP_CHAIN (16)
+#define MAX_LIVENESS_SCAN (64)
+#define MAX_DCE_ROUNDS (8)
+
+// Subroutines up to this length are inlined without the .inline directive
+#define INLINE_MAX_LEN (12)
+#define INLINE_FORCED_MAX_LEN (256)
+// With the profile, calls executed at least 1/INLINE_HOT_SHARE times
+// of the hottest call are inlined up to this length, never executed are not
+#define INLINE_HOT_MAX_LEN (64)
+#define INLINE_HOT_SHARE (8)
+// Inlining stops when the code grows by this factor
+#define INLINE_MAX_GROWTH (2)
+
+struct asm_opt_ctx {
+	struct arena *arena;
+	// NULL if the program was not profiled
+	const struct spu_profile *profile;
+
+	struct asm_ir_instr *ir;
+	size_t n_ir;
+	struct label_table *labels;
+
+	// Constant pool holding the offsets of the long jumps
+	const spu_data_t *consts;
+	size_t n_consts;
+
+	// After fcmp of NaN only neq holds, so the ordered conditions
+	// are not the opposites of each other, see do_conditional_jump
+	int has_fcmp;
+
+	// Instruction index the jump goes to, -1 if it is not known here
+	ssize_t *targets;
+	// The instruction is a label or a jump target
+	uint8_t *is_target;
+	uint8_t *deleted;
+
+	// Positions of the instructions after the stage, of n_ir + 1 elements
+	size_t *new_map;
+	struct asm_ir_instr *scratch;
+};
+
+// Successor of the block which is not there
+#define BLOCK_NONE (SIZE_MAX)
+// Control leaves the code or goes to an unknown place
+#define BLOCK_EXIT (SIZE_MAX - 1)
+
+struct asm_block {
+	// Instructions [start, end)
+	size_t start;
+	size_t end;
+
+	// The fall-through successor goes first
+	size_t succs[2];
+
+	uint32_t live_in;
+	uint32_t live_out;
+
+	int reachable;
+};
+
+struct asm_cfg {
+	struct asm_block *blocks;
+	size_t n_blocks;
+
+	// Block of every instruction
+	size_t *block_of;
+};
+
+struct reg_effect {
+	uint32_t reads;
+	uint32_t writes;
+};
+
+static int ir_is(const struct spu_instr_data *instr_data,
+		 const struct op_layout *layout, uint32_t opcode) {
+	assert (instr_data);
+
+	return instr_data->layout == layout && instr_data->opcode == opcode;
+}
+
+static int ir_is_jmp(const struct spu_instr_data *instr_data) {
+	assert (instr_data);
+
+	return instr_data->layout == &opl_jmp;
+}
+
+/**
+ * Long jumps and calls take the offset from the constant pool.
+ */
+static int ir_is_long_jmp(const struct spu_instr_data *instr_data) {
+	assert (instr_data);
+
+	return	ir_is(instr_data, &opl_jmp, JMPL_OPCODE) ||
+		ir_is(instr_data, &opl_jmp, CALLL_OPCODE);
+}
+
+/**
+ * Puts the offset of the moved jump into the instruction. Long jumps
+ * become short ones: the translator makes the jumps which do not fit
+ * long again when the code is final.
+ */
+static void ir_set_jmp_offset(struct asm_ir_instr *ir_instr, ssize_t offset) {
+	assert (ir_instr);
+
+	if (ir_is_long_jmp(&ir_instr->data)) {
+		ir_instr->data.opcode = (ir_instr->data.opcode == JMPL_OPCODE) ?
+					JMP_OPCODE : CALL_OPCODE;
+	}
+
+	ir_instr->label_id = ASM_NO_LABEL;
+	ir_instr->data.jmp_position = (int32_t)offset;
+}
+
+/**
+ * Registers read and written by the instruction.
+ * Unknown instructions are assumed to touch every register.
+ */
+static struct reg_effect ir_reg_effect(const struct spu_instr_data *instr_data) {
+	assert (instr_data);
+
+	uint32_t rd = REG_BIT(instr_data->rdest);
+	uint32_t rs1 = REG_BIT(instr_data->rsrc1);
+	uint32_t rs2 = REG_BIT(instr_data->rsrc2);
+	const struct op_layout *layout = instr_data->layout;
+
+	if (layout == &opl_mov) {
+		return (struct reg_effect) {rs1, rd};
+	}
+
+	if (layout == &opl_ldc) {
+		return (struct reg_effect) {0, rd};
+	}
+
+	if (layout == &opl_jmp) {
+		if (instr_data->opcode == JMP_OPCODE) {
+			return (struct reg_effect) {0, 0};
+		}
+
+		if (instr_data->opcode == LOOP_OPCODE) {
+			return (struct reg_effect) {rd, rd};
+		}
+
+		return (struct reg_effect) {ALL_REGS, ALL_REGS};
+	}
+
+	if (layout == &opl_triple_reg) {
+		switch (instr_data->opcode) {
+			case MSET_OPCODE:
+			case MCPY_OPCODE:
+			case MCMP_OPCODE:
+			case VADD_OPCODE:
+			case VSUB_OPCODE:
+			case VMUL_OPCODE:
+			case VMIN_OPCODE:
+			case VMAX_OPCODE:
+				return (struct reg_effect) {rd | rs1 | rs2, 0};
+			case READ_OPCODE:
+			case WRITE_OPCODE:
+				return (struct reg_effect) {rd | rs1 | rs2, rd};
+			default:
+				return (struct reg_effect) {rs1 | rs2, rd};
+		}
+	}
+
+	if (layout == &opl_double_reg) {
+		switch (instr_data->opcode) {
+			case CMP_OPCODE:
+			case FCMP_OPCODE:
+			case STM_OPCODE:
+			case BSET_OPCODE:
+			case BCLR_OPCODE:
+			case BTST_OPCODE:
+				return (struct reg_effect) {rd | rs1, 0};
+			case LDM_OPCODE:
+				return (struct reg_effect) {rd, rs1};
+			case SQRT_OPCODE:
+			case NOT_OPCODE:
+			case POPCNT_OPCODE:
+			case CLZ_OPCODE:
+			case CTZ_OPCODE:
+			case BSWAP_OPCODE:
+			case FSQRT_OPCODE:
+			case ITOF_OPCODE:
+			case FTOI_OPCODE:
+			case VSUM_OPCODE:
+				return (struct reg_effect) {rs1, rd};
+			case SCRHW_OPCODE:
+				return (struct reg_effect) {0, rd | rs1};
+			default:
+				break;
+		}
+	}
+
+	if (layout == &opl_mem) {
+		uint32_t index = (instr_data->rsrc2 == MEM_NO_INDEX) ? 0 : rs2;
+
+		switch (instr_data->opcode) {
+			case LDX_OPCODE:
+			case LDB_OPCODE:
+			case LDW_OPCODE:
+				return (struct reg_effect) {rs1 | index, rd};
+			default:
+				break;
+		}
+
+		return (struct reg_effect) {rd | rs1 | index, 0};
+	}
+
+	if (layout == &opl_bitfield) {
+		if (instr_data->opcode == BFI_OPCODE) {
+			return (struct reg_effect) {rd | rs1, rd};
+		}
+
+		return (struct reg_effect) {rs1, rd};
+	}
+
+	if (layout == &opl_regmask) {
+		if (instr_data->opcode == PUSHM_OPCODE) {
+			return (struct reg_effect) {instr_data->unum, 0};
+		}
+
+		return (struct reg_effect) {0, instr_data->unum};
+	}
+
+	if (layout == &opl_cond) {
+		if (instr_data->opcode == CMOV_OPCODE) {
+			// Rd is kept when the condition does not hold
+			return (struct reg_effect) {rd | rs1, rd};
+		}
+
+		return (struct reg_effect) {0, rd};
+	}
+
+	if (layout == &opl_reg_imm) {
+		if (instr_data->opcode == CMPI_OPCODE) {
+			return (struct reg_effect) {rd, 0};
+		}
+
+		return (struct reg_effect) {rd, rd};
+	}
+
+	if (layout == &opl_single_reg) {
+		switch (instr_data->opcode) {
+			case PUSH_OPCODE:
+			case PRINT_OPCODE:
+			case DRAW_OPCODE:
+			case VLEN_OPCODE:
+			case FPRINT_OPCODE:
+				return (struct reg_effect) {rd, 0};
+			case POP_OPCODE:
+			case INPUT_OPCODE:
+			case FINPUT_OPCODE:
+				return (struct reg_effect) {0, rd};
+			// Registers may be used at any target
+			case JMPR_OPCODE:
+				return (struct reg_effect) {ALL_REGS, 0};
+			default:
+				break;
+		}
+	}
+
+	if (layout == &opl_noarg && instr_data->opcode == HALT_OPCODE) {
+		return (struct reg_effect) {0, 0};
+	}
+
+	return (struct reg_effect) {ALL_REGS, ALL_REGS};
+}
+
+static uint64_t ir_count(const struct asm_opt_ctx *opt, size_t idx) {
+	assert (opt);
+
+	return opt->profile ? opt->profile->counts[opt->ir[idx].prof_id] : 0;
+}
+
+static uint64_t ir_taken(const struct asm_opt_ctx *opt, size_t idx) {
+	assert (opt);
+
+	return opt->profile ? opt->profile->taken[opt->ir[idx].prof_id] : 0;
+}
+
+static size_t next_kept(const struct asm_opt_ctx *opt, size_t idx) {
+	assert (opt);
+
+	while (idx < opt->n_ir && opt->deleted[idx]) {
+		idx++;
+	}
+
+	return idx;
+}
+
+/**
+ * Finds jump targets and marks instructions control may come to
+ * not only from the previous one.
+ */
+static int find_targets(struct asm_opt_ctx *opt) {
+	assert (opt);
+
+	const struct label_table *labels = opt->labels;
+
+	for (uint32_t id = 0; id < labels->n_labels; id++) {
+		const struct label_instance *label = &labels->labels[id];
+
+		if (	label->section == SPU_SECTION_CODE &&
+			label->instruction_ptr != -1 &&
+			(size_t)label->instruction_ptr < opt->n_ir) {
+			opt->is_target[label->instruction_ptr] = 1;
+		}
+	}
+
+	for (size_t i = 0; i < opt->n_ir; i++) {
+		const struct asm_ir_instr *ir_instr = &opt->ir[i];
+		ssize_t target = -1;
+
+		opt->targets[i] = -1;
+
+		if (!ir_is_jmp(&ir_instr->data)) {
+			continue;
+		}
+
+		if (ir_is_long_jmp(&ir_instr->data)) {
+			int32_t index = ir_instr->data.jmp_position;
+
+			if (index < 0 || (size_t)index >= opt->n_consts) {
+				return S_FAIL;
+			}
+
+			// Jumps out of the program can not be moved safely
+			if (	opt->consts[index] < -(spu_data_t)i - 1 ||
+				opt->consts[index] > (spu_data_t)(opt->n_ir - i - 1)) {
+				return S_FAIL;
+			}
+
+			target = (ssize_t)i + 1 + (ssize_t)opt->consts[index];
+		} else if (ir_instr->label_id != ASM_NO_LABEL) {
+			const struct label_instance *label =
+				&labels->labels[ir_instr->label_id];
+
+			if (	label->section == SPU_SECTION_CODE &&
+				label->instruction_ptr != -1) {
+				target = label->instruction_ptr;
+			}
+		} else {
+			target = (ssize_t)i + 1 + ir_instr->data.jmp_position;
+
+			// Jumps out of the program can not be moved safely
+			if (target < 0 || (size_t)target > opt->n_ir) {
+				return S_FAIL;
+			}
+		}
+
+		if (target != -1 && (size_t)target < opt->n_ir) {
+			opt->is_target[target] = 1;
+		}
+
+		opt->targets[i] = target;
+	}
+
+	return S_OK;
+}
+
+/**
+ * Checks that the register value is not used after the instruction
+ * on the fall-through path.
+ */
+static int reg_dead_after(const struct asm_opt_ctx *opt, size_t idx,
+			  spu_register_num_t reg) {
+	assert (opt);
+
+	size_t scan_end = opt->n_ir;
+
+	if (scan_end > idx + MAX_LIVENESS_SCAN) {
+		scan_end = idx + MAX_LIVENESS_SCAN;
+	}
+
+	for (size_t i = idx; i < scan_end; i++) {
+		const struct spu_instr_data *instr_data = &opt->ir[i].data;
+
+		if (opt->deleted[i]) {
+			continue;
+		}
+
+		if (ir_is(instr_data, &opl_noarg, HALT_OPCODE)) {
+			return 1;
+		}
+
+		struct reg_effect effect = ir_reg_effect(instr_data);
+
+		if (ir_is_jmp(instr_data) || (effect.reads & REG_BIT(reg))) {
+			return 0;
+		}
+
+		if (effect.writes & REG_BIT(reg)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+struct const_state {
+	spu_data_t values[N_REGISTERS];
+	uint32_t known;
+	// ldc which loaded the register and is used by nothing yet, -1 if none
+	ssize_t defs[N_REGISTERS];
+};
+
+static void forget_defs(struct const_state *state, uint32_t regs) {
+	assert (state);
+
+	for (spu_register_num_t reg = 0; reg < N_REGISTERS; reg++) {
+		if (regs & REG_BIT(reg)) {
+			state->defs[reg] = -1;
+		}
+	}
+}
+
+static int find_const_reg(const struct const_state *state, spu_data_t value,
+			  spu_register_num_t *reg) {
+	assert (state);
+	assert (reg);
+
+	for (spu_register_num_t i = 0; i < N_REGISTERS; i++) {
+		if ((state->known & REG_BIT(i)) && state->values[i] == value) {
+			*reg = i;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Rewrites mul by a power of two into shl if a register with the shift
+ * is already there, or the ldc of the multiplier can load the shift instead.
+ */
+static void mul_to_shl(struct asm_opt_ctx *opt, size_t idx,
+		       struct const_state *state) {
+	assert (opt);
+	assert (state);
+
+	struct spu_instr_data *instr_data = &opt->ir[idx].data;
+	spu_register_num_t mult_reg = instr_data->rsrc1;
+	spu_register_num_t other_reg = instr_data->rsrc2;
+
+	// Try the right operand first, then the left one
+	for (size_t i = 0; i < 2; i++) {
+		spu_register_num_t swap_reg = mult_reg;
+		spu_register_num_t shift_reg = 0;
+
+		mult_reg = other_reg;
+		other_reg = swap_reg;
+
+		if (!(state->known & REG_BIT(mult_reg))) {
+			continue;
+		}
+
+		spu_data_t mult = state->values[mult_reg];
+		if (mult <= 0 || (mult & (mult - 1))) {
+			continue;
+		}
+
+		spu_data_t shift = __builtin_ctzll((unsigned long long)mult);
+
+		if (find_const_reg(state, shift, &shift_reg)) {
+			// Found it
+		} else if (	state->defs[mult_reg] != -1 && mult_reg != other_reg &&
+				(instr_data->rdest == mult_reg ||
+				 reg_dead_after(opt, idx + 1, mult_reg))) {
+			opt->ir[state->defs[mult_reg]].data.snum = (int32_t)shift;
+			state->values[mult_reg] = shift;
+			shift_reg = mult_reg;
+		} else {
+			continue;
+		}
+
+		instr_data->opcode = SHL_OPCODE;
+		instr_data->rsrc1 = other_reg;
+		instr_data->rsrc2 = shift_reg;
+		return;
+	}
+}
+
+/**
+ * Rewrites the operation with the constant operand into the immediate form,
+ * the ldc of the operand is left to the dead code elimination.
+ */
+static void alu_to_imm(struct asm_opt_ctx *opt, size_t idx,
+		       const struct const_state *state) {
+	assert (opt);
+	assert (state);
+
+	struct spu_instr_data *instr_data = &opt->ir[idx].data;
+	spu_register_num_t reg = instr_data->rdest;
+	spu_register_num_t imm_reg = instr_data->rsrc1;
+	uint32_t opcode = 0;
+	int commutative = 0;
+
+	if (ir_is(instr_data, &opl_double_reg, CMP_OPCODE)) {
+		opcode = CMPI_OPCODE;
+	} else if (instr_data->layout == &opl_triple_reg) {
+		switch (instr_data->opcode) {
+			case ADD_OPCODE: opcode = ADDI_OPCODE; commutative = 1; break;
+			case MUL_OPCODE: opcode = MULI_OPCODE; commutative = 1; break;
+			case AND_OPCODE: opcode = ANDI_OPCODE; commutative = 1; break;
+			case SUB_OPCODE: opcode = SUBI_OPCODE; break;
+			case SHR_OPCODE: opcode = SHRI_OPCODE; break;
+			case SHL_OPCODE: opcode = SHLI_OPCODE; break;
+			default: return;
+		}
+
+		// Only the destructive form Rd = op(Rd, imm) is there
+		if (instr_data->rsrc1 == reg) {
+			imm_reg = instr_data->rsrc2;
+		} else if (commutative && instr_data->rsrc2 == reg) {
+			imm_reg = instr_data->rsrc1;
+		} else {
+			return;
+		}
+	} else {
+		return;
+	}
+
+	if (!(state->known & REG_BIT(imm_reg)) || imm_reg == reg) {
+		return;
+	}
+
+	spu_data_t imm = state->values[imm_reg];
+
+	if (	imm < -(1 << (IMM_INTEGER_BLEN - 1)) ||
+		imm >= (1 << (IMM_INTEGER_BLEN - 1))) {
+		return;
+	}
+
+	if ((opcode == SHLI_OPCODE || opcode == SHRI_OPCODE) && (imm < 0 || imm >= 64)) {
+		return;
+	}
+
+	*instr_data = (struct spu_instr_data) {
+		.opcode = opcode,
+		.layout = &opl_reg_imm,
+		.rdest = reg,
+		.rsrc1 = 0,
+		.rsrc2 = 0,
+		.snum = (int32_t)imm,
+	};
+}
+
+/**
+ * Folds the address computation into the next ldm or stm
+ * if the address register is not used after it.
+ */
+static void fuse_address(struct asm_opt_ctx *opt, size_t idx) {
+	assert (opt);
+
+	const struct spu_instr_data *addr_data = &opt->ir[idx].data;
+	spu_register_num_t addr_reg = addr_data->rdest;
+	struct spu_instr_data mem_data = {
+		.opcode = 0,
+		.layout = &opl_mem,
+		.rdest = 0,
+		.rsrc1 = addr_reg,
+		.rsrc2 = MEM_NO_INDEX,
+		.shift = 0,
+		.snum = 0,
+	};
+
+	if (idx + 1 >= opt->n_ir || opt->is_target[idx + 1]) {
+		return;
+	}
+
+	if (ir_is(addr_data, &opl_triple_reg, ADD_OPCODE)) {
+		if (	addr_data->rsrc1 == MEM_NO_INDEX ||
+			addr_data->rsrc2 == MEM_NO_INDEX) {
+			return;
+		}
+
+		mem_data.rsrc1 = addr_data->rsrc1;
+		mem_data.rsrc2 = addr_data->rsrc2;
+	} else if (ir_is(addr_data, &opl_reg_imm, ADDI_OPCODE)) {
+		if (	addr_data->snum < -(1 << (MEM_DISP_BLEN - 1)) ||
+			addr_data->snum >= (1 << (MEM_DISP_BLEN - 1))) {
+			return;
+		}
+
+		mem_data.snum = addr_data->snum;
+	} else {
+		return;
+	}
+
+	struct spu_instr_data *next_data = &opt->ir[idx + 1].data;
+
+	if (next_data->layout != &opl_double_reg || next_data->rdest != addr_reg) {
+		return;
+	}
+
+	mem_data.rdest = next_data->rsrc1;
+
+	if (next_data->opcode == LDM_OPCODE) {
+		mem_data.opcode = LDX_OPCODE;
+	} else if (next_data->opcode == STM_OPCODE && mem_data.rdest != addr_reg) {
+		mem_data.opcode = STX_OPCODE;
+	} else {
+		return;
+	}
+
+	if (	mem_data.rdest != addr_reg &&
+		!reg_dead_after(opt, idx + 2, addr_reg)) {
+		return;
+	}
+
+	*next_data = mem_data;
+	opt->deleted[idx] = 1;
+}
+
+/**
+ * Removes push/pop pairs and self-moves, reloads of the constant
+ * the register already holds, turns mul by a power of two into shl
+ * and operations with constants into the immediate forms.
+ * Address additions are folded into the following loads and stores.
+ *
+ * Constants are tracked along the fall-through path and are forgotten
+ * on labels and calls.
+ */
+static void opt_peephole(struct asm_opt_ctx *opt) {
+	assert (opt);
+
+	struct const_state state = {{0}};
+	forget_defs(&state, ALL_REGS);
+
+	for (size_t i = 0; i < opt->n_ir; i++) {
+		struct spu_instr_data *instr_data = &opt->ir[i].data;
+
+		if (opt->is_target[i]) {
+			state.known = 0;
+			forget_defs(&state, ALL_REGS);
+		}
+
+		if (	ir_is(instr_data, &opl_mov, MOV_OPCODE) &&
+			instr_data->rdest == instr_data->rsrc1) {
+			opt->deleted[i] = 1;
+			continue;
+		}
+
+		if (	ir_is(instr_data, &opl_single_reg, PUSH_OPCODE) &&
+			i + 1 < opt->n_ir && !opt->is_target[i + 1] &&
+			ir_is(&opt->ir[i + 1].data, &opl_single_reg, POP_OPCODE) &&
+			opt->ir[i + 1].data.rdest == instr_data->rdest) {
+			opt->deleted[i] = opt->deleted[i + 1] = 1;
+			i++;
+			continue;
+		}
+
+		if (	ir_is(instr_data, &opl_regmask, PUSHM_OPCODE) &&
+			i + 1 < opt->n_ir && !opt->is_target[i + 1] &&
+			ir_is(&opt->ir[i + 1].data, &opl_regmask, POPM_OPCODE) &&
+			opt->ir[i + 1].data.unum == instr_data->unum) {
+			opt->deleted[i] = opt->deleted[i + 1] = 1;
+			i++;
+			continue;
+		}
+
+		int is_const_load = ir_is(instr_data, &opl_ldc, LDC_OPCODE) &&
+				    opt->ir[i].label_id == ASM_NO_LABEL;
+
+		if (	is_const_load &&
+			(state.known & REG_BIT(instr_data->rdest)) &&
+			state.values[instr_data->rdest] == instr_data->snum) {
+			opt->deleted[i] = 1;
+			continue;
+		}
+
+		if (ir_is(instr_data, &opl_triple_reg, MUL_OPCODE)) {
+			mul_to_shl(opt, i, &state);
+		}
+
+		alu_to_imm(opt, i, &state);
+		fuse_address(opt, i);
+
+		struct reg_effect effect = ir_reg_effect(instr_data);
+
+		forget_defs(&state, effect.reads | effect.writes);
+		state.known &= ~effect.writes;
+
+		if (is_const_load) {
+			state.known |= REG_BIT(instr_data->rdest);
+			state.values[instr_data->rdest] = instr_data->snum;
+			state.defs[instr_data->rdest] = (ssize_t)i;
+		}
+
+		// The jump target may use the loaded constants
+		if (ir_is_jmp(instr_data)) {
+			forget_defs(&state, ALL_REGS);
+		}
+	}
+}
+
+/**
+ * Makes jumps to unconditional jumps go to the final target and
+ * removes jumps to the next instruction.
+ */
+static void opt_jump_chains(struct asm_opt_ctx *opt) {
+	assert (opt);
+
+	for (size_t i = 0; i < opt->n_ir; i++) {
+		ssize_t target = opt->targets[i];
+
+		if (opt->deleted[i] || target == -1) {
+			continue;
+		}
+
+		target = (ssize_t)next_kept(opt, (size_t)target);
+
+		for (size_t hops = 0; hops < MAX_JMP_CHAIN; hops++) {
+			if ((size_t)target == opt->n_ir || (size_t)target == i) {
+				break;
+			}
+
+			const struct asm_ir_instr *target_instr = &opt->ir[target];
+
+			if (	!ir_is(&target_instr->data, &opl_jmp, JMP_OPCODE) ||
+				target_instr->data.jmp_condition != UNCONDITIONAL_JMP ||
+				opt->targets[target] == -1) {
+				break;
+			}
+
+			target = (ssize_t)next_kept(opt, (size_t)opt->targets[target]);
+		}
+
+		// Removed instructions only make the distance shorter
+		ssize_t distance = target - (ssize_t)i - 1;
+		if (distance >= JMP_POSITION_MIN && distance <= JMP_POSITION_MAX) {
+			opt->targets[i] = target;
+		}
+	}
+
+	for (size_t i = opt->n_ir; i-- > 0; ) {
+		if (	!opt->deleted[i] && opt->targets[i] != -1 &&
+			ir_is(&opt->ir[i].data, &opl_jmp, JMP_OPCODE) &&
+			next_kept(opt, i + 1) == next_kept(opt, (size_t)opt->targets[i])) {
+			opt->deleted[i] = 1;
+		}
+	}
+}
+
+static int jmp_fits(ssize_t from, ssize_t to) {
+	ssize_t distance = to - from - 1;
+
+	return distance >= JMP_POSITION_MIN && distance <= JMP_POSITION_MAX;
+}
+
+/**
+ * Computes the positions of instructions after the stage and returns
+ * the new number of instructions. Kept instructions go in the order,
+ * or in the original one if it is NULL. Without the order removed
+ * instructions are replaced by the next kept one, with the order
+ * they are jumps replaced by their targets. The target may be a removed
+ * jump too, so removed jumps are redirected to the first kept
+ * instruction down the chain.
+ */
+static size_t build_new_map(struct asm_opt_ctx *opt,
+			    const size_t *order, size_t n_order) {
+	assert (opt);
+
+	size_t *new_map = opt->new_map;
+
+	if (!order) {
+		size_t n_kept = 0;
+
+		for (size_t i = 0; i < opt->n_ir; i++) {
+			new_map[i] = n_kept;
+			n_kept += !opt->deleted[i];
+		}
+		new_map[opt->n_ir] = n_kept;
+
+		return n_kept;
+	}
+
+	for (size_t i = 0; i < n_order; i++) {
+		new_map[order[i]] = i;
+	}
+	new_map[opt->n_ir] = n_order;
+
+	for (size_t i = 0; i < opt->n_ir; i++) {
+		if (!opt->deleted[i]) {
+			continue;
+		}
+
+		ssize_t target = opt->targets[i];
+
+		while (opt->deleted[target]) {
+			assert (opt->targets[target] != -1);
+			target = opt->targets[target];
+		}
+
+		// Walked chains are not walked again
+		for (size_t j = i; opt->deleted[j]; ) {
+			size_t next = (size_t)opt->targets[j];
+
+			opt->targets[j] = target;
+			j = next;
+		}
+
+		new_map[i] = new_map[target];
+	}
+
+	return n_order;
+}
+
+static int jumps_fit(const struct asm_opt_ctx *opt) {
+	assert (opt);
+
+	for (size_t i = 0; i < opt->n_ir; i++) {
+		if (	!opt->deleted[i] && opt->targets[i] != -1 &&
+			!jmp_fits((ssize_t)opt->new_map[i],
+				  (ssize_t)opt->new_map[opt->targets[i]])) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Moves instructions and code labels to the new positions and
+ * recomputes the jumps to the new layout.
+ */
+static void apply_new_map(struct asm_opt_ctx *opt, size_t n_new) {
+	assert (opt);
+
+	struct label_table *labels = opt->labels;
+	const size_t *new_map = opt->new_map;
+
+	for (uint32_t id = 0; id < labels->n_labels; id++) {
+		struct label_instance *label = &labels->labels[id];
+
+		if (label->section == SPU_SECTION_CODE && label->instruction_ptr != -1) {
+			label->instruction_ptr = (ssize_t)new_map[label->instruction_ptr];
+		}
+	}
+
+	for (size_t i = 0; i < opt->n_ir; i++) {
+		struct asm_ir_instr *ir_instr = &opt->ir[i];
+
+		if (opt->deleted[i]) {
+			continue;
+		}
+
+		if (opt->targets[i] != -1) {
+			ssize_t new_target = (ssize_t)new_map[opt->targets[i]];
+
+			if (	ir_instr->label_id == ASM_NO_LABEL ||
+				labels->labels[ir_instr->label_id].instruction_ptr !=
+					new_target) {
+				ir_set_jmp_offset(ir_instr, new_target -
+						  (ssize_t)new_map[i] - 1);
+			}
+		}
+
+		opt->scratch[new_map[i]] = *ir_instr;
+	}
+
+	memcpy(opt->ir, opt->scratch, sizeof(struct asm_ir_instr) * n_new);
+	opt->n_ir = n_new;
+}
+
+static int ir_ends_block(const struct spu_instr_data *instr_data) {
+	assert (instr_data);
+
+	return	ir_is_jmp(instr_data) ||
+		ir_is(instr_data, &opl_single_reg, JMPR_OPCODE) ||
+		ir_is(instr_data, &opl_noarg, RET_OPCODE) ||
+		ir_is(instr_data, &opl_noarg, HALT_OPCODE);
+}
+
+static int ir_falls_through(const struct spu_instr_data *instr_data) {
+	assert (instr_data);
+
+	if (ir_is(instr_data, &opl_jmp, JMP_OPCODE)) {
+		return instr_data->jmp_condition != UNCONDITIONAL_JMP;
+	}
+
+	return	!ir_is(instr_data, &opl_single_reg, JMPR_OPCODE) &&
+		!ir_is(instr_data, &opl_noarg, RET_OPCODE) &&
+		!ir_is(instr_data, &opl_noarg, HALT_OPCODE);
+}
+
+/**
+ * Instructions whose only effect is the destination register.
+ * Ones which may fault, like div, are not here.
+ */
+static int ir_is_pure(const struct spu_instr_data *instr_data) {
+	assert (instr_data);
+
+	if (	ir_is(instr_data, &opl_mov, MOV_OPCODE) ||
+		ir_is(instr_data, &opl_ldc, LDC_OPCODE) ||
+		ir_is(instr_data, &opl_ldc, LDK_OPCODE) ||
+		ir_is(instr_data, &opl_double_reg, NOT_OPCODE) ||
+		ir_is(instr_data, &opl_double_reg, POPCNT_OPCODE) ||
+		ir_is(instr_data, &opl_double_reg, CLZ_OPCODE) ||
+		ir_is(instr_data, &opl_double_reg, CTZ_OPCODE) ||
+		ir_is(instr_data, &opl_double_reg, BSWAP_OPCODE) ||
+		ir_is(instr_data, &opl_double_reg, FSQRT_OPCODE) ||
+		ir_is(instr_data, &opl_double_reg, ITOF_OPCODE) ||
+		instr_data->layout == &opl_cond ||
+		instr_data->layout == &opl_bitfield) {
+		return 1;
+	}
+
+	if (instr_data->layout == &opl_reg_imm) {
+		return instr_data->opcode != CMPI_OPCODE;
+	}
+
+	if (instr_data->layout != &opl_triple_reg) {
+		return 0;
+	}
+
+	switch (instr_data->opcode) {
+		case ADD_OPCODE:
+		case MUL_OPCODE:
+		case SUB_OPCODE:
+		case SHR_OPCODE:
+		case SHL_OPCODE:
+		case OR_OPCODE:
+		case XOR_OPCODE:
+		case AND_OPCODE:
+		case ROL_OPCODE:
+		case ROR_OPCODE:
+		case FADD_OPCODE:
+		case FSUB_OPCODE:
+		case FMUL_OPCODE:
+		case FDIV_OPCODE:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static size_t target_block(const struct asm_opt_ctx *opt,
+			   const struct asm_cfg *cfg, size_t idx) {
+	assert (opt);
+	assert (cfg);
+
+	ssize_t target = opt->targets[idx];
+
+	if (target == -1 || (size_t)target == opt->n_ir) {
+		return BLOCK_EXIT;
+	}
+
+	return cfg->block_of[target];
+}
+
+/**
+ * Splits the code into basic blocks. Expects no removed instructions.
+ */
+static int build_cfg(struct asm_opt_ctx *opt, struct asm_cfg *cfg) {
+	assert (opt);
+	assert (cfg);
+
+	size_t n_blocks = 0;
+
+	cfg->block_of = (size_t *)arena_alloc(opt->arena,
+					sizeof(size_t) * (opt->n_ir + 1));
+	if (!cfg->block_of) {
+		return S_FAIL;
+	}
+
+	for (size_t i = 0; i < opt->n_ir; i++) {
+		if (	i == 0 || opt->is_target[i] ||
+			ir_ends_block(&opt->ir[i - 1].data)) {
+			n_blocks++;
+		}
+
+		cfg->block_of[i] = n_blocks - 1;
+	}
+
+	cfg->n_blocks = n_blocks;
+	cfg->blocks = (struct asm_block *)arena_calloc(opt->arena,
+					n_blocks + 1, sizeof(struct asm_block));
+	if (!cfg->blocks) {
+		return S_FAIL;
+	}
+
+	for (size_t i = opt->n_ir; i-- > 0; ) {
+		cfg->blocks[cfg->block_of[i]].start = i;
+	}
+
+	for (size_t b = 0; b < n_blocks; b++) {
+		struct asm_block *block = &cfg->blocks[b];
+		size_t last = 0;
+
+		block->end = (b + 1 < n_blocks) ? cfg->blocks[b + 1].start : opt->n_ir;
+		block->succs[0] = block->succs[1] = BLOCK_NONE;
+
+		last = block->end - 1;
+		const struct spu_instr_data *instr_data = &opt->ir[last].data;
+
+		if (ir_falls_through(instr_data)) {
+			block->succs[0] = (block->end == opt->n_ir) ? BLOCK_EXIT : b + 1;
+		}
+
+		if (ir_is_jmp(instr_data)) {
+			block->succs[1] = target_block(opt, cfg, last);
+		}
+	}
+
+	return S_OK;
+}
+
+static void mark_reachable(const struct asm_cfg *cfg, size_t *stack,
+			   size_t *n_stack, size_t block) {
+	assert (cfg);
+	assert (stack);
+	assert (n_stack);
+
+	if (block >= cfg->n_blocks || cfg->blocks[block].reachable) {
+		return;
+	}
+
+	cfg->blocks[block].reachable = 1;
+	stack[(*n_stack)++] = block;
+}
+
+/**
+ * Removes blocks not reachable from the program start, global labels
+ * and labels whose address is taken.
+ */
+static int remove_unreachable(struct asm_opt_ctx *opt, struct asm_cfg *cfg) {
+	assert (opt);
+	assert (cfg);
+
+	const struct label_table *labels = opt->labels;
+	size_t n_stack = 0;
+	size_t *stack = (size_t *)arena_alloc(opt->arena,
+					sizeof(size_t) * (cfg->n_blocks + 1));
+	if (!stack) {
+		return S_FAIL;
+	}
+
+	mark_reachable(cfg, stack, &n_stack, 0);
+
+	for (uint32_t id = 0; id < labels->n_labels; id++) {
+		const struct label_instance *label = &labels->labels[id];
+
+		if (	label->section == SPU_SECTION_CODE &&
+			(label->flags & (SPU_SYMBOL_GLOBAL | ASM_LABEL_JTABLE)) &&
+			label->instruction_ptr != -1 &&
+			(size_t)label->instruction_ptr < opt->n_ir) {
+			mark_reachable(cfg, stack, &n_stack,
+				       cfg->block_of[label->instruction_ptr]);
+		}
+	}
+
+	for (size_t i = 0; i < opt->n_ir; i++) {
+		const struct asm_ir_instr *ir_instr = &opt->ir[i];
+
+		if (ir_instr->label_id == ASM_NO_LABEL || ir_is_jmp(&ir_instr->data)) {
+			continue;
+		}
+
+		const struct label_instance *label = &labels->labels[ir_instr->label_id];
+
+		if (	label->section == SPU_SECTION_CODE &&
+			label->instruction_ptr != -1 &&
+			(size_t)label->instruction_ptr < opt->n_ir) {
+			mark_reachable(cfg, stack, &n_stack,
+				       cfg->block_of[label->instruction_ptr]);
+		}
+	}
+
+	while (n_stack > 0) {
+		const struct asm_block *block = &cfg->blocks[stack[--n_stack]];
+
+		mark_reachable(cfg, stack, &n_stack, block->succs[0]);
+		mark_reachable(cfg, stack, &n_stack, block->succs[1]);
+	}
+
+	for (size_t b = 0; b < cfg->n_blocks; b++) {
+		const struct asm_block *block = &cfg->blocks[b];
+
+		if (block->reachable) {
+			continue;
+		}
+
+		for (size_t i = block->start; i < block->end; i++) {
+			opt->deleted[i] = 1;
+		}
+	}
+
+	return S_OK;
+}
+
+static uint32_t block_live_in(const struct asm_opt_ctx *opt,
+			      const struct asm_block *block) {
+	assert (opt);
+	assert (block);
+
+	uint32_t live = block->live_out;
+
+	for (size_t i = block->end; i-- > block->start; ) {
+		if (opt->deleted[i]) {
+			continue;
+		}
+
+		struct reg_effect effect = ir_reg_effect(&opt->ir[i].data);
+
+		live = effect.reads | (live & ~effect.writes);
+	}
+
+	return live;
+}
+
+static uint32_t succ_live_in(const struct asm_cfg *cfg, size_t succ) {
+	assert (cfg);
+
+	if (succ == BLOCK_NONE) {
+		return 0;
+	}
+
+	// Nothing is known about the code after the exit
+	if (succ == BLOCK_EXIT) {
+		return ALL_REGS;
+	}
+
+	return cfg->blocks[succ].live_in;
+}
+
+static void compute_liveness(const struct asm_opt_ctx *opt, struct asm_cfg *cfg) {
+	assert (opt);
+	assert (cfg);
+
+	int changed = 1;
+
+	for (size_t b = 0; b < cfg->n_blocks; b++) {
+		cfg->blocks[b].live_in = cfg->blocks[b].live_out = 0;
+	}
+
+	while (changed) {
+		changed = 0;
+
+		for (size_t b = cfg->n_blocks; b-- > 0; ) {
+			struct asm_block *block = &cfg->blocks[b];
+
+			if (!block->reachable) {
+				continue;
+			}
+
+			block->live_out = succ_live_in(cfg, block->succs[0]) |
+					  succ_live_in(cfg, block->succs[1]);
+
+			uint32_t live_in = block_live_in(opt, block);
+
+			if (live_in != block->live_in) {
+				block->live_in = live_in;
+				changed = 1;
+			}
+		}
+	}
+}
+
+/**
+ * Removes instructions writing registers nobody reads afterwards.
+ * Returns the number of the removed ones.
+ */
+static size_t remove_dead_writes(struct asm_opt_ctx *opt, const struct asm_cfg *cfg) {
+	assert (opt);
+	assert (cfg);
+
+	size_t n_removed = 0;
+
+	for (size_t b = 0; b < cfg->n_blocks; b++) {
+		const struct asm_block *block = &cfg->blocks[b];
+		uint32_t live = block->live_out;
+
+		if (!block->reachable) {
+			continue;
+		}
+
+		for (size_t i = block->end; i-- > block->start; ) {
+			const struct spu_instr_data *instr_data = &opt->ir[i].data;
+
+			if (opt->deleted[i]) {
+				continue;
+			}
+
+			struct reg_effect effect = ir_reg_effect(instr_data);
+
+			if (ir_is_pure(instr_data) && !(effect.writes & live)) {
+				opt->deleted[i] = 1;
+				n_removed++;
+				continue;
+			}
+
+			live = effect.reads | (live & ~effect.writes);
+		}
+	}
+
+	return n_removed;
+}
+
+static int invert_jmp_condition(const struct asm_opt_ctx *opt,
+				spu_register_num_t condition,
+				spu_register_num_t *inverted) {
+	assert (opt);
+	assert (inverted);
+
+	switch (condition) {
+		case EQUALS_JMP:		*inverted = NOT_EQUALS_JMP;	return S_OK;
+		case NOT_EQUALS_JMP:		*inverted = EQUALS_JMP;		return S_OK;
+		default:
+			break;
+	}
+
+	if (opt->has_fcmp) {
+		return S_FAIL;
+	}
+
+	switch (condition) {
+		case GREATER_EQUALS_JMP:	*inverted = LESS_JMP;		break;
+		case LESS_JMP:			*inverted = GREATER_EQUALS_JMP;	break;
+		case GREATER_JMP:		*inverted = LESS_EQUALS_JMP;	break;
+		case LESS_EQUALS_JMP:		*inverted = GREATER_JMP;	break;
+		default:
+			return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+/**
+ * Turns a conditional jump over an unconditional one
+ *
+ * ```
+ *	jmp.eq .next
+ *	jmp .far
+ * .next:
+ * ```
+ *
+ * into the single inverted jump `jmp.ne .far`.
+ */
+static void thread_branches(struct asm_opt_ctx *opt) {
+	assert (opt);
+
+	for (size_t i = 0; i < opt->n_ir; i++) {
+		struct spu_instr_data *instr_data = &opt->ir[i].data;
+		spu_register_num_t inverted = 0;
+
+		if (	opt->deleted[i] || opt->targets[i] == -1 ||
+			!ir_is(instr_data, &opl_jmp, JMP_OPCODE) ||
+			invert_jmp_condition(opt, instr_data->jmp_condition, &inverted)) {
+			continue;
+		}
+
+		size_t next = next_kept(opt, i + 1);
+
+		if (	next == opt->n_ir || opt->is_target[next] ||
+			opt->targets[next] == -1 ||
+			!ir_is(&opt->ir[next].data, &opl_jmp, JMP_OPCODE) ||
+			opt->ir[next].data.jmp_condition != UNCONDITIONAL_JMP ||
+			next_kept(opt, next + 1) != next_kept(opt, (size_t)opt->targets[i]) ||
+			!jmp_fits((ssize_t)i, opt->targets[next])) {
+			continue;
+		}
+
+		instr_data->jmp_condition = inverted;
+		opt->targets[i] = opt->targets[next];
+		opt->deleted[next] = 1;
+	}
+}
+
+/**
+ * Resets per-stage marks and finds jump targets of the current code.
+ */
+static int prepare_stage(struct asm_opt_ctx *opt) {
+	assert (opt);
+
+	memset(opt->is_target, 0, opt->n_ir + 1);
+	memset(opt->deleted, 0, opt->n_ir + 1);
+
+	return find_targets(opt);
+}
+
+static int peephole_stage(struct asm_opt_ctx *opt) {
+	assert (opt);
+
+	opt_peephole(opt);
+	opt_jump_chains(opt);
+
+	apply_new_map(opt, build_new_map(opt, NULL, 0));
+
+	return S_OK;
+}
+
+/**
+ * Global passes over the control-flow graph: removes unreachable blocks
+ * and dead register writes, threads branches.
+ */
+static int cfg_stage(struct asm_opt_ctx *opt) {
+	assert (opt);
+
+	int ret = S_OK;
+	struct asm_cfg cfg = {0};
+
+	_CT_CHECKED(build_cfg(opt, &cfg));
+	_CT_CHECKED(remove_unreachable(opt, &cfg));
+
+	for (size_t round = 0; round < MAX_DCE_ROUNDS; round++) {
+		compute_liveness(opt, &cfg);
+
+		if (remove_dead_writes(opt, &cfg) == 0) {
+			break;
+		}
+	}
+
+	thread_branches(opt);
+
+	apply_new_map(opt, build_new_map(opt, NULL, 0));
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+/**
+ * Chains are runs of blocks falling through into each other.
+ * They may be placed anywhere, so the chain an unconditional jump
+ * at the end of the chain goes to is placed right after it, and
+ * the jump is removed. The chain falling out of the code stays last.
+ *
+ * With the profile, a conditional jump which is mostly taken is
+ * inverted to go to its fall-through path, the rest of its chain
+ * becomes a chain of its own, and the chain the jump went to is
+ * placed right after it. Chains never executed go to the end.
+ */
+struct layout_ctx {
+	// End of the chain, valid at chain starts
+	size_t *chain_end;
+	uint8_t *is_chain_start;
+	uint8_t *placed;
+
+	// Chain starts split off by inverted jumps
+	size_t *split;
+	size_t n_split;
+
+	// Scan positions of chain starts in the original order
+	size_t next_hot;
+	size_t next_cold;
+
+	size_t last_chain;
+
+	size_t *order;
+	size_t n_order;
+};
+
+static int chain_is_cold(const struct asm_opt_ctx *opt, size_t chain) {
+	assert (opt);
+
+	return opt->profile && ir_count(opt, chain) == 0;
+}
+
+/**
+ * Checks that the jump should be inverted to let its target fall through.
+ */
+static int layout_should_invert(const struct asm_opt_ctx *opt,
+				const struct layout_ctx *layout, size_t idx) {
+	assert (opt);
+	assert (layout);
+
+	const struct spu_instr_data *instr_data = &opt->ir[idx].data;
+	ssize_t target = opt->targets[idx];
+	spu_register_num_t inverted = 0;
+
+	if (	!opt->profile || target == -1 || (size_t)target >= opt->n_ir ||
+		(size_t)target == idx + 1 ||
+		!ir_is(instr_data, &opl_jmp, JMP_OPCODE) ||
+		invert_jmp_condition(opt, instr_data->jmp_condition, &inverted)) {
+		return 0;
+	}
+
+	return	layout->is_chain_start[target] && !layout->placed[target] &&
+		ir_taken(opt, idx) * 2 > ir_count(opt, idx);
+}
+
+static size_t layout_next_chain(const struct asm_opt_ctx *opt,
+				struct layout_ctx *layout) {
+	assert (opt);
+	assert (layout);
+
+	size_t n = opt->n_ir;
+
+	while (	layout->next_hot < n &&
+		(layout->placed[layout->next_hot] ||
+		 chain_is_cold(opt, layout->next_hot))) {
+		layout->next_hot = layout->chain_end[layout->next_hot];
+	}
+
+	if (layout->next_hot < n) {
+		return layout->next_hot;
+	}
+
+	while (layout->n_split > 0) {
+		size_t chain = layout->split[--layout->n_split];
+
+		if (!layout->placed[chain]) {
+			return chain;
+		}
+	}
+
+	while (layout->next_cold < n && layout->placed[layout->next_cold]) {
+		layout->next_cold = layout->chain_end[layout->next_cold];
+	}
+
+	return layout->next_cold;
+}
+
+/**
+ * Places the chain and returns the chain which has to go next,
+ * or the number of instructions if any chain may go.
+ */
+static size_t layout_place_chain(struct asm_opt_ctx *opt,
+				 struct layout_ctx *layout, size_t chain) {
+	assert (opt);
+	assert (layout);
+
+	size_t n = opt->n_ir;
+	size_t end = layout->chain_end[chain];
+
+	layout->placed[chain] = 1;
+
+	for (size_t i = chain; i < end; i++) {
+		layout->order[layout->n_order++] = i;
+
+		if (i + 1 < end && layout_should_invert(opt, layout, i)) {
+			size_t target = (size_t)opt->targets[i];
+
+			layout->chain_end[i + 1] = end;
+			layout->is_chain_start[i + 1] = 1;
+			layout->split[layout->n_split++] = i + 1;
+
+			// The condition is inverted when the layout is applied
+			opt->targets[i] = (ssize_t)(i + 1);
+
+			return target;
+		}
+	}
+
+	size_t last = end - 1;
+	ssize_t target = opt->targets[last];
+
+	if (	ir_is(&opt->ir[last].data, &opl_jmp, JMP_OPCODE) &&
+		opt->ir[last].data.jmp_condition == UNCONDITIONAL_JMP &&
+		target != -1 && (size_t)target < n &&
+		layout->is_chain_start[target] && !layout->placed[target]) {
+		opt->deleted[last] = 1;
+		layout->n_order--;
+
+		return (size_t)target;
+	}
+
+	return n;
+}
+
+static int layout_stage(struct asm_opt_ctx *opt) {
+	assert (opt);
+
+	size_t n = opt->n_ir;
+
+	if (n == 0) {
+		return S_OK;
+	}
+
+	struct layout_ctx layout = {
+		.chain_end = (size_t *)arena_alloc(opt->arena, sizeof(size_t) * n),
+		.is_chain_start = (uint8_t *)arena_calloc(opt->arena, n, sizeof(uint8_t)),
+		.placed = (uint8_t *)arena_calloc(opt->arena, n, sizeof(uint8_t)),
+		.split = (size_t *)arena_alloc(opt->arena, sizeof(size_t) * n),
+		.n_split = 0,
+		.next_hot = 0,
+		.next_cold = 0,
+		.last_chain = n,
+		.order = (size_t *)arena_alloc(opt->arena, sizeof(size_t) * n),
+		.n_order = 0,
+	};
+
+	ssize_t *old_targets = (ssize_t *)arena_alloc(opt->arena,
+					sizeof(ssize_t) * (n + 1));
+
+	if (	!layout.chain_end || !layout.is_chain_start || !layout.placed ||
+		!layout.split || !layout.order || !old_targets) {
+		return S_FAIL;
+	}
+
+	memcpy(old_targets, opt->targets, sizeof(ssize_t) * (n + 1));
+
+	for (size_t i = 0, start = 0; i < n; i++) {
+		if (!ir_falls_through(&opt->ir[i].data) || i + 1 == n) {
+			layout.is_chain_start[start] = 1;
+			layout.chain_end[start] = i + 1;
+			start = i + 1;
+		}
+	}
+
+	if (ir_falls_through(&opt->ir[n - 1].data)) {
+		for (layout.last_chain = 0; layout.chain_end[layout.last_chain] != n;
+		     layout.last_chain = layout.chain_end[layout.last_chain]) {
+		}
+
+		// Nothing to reorder
+		if (layout.last_chain == 0) {
+			return S_OK;
+		}
+
+		layout.placed[layout.last_chain] = 1;
+	}
+
+	size_t chain = 0;
+
+	while (chain != n) {
+		chain = layout_place_chain(opt, &layout, chain);
+
+		if (chain == n) {
+			chain = layout_next_chain(opt, &layout);
+		}
+	}
+
+	if (layout.last_chain != n) {
+		for (size_t i = layout.last_chain; i < n; i++) {
+			layout.order[layout.n_order++] = i;
+		}
+	}
+
+	size_t n_new = build_new_map(opt, layout.order, layout.n_order);
+
+	// Moved blocks may get too far from each other
+	if (!jumps_fit(opt)) {
+		return S_OK;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		spu_register_num_t inverted = 0;
+
+		if (	opt->targets[i] != old_targets[i] && !opt->deleted[i] &&
+			!invert_jmp_condition(opt, opt->ir[i].data.jmp_condition, &inverted)) {
+			opt->ir[i].data.jmp_condition = inverted;
+		}
+	}
+
+	apply_new_map(opt, n_new);
+
+	return S_OK;
+}
+
+/**
+ * Finds the end of the leaf subroutine starting at the instruction:
+ * the ret all its jumps stay before. Subroutines with calls, jumps
+ * outside, or longer than the limit are not inlined.
+ */
+static ssize_t find_inline_body(const struct asm_opt_ctx *opt, size_t start,
+				size_t max_len) {
+	assert (opt);
+
+	size_t max_target = start;
+
+	for (size_t i = start; i < opt->n_ir && i - start <= max_len; i++) {
+		const struct spu_instr_data *instr_data = &opt->ir[i].data;
+
+		if (	ir_is(instr_data, &opl_jmp, CALL_OPCODE) ||
+			ir_is(instr_data, &opl_jmp, CALLL_OPCODE) ||
+			ir_is(instr_data, &opl_single_reg, JMPR_OPCODE) ||
+			ir_is(instr_data, &opl_single_reg, CALLR_OPCODE)) {
+			return -1;
+		}
+
+		if (ir_is_jmp(instr_data)) {
+			ssize_t target = opt->targets[i];
+
+			if (target < (ssize_t)start) {
+				return -1;
+			}
+
+			if ((size_t)target > max_target) {
+				max_target = (size_t)target;
+			}
+		}
+
+		if (ir_is(instr_data, &opl_noarg, RET_OPCODE) && max_target <= i) {
+			return (ssize_t)i;
+		}
+	}
+
+	return -1;
+}
+
+struct inline_site {
+	// Body of the subroutine without the last ret, -1 if the call is kept
+	ssize_t start;
+	ssize_t end;
+};
+
+/**
+ * Decides which calls are replaced by the bodies of the subroutines
+ * and returns the new number of instructions.
+ */
+static size_t find_inline_sites(struct asm_opt_ctx *opt, struct inline_site *sites) {
+	assert (opt);
+	assert (sites);
+
+	const struct label_table *labels = opt->labels;
+	size_t n_new = opt->n_ir;
+	uint64_t max_count = 0;
+
+	uint8_t *forced = (uint8_t *)arena_calloc(opt->arena, opt->n_ir + 1,
+						  sizeof(uint8_t));
+	ssize_t *body_ends = (ssize_t *)arena_alloc(opt->arena,
+						sizeof(ssize_t) * (opt->n_ir + 1));
+	if (!forced || !body_ends) {
+		return n_new;
+	}
+
+	for (uint32_t id = 0; id < labels->n_labels; id++) {
+		const struct label_instance *label = &labels->labels[id];
+
+		if (	label->section == SPU_SECTION_CODE &&
+			(label->flags & ASM_LABEL_INLINE) &&
+			label->instruction_ptr != -1) {
+			forced[label->instruction_ptr] = 1;
+		}
+	}
+
+	for (size_t i = 0; i <= opt->n_ir; i++) {
+		body_ends[i] = -2;
+	}
+
+	for (size_t i = 0; i < opt->n_ir; i++) {
+		if (ir_is(&opt->ir[i].data, &opl_jmp, CALL_OPCODE) &&
+		    ir_count(opt, i) > max_count) {
+			max_count = ir_count(opt, i);
+		}
+	}
+
+	for (size_t i = 0; i < opt->n_ir; i++) {
+		const struct spu_instr_data *instr_data = &opt->ir[i].data;
+		ssize_t target = opt->targets[i];
+
+		sites[i].start = sites[i].end = -1;
+
+		// Even the call which is not taken pushes the return address
+		if (	!ir_is(instr_data, &opl_jmp, CALL_OPCODE) ||
+			instr_data->jmp_condition != UNCONDITIONAL_JMP ||
+			target == -1 || (size_t)target == opt->n_ir) {
+			continue;
+		}
+
+		size_t max_len = INLINE_MAX_LEN;
+
+		if (forced[target]) {
+			max_len = INLINE_FORCED_MAX_LEN;
+		} else if (opt->profile && ir_count(opt, i) == 0) {
+			continue;
+		} else if (opt->profile &&
+			   ir_count(opt, i) * INLINE_HOT_SHARE >= max_count) {
+			max_len = INLINE_HOT_MAX_LEN;
+		}
+
+		if (body_ends[target] == -2) {
+			body_ends[target] = find_inline_body(opt, (size_t)target,
+							     INLINE_FORCED_MAX_LEN);
+		}
+
+		if (body_ends[target] == -1) {
+			continue;
+		}
+
+		size_t body_len = (size_t)(body_ends[target] - target);
+
+		if (	body_len > max_len ||
+			n_new + body_len - 1 > INLINE_MAX_GROWTH * opt->n_ir) {
+			continue;
+		}
+
+		sites[i].start = target;
+		sites[i].end = body_ends[target];
+		n_new = n_new + body_len - 1;
+	}
+
+	return n_new;
+}
+
+/**
+ * Allocates per-instruction arrays of the passes for the current code.
+ */
+static int alloc_opt_arrays(struct asm_opt_ctx *opt) {
+	assert (opt);
+
+	size_t n = opt->n_ir + 1;
+
+	opt->targets = (ssize_t *)arena_alloc(opt->arena, sizeof(ssize_t) * n);
+	opt->is_target = (uint8_t *)arena_alloc(opt->arena, n);
+	opt->deleted = (uint8_t *)arena_alloc(opt->arena, n);
+	opt->new_map = (size_t *)arena_alloc(opt->arena, sizeof(size_t) * n);
+	opt->scratch = (struct asm_ir_instr *)arena_alloc(opt->arena,
+					sizeof(struct asm_ir_instr) * n);
+
+	if (	!opt->targets || !opt->is_target || !opt->deleted ||
+		!opt->new_map || !opt->scratch) {
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+/**
+ * Replaces calls of small leaf subroutines with copies of their bodies.
+ * Returns from the copy become jumps past its end. Subroutines stay
+ * where they are, the unused ones are removed as unreachable later.
+ */
+static int inline_stage(struct asm_opt_ctx *opt) {
+	assert (opt);
+
+	int ret = S_OK;
+	size_t n = opt->n_ir;
+	size_t *new_map = opt->new_map;
+	const struct label_table *labels = opt->labels;
+
+	struct inline_site *sites = (struct inline_site *)arena_alloc(opt->arena,
+					sizeof(struct inline_site) * (n + 1));
+	if (!sites) {
+		_CT_FAIL();
+	}
+
+	size_t n_new = find_inline_sites(opt, sites);
+	size_t pos = 0;
+
+	struct asm_ir_instr *new_ir = (struct asm_ir_instr *)arena_alloc(opt->arena,
+					sizeof(struct asm_ir_instr) * (n_new + 1));
+	ssize_t *new_targets = (ssize_t *)arena_alloc(opt->arena,
+					sizeof(ssize_t) * (n_new + 1));
+	if (!new_ir || !new_targets) {
+		_CT_FAIL();
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		new_map[i] = pos;
+		pos += (sites[i].start == -1) ? 1 : (size_t)(sites[i].end - sites[i].start);
+	}
+	new_map[n] = pos;
+	assert (pos == n_new);
+
+	for (size_t i = 0; i < n; i++) {
+		size_t base = new_map[i];
+
+		if (sites[i].start == -1) {
+			new_ir[base] = opt->ir[i];
+			new_targets[base] = (opt->targets[i] == -1) ? -1 :
+					    (ssize_t)new_map[opt->targets[i]];
+			continue;
+		}
+
+		size_t start = (size_t)sites[i].start;
+		size_t end = (size_t)sites[i].end;
+
+		for (size_t j = start; j < end; j++) {
+			struct asm_ir_instr *copy = &new_ir[base + j - start];
+
+			*copy = opt->ir[j];
+			new_targets[base + j - start] = (opt->targets[j] == -1) ? -1 :
+				(ssize_t)(base + (size_t)opt->targets[j] - start);
+
+			if (ir_is(&copy->data, &opl_noarg, RET_OPCODE)) {
+				copy->data = (struct spu_instr_data) {
+					.opcode = JMP_OPCODE,
+					.layout = &opl_jmp,
+					.jmp_condition = UNCONDITIONAL_JMP,
+				};
+				new_targets[base + j - start] = (ssize_t)(base + end - start);
+			}
+
+			// Jumps of the copy go inside it, ldc keeps the address of the label
+			if (ir_is_jmp(&copy->data)) {
+				copy->label_id = ASM_NO_LABEL;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < n_new; i++) {
+		if (new_targets[i] != -1 && !jmp_fits((ssize_t)i, new_targets[i])) {
+			return S_OK;
+		}
+	}
+
+	for (uint32_t id = 0; id < labels->n_labels; id++) {
+		struct label_instance *label = &labels->labels[id];
+
+		if (label->section == SPU_SECTION_CODE && label->instruction_ptr != -1) {
+			label->instruction_ptr = (ssize_t)new_map[label->instruction_ptr];
+		}
+	}
+
+	for (size_t i = 0; i < n_new; i++) {
+		struct asm_ir_instr *ir_instr = &new_ir[i];
+
+		if (new_targets[i] == -1) {
+			continue;
+		}
+
+		if (	ir_instr->label_id == ASM_NO_LABEL ||
+			labels->labels[ir_instr->label_id].instruction_ptr !=
+				new_targets[i]) {
+			ir_set_jmp_offset(ir_instr, new_targets[i] - (ssize_t)i - 1);
+		}
+	}
+
+	opt->ir = new_ir;
+	opt->n_ir = n_new;
+
+	_CT_CHECKED(alloc_opt_arrays(opt));
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+typedef int (*asm_opt_stage_fn)(struct asm_opt_ctx *opt);
+
+int asm_optimize(struct arena *arena, struct asm_ir_instr **ir, size_t *n_ir,
+		 struct label_table *labels, const spu_data_t *consts, size_t n_consts,
+		 const struct spu_profile *profile) {
+	assert (arena);
+	assert (ir);
+	assert (*ir || *n_ir == 0);
+	assert (n_ir);
+	assert (labels);
+	assert (consts || n_consts == 0);
+
+	int ret = S_OK;
+
+	static const asm_opt_stage_fn stages[] = {
+		inline_stage,
+		peephole_stage,
+		cfg_stage,
+		layout_stage,
+	};
+
+	struct asm_opt_ctx opt = {
+		.arena = arena,
+		.profile = profile,
+		.ir = *ir,
+		.n_ir = *n_ir,
+		.labels = labels,
+		.consts = consts,
+		.n_consts = n_consts,
+	};
+
+	_CT_CHECKED(alloc_opt_arrays(&opt));
+
+	for (size_t i = 0; i < opt.n_ir; i++) {
+		if (ir_is(&opt.ir[i].data, &opl_double_reg, FCMP_OPCODE)) {
+			opt.has_fcmp = 1;
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < sizeof(stages) / sizeof(*stages); i++) {
+		// Programs with jumps out of the code are left as is
+		if (prepare_stage(&opt)) {
+			break;
+		}
+
+		_CT_CHECKED(stages[i](&opt));
+	}
+
+	*ir = opt.ir;
+	*n_ir = opt.n_ir;
+
+_CT_EXIT_POINT:
+	return ret;
+}
@@ -6,6 +6,8 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "spu_asm.h"
 #include "spu_bit_ops.h"
@@ -14,134 +16,194 @@
 #include "translator.h"
 #include "pvector.h"
 #include "ctio.h"
+#include "file_map.h"
+#include "spu.h"
+#include "spu_obj.h"
+#include "asm_directives.h"
+#include "asm_cache.h"
+#include "asm_optimizer.h"
 #include "jmp_opl.h"
 
 #ifdef _DEBUG
 #define ASM_DEBUG
 #endif
 
-static inline int is_comment_string(char *arg) {
-	assert (arg);
+enum asm_char_class {
+	ASM_CHAR_TOKEN		= 0,
+	ASM_CHAR_SEPARATOR	= 1,
+	ASM_CHAR_COMMENT	= 2,
+};
+
+// Read by the parser threads, never written
+static const uint8_t asm_char_classes[256] = {
+	[' ']	= ASM_CHAR_SEPARATOR,
+	['\t']	= ASM_CHAR_SEPARATOR,
+	['\r']	= ASM_CHAR_SEPARATOR,
+	['\n']	= ASM_CHAR_SEPARATOR,
+	[';']	= ASM_CHAR_COMMENT,
+	['#']	= ASM_CHAR_COMMENT,
+};
 
-	char *comment_ptr = strpbrk(arg, ";#");
-	if (comment_ptr) {
-		*comment_ptr = '\0';
-		return 1;
-	}
-
-	return 0;
-}
-
-static const char *const argsplit_syms = " \n\t";
-
-static ssize_t tokenize_opcodeline(char *lineptr, char *argsptrs[MAX_INSTR_ARGS]) {
+/**
+ * Splits the line [lineptr, line_end) into tokens.
+ * Tokens point into the line, the source is not modified.
+ *
+ * Returns the number of tokens or S_FAIL.
+ */
+static ssize_t tokenize_opcodeline(struct asm_token args[MAX_INSTR_ARGS],
+				   const char *lineptr, const char *line_end) {
+	assert (args);
 	assert (lineptr);
-	assert (argsptrs);
-
-	char *saveptr = NULL;
+	assert (line_end);
 
 	ssize_t n_args = 0;
-	char *strtok_ptr = lineptr;
-	for (; n_args < MAX_INSTR_ARGS; 
-			strtok_ptr = NULL, n_args++) {
-		char *subtoken = strtok_r(strtok_ptr,
-			    argsplit_syms, &saveptr);
-		if (subtoken == NULL)
-			break;
+	const char *ptr = lineptr;
 
-		argsptrs[n_args] = subtoken;
+	while (ptr != line_end) {
+		uint8_t char_class = asm_char_classes[(uint8_t)*ptr];
 
-		if (is_comment_string(subtoken)) {
-			if (*subtoken != '\0') {
-				n_args++;
-			}
+		if (char_class == ASM_CHAR_SEPARATOR) {
+			ptr++;
+			continue;
+		}
 
+		if (char_class == ASM_CHAR_COMMENT) {
 			break;
 		}
-	}
 
-	if (n_args == MAX_INSTR_ARGS) {
-		return S_FAIL;
+		const char *token_start = ptr;
+		while (ptr != line_end &&
+		       asm_char_classes[(uint8_t)*ptr] == ASM_CHAR_TOKEN) {
+			ptr++;
+		}
+
+		if (n_args == MAX_INSTR_ARGS) {
+			log_error("Too many operands, maximum is %d", MAX_INSTR_ARGS - 1);
+			return S_FAIL;
+		}
+
+		args[n_args++] = (struct asm_token) {
+			.str = token_start,
+			.len = (size_t)(ptr - token_start),
+		};
 	}
 
 	return n_args;
 }
 
-static int lookup_asm_instruction(size_t n_args, char *argsptrs[MAX_INSTR_ARGS],
-				  struct asm_instruction *asm_instr) {
-	assert (argsptrs);
+static int lookup_asm_instruction(struct asm_instruction *asm_instr) {
 	assert (asm_instr);
 
-	asm_instr->n_args	= n_args;
-	memcpy(asm_instr->argsptrs, argsptrs, sizeof(asm_instr->argsptrs));
-
 	if (asm_instr->n_args == 0) {
 		asm_instr->is_empty = 1;
 		return S_OK;
 	}
-	
-	char *cmd = asm_instr->argsptrs[0];
 
+	const struct asm_token *cmd = &asm_instr->args[0];
+	
 	// Some instructions accept arguments divided by function name and point
-	char *point_arg = strchr(cmd, '.');
+	const char *point_arg = (const char *)memchr(cmd->str, '.', cmd->len);
 
 	// If point is placed in start of instruction, it is label declaration
-	if (cmd == point_arg) {
+	if (cmd->str == point_arg) {
 		asm_instr->is_label = 1;
 		return S_OK;
 	}
 
+	size_t cmd_len = cmd->len;
+
 	if (point_arg) {
-		*(point_arg++) = '\0';
+		cmd_len = (size_t)(point_arg - cmd->str);
+		point_arg++;
 
-		if (*point_arg == '\0') {
+		asm_instr->op_arg = (struct asm_token) {
+			.str = point_arg,
+			.len = cmd->len - cmd_len - 1,
+		};
+
+		if (asm_instr->op_arg.len == 0) {
 			return S_FAIL;
 		}
 	}
 
-
-	const struct op_cmd *op_cmd_ptr = find_op_cmd(cmd);
+	const struct op_cmd *op_cmd_ptr = find_op_cmd(cmd->str, cmd_len);
 	if (!op_cmd_ptr) {
 		return S_FAIL;
 	}
 
 	asm_instr->op_cmd = op_cmd_ptr;
-	asm_instr->op_arg = point_arg;
 
 	return S_OK;
 }
 
-static int tokenize_instructions(struct translating_context *ctx,
-				 char *textbuf, size_t textbuf_len) {
+static int parse_instruction(struct asm_instruction *asm_instr) {
+	assert (asm_instr);
+
+	int ret = S_OK;
+
+	struct translating_context *ctx = asm_instr->ctx;
+	struct asm_ir_instr *ir_instr = &ctx->ir[ctx->n_ir];
+
+	ctx->label_ref = ASM_NO_LABEL;
+
+	_CT_CHECKED(asm_instr->op_cmd->layout->parse_asm_fn(asm_instr,
+							&ir_instr->data));
+
+	ir_instr->label_id = ctx->label_ref;
+	ir_instr->nline = (uint32_t)asm_instr->nline;
+
+	ctx->n_ir++;
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+/**
+ * Parses the source part into the IR.
+ * Labels are defined here, jumps to them are resolved later.
+ */
+static int parse_instructions(struct translating_context *ctx,
+			      const char *textbuf, size_t textbuf_len,
+			      size_t first_line, size_t n_lines) {
+	assert (ctx);
+
 	int ret = S_OK;
 
-	PVECTOR_CREATE(lines_arr, sizeof(struct text_line));
-	_CT_FAIL_NONZERO(pvector_read_lines(&lines_arr,
-			  textbuf, textbuf_len));
+	const char *line = textbuf;
+	const char *text_end = textbuf + textbuf_len;
+	size_t nline = first_line;
 
-	_CT_FAIL_NONZERO(pvector_init(&ctx->asm_instr_arr, sizeof(struct asm_instruction)));
-	_CT_FAIL_NONZERO(pvector_set_capacity(&ctx->asm_instr_arr, lines_arr.len + 1));
+	// Each line produces at most one instruction
+	ctx->ir = (struct asm_ir_instr *)arena_alloc(&ctx->arena,
+				sizeof(struct asm_ir_instr) * n_lines);
+	if (!ctx->ir) {
+		_CT_FAIL();
+	}
 
-	for (size_t i = 0; i < lines_arr.len; i++) {
-		struct text_line *line = NULL;
-		_CT_FAIL_NONZERO(pvector_get(
-			&lines_arr, i, (void **)&line));
+	for (; line < text_end; nline++) {
+		const char *line_end = (const char *)memchr(line, '\n',
+						(size_t)(text_end - line));
+		if (!line_end) {
+			line_end = text_end;
+		}
 
-		char *argsptrs[MAX_INSTR_ARGS] = {0};
 		struct asm_instruction asm_instr = {0};
-
 		ssize_t n_args = 0;
 
-		if ((n_args = tokenize_opcodeline(
-			line->line_ptr,
-			argsptrs)) < 0) {
-			log_error("Invalid line #%zu", i + 1);
+		if ((n_args = tokenize_opcodeline(asm_instr.args,
+						  line, line_end)) < 0) {
+			log_error("Invalid line #%zu", nline + 1);
 			_CT_FAIL();
 		}
 
-		if (lookup_asm_instruction((size_t) n_args, 
-				argsptrs, &asm_instr)) {
-			log_error("Invalid line #%zu", i + 1);
+		line = line_end + 1;
+
+		asm_instr.n_args = (size_t)n_args;
+		asm_instr.nline = nline;
+		asm_instr.ctx = ctx;
+
+		if (lookup_asm_instruction(&asm_instr)) {
+			log_error("Invalid line #%zu", nline + 1);
 			_CT_FAIL();
 		}
 
@@ -149,143 +211,1136 @@ static int tokenize_instructions(struct translating_context *ctx,
 			continue;
 		}
 
-		asm_instr.nline = i;
+		if (asm_instr.is_label) {
+			const struct asm_directive *directive =
+				find_asm_directive(&asm_instr.args[0]);
 
-		asm_instr.ctx = ctx;
+			if (directive && directive->fn(&asm_instr)) {
+				log_error("Invalid directive on line #%zu", nline + 1);
+				_CT_FAIL();
+			} else if (!directive) {
+				_CT_CHECKED(process_label(&asm_instr));
+			}
+		} else if (ctx->section != SPU_SECTION_CODE) {
+			log_error("Instruction in the data section on line #%zu",
+				  nline + 1);
+			_CT_FAIL();
+		} else if (parse_instruction(&asm_instr)) {
+			log_error("Invalid line #%zu", nline + 1);
+			_CT_FAIL();
+		}
+	}
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+static int assembly(const struct asm_ir_instr *ir, size_t n_ir,
+		    spu_instruction_t *bin_instr_arr) {
+	assert (ir || n_ir == 0);
+	assert (bin_instr_arr || n_ir == 0);
+
+	int ret = S_OK;
+
+	for (size_t i = 0; i < n_ir; i++) {
+		const struct asm_ir_instr *ir_instr = &ir[i];
+		struct spu_instruction bin_instr = {0};
+
+		if (ir_instr->data.layout->write_bin_fn(&ir_instr->data, &bin_instr)) {
+			log_error("Invalid line #%u", ir_instr->nline + 1);
+			_CT_FAIL();
+		}
+
+#ifdef ASM_DEBUG
+		eprintf("Writing instruction: <0x");
+		buf_dump_hex(&bin_instr, sizeof (bin_instr), stderr);
+		eprintf(">\n");
+#endif /* ASM_DEBUG */
 
-		_CT_FAIL_NONZERO(pvector_push_back(&ctx->asm_instr_arr, &asm_instr));
+		bin_instr_arr[i] = bin_instr.instruction;
 	}
 
 _CT_EXIT_POINT:
-	pvector_destroy(&lines_arr);
+	return ret;
+}
+
+/*
+ * Large sources are split into chunks on line boundaries.
+ * Chunks are parsed in parallel, each one into its own arena with
+ * its own label table. Then the label tables are merged into the
+ * program-wide one, and chunks resolve jumps and encode instructions
+ * into their parts of the output buffer in parallel.
+ */
+
+// Sources smaller than this are assembled on a single thread
+#define ASM_MIN_CHUNK_LEN (1 << 20)
+#define ASM_MAX_THREADS (64)
+
+struct asm_program {
+	struct arena arena;
+	struct label_table labels;
+
+	spu_instruction_t *bin_instr_arr;
+	size_t n_instructions;
+
+	spu_data_t *data;
+	size_t n_data;
+
+	// Deduplicated pool of wide constants
+	spu_data_t *consts;
+	size_t n_consts;
+
+	// Leave undefined labels and addresses to the linker
+	int relocatable;
+};
+
+struct asm_chunk {
+	struct translating_context ctx;
+	struct asm_program *program;
+
+	const char *text;
+	size_t text_len;
+
+	size_t n_lines;
+	size_t first_line;
+
+	// Section selected by the last section directive of the chunk
+	int last_section;
+
+	// Indexes of the first chunk instruction and data word in the program
+	size_t base;
+	size_t data_base;
+	// Index of the first chunk constant before the pool is deduplicated
+	size_t const_base;
+
+	// Of type spu_obj_reloc
+	struct pvector relocs;
+
+	int status;
+};
+
+typedef int (*asm_chunk_fn)(struct asm_chunk *chunk);
+
+struct asm_chunk_job {
+	struct asm_chunk *chunk;
+	asm_chunk_fn fn;
+};
+
+static void *asm_chunk_thread(void *arg) {
+	struct asm_chunk_job *job = (struct asm_chunk_job *)arg;
+
+	job->chunk->status = job->fn(job->chunk);
+
+	return NULL;
+}
+
+/**
+ * Runs fn for every chunk, each one on its own thread.
+ */
+static int run_chunks(struct asm_chunk *chunks, size_t n_chunks, asm_chunk_fn fn) {
+	assert (chunks);
+	assert (fn);
+
+	int ret = S_OK;
+
+	pthread_t threads[ASM_MAX_THREADS] = {0};
+	struct asm_chunk_job jobs[ASM_MAX_THREADS] = {{0}};
+	size_t n_started = 0;
+
+	assert (n_chunks <= ASM_MAX_THREADS);
+
+	// The first chunk is processed on the calling thread
+	for (size_t i = 1; i < n_chunks; i++, n_started++) {
+		jobs[i] = (struct asm_chunk_job) {
+			.chunk = &chunks[i],
+			.fn = fn,
+		};
+
+		if (pthread_create(&threads[i], NULL, asm_chunk_thread, &jobs[i])) {
+			log_error("Unable to start the assembler thread");
+			ret = S_FAIL;
+			break;
+		}
+	}
+
+	if (ret == S_OK) {
+		chunks[0].status = fn(&chunks[0]);
+	}
+
+	for (size_t i = 1; i <= n_started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	for (size_t i = 0; i < n_chunks && ret == S_OK; i++) {
+		if (chunks[i].status) {
+			ret = S_FAIL;
+		}
+	}
 
 	return ret;
 }
 
+/**
+ * Returns the section selected by the line if it is a section directive.
+ */
+static int line_section_directive(const char *line, const char *line_end) {
+	assert (line);
+	assert (line_end);
 
-static int assemble_instruction(struct asm_instruction *asm_instr) {
-	assert (asm_instr);
+	while (line != line_end &&
+	       asm_char_classes[(uint8_t)*line] == ASM_CHAR_SEPARATOR) {
+		line++;
+	}
+
+	// Only directives and labels start with the point
+	if (line == line_end || *line != '.') {
+		return SPU_SECTION_UNDEF;
+	}
+
+	struct asm_token directive = {
+		.str = line,
+		.len = 0,
+	};
+
+	while (line != line_end &&
+	       asm_char_classes[(uint8_t)*line] == ASM_CHAR_TOKEN) {
+		line++;
+	}
+	directive.len = (size_t)(line - directive.str);
+
+	return asm_section_directive(&directive);
+}
 
-	struct spu_instruction bin_instr = {0};
+/**
+ * Counts lines of the chunk and finds the section where it ends,
+ * so the next chunk knows where it starts.
+ */
+static int scan_chunk(struct asm_chunk *chunk) {
+	assert (chunk);
+
+	const char *line = chunk->text;
+	const char *text_end = chunk->text + chunk->text_len;
+
+	chunk->n_lines = 1;
+	chunk->last_section = SPU_SECTION_UNDEF;
+
+	while (line < text_end) {
+		const char *line_end = (const char *)memchr(line, '\n',
+						(size_t)(text_end - line));
+
+		int section = line_section_directive(line,
+						line_end ? line_end : text_end);
+		if (section != SPU_SECTION_UNDEF) {
+			chunk->last_section = section;
+		}
+
+		if (!line_end) {
+			break;
+		}
+
+		line = line_end + 1;
+		chunk->n_lines++;
+	}
+
+	return S_OK;
+}
+
+static int parse_chunk(struct asm_chunk *chunk) {
+	assert (chunk);
+
+	return parse_instructions(&chunk->ctx, chunk->text, chunk->text_len,
+				  chunk->first_line, chunk->n_lines);
+}
+
+/**
+ * Tells if the number of the instruction is an index in the constant pool:
+ * ldk takes the constant from there, long jumps take the offset.
+ */
+static int ir_uses_pool(const struct asm_ir_instr *ir_instr) {
+	assert (ir_instr);
+
+	if (ir_instr->data.layout == &opl_ldc) {
+		return ir_instr->data.opcode == LDK_OPCODE;
+	}
+
+	return ir_instr->data.layout == &opl_jmp &&
+	       (ir_instr->data.opcode == JMPL_OPCODE ||
+		ir_instr->data.opcode == CALLL_OPCODE);
+}
+
+/**
+ * Stores addresses of the code labels to the jump tables of the chunk,
+ * the relocatable program gets relocations for them instead.
+ */
+static int resolve_data_refs(struct asm_chunk *chunk) {
+	assert (chunk);
 
 	int ret = S_OK;
+	struct translating_context *ctx = &chunk->ctx;
+	struct asm_program *program = chunk->program;
+	struct asm_data_ref *refs = NULL;
 
-	const struct op_cmd *op_cmd = asm_instr->op_cmd;
+	if (ctx->data_refs.len == 0) {
+		return S_OK;
+	}
 
-	struct spu_instr_data instr_data = {0};
+	_CT_FAIL_NONZERO(pvector_get(&ctx->data_refs, 0, (void **)&refs));
 
-	_CT_CHECKED(op_cmd->layout->parse_asm_fn(asm_instr, &instr_data));
-	_CT_CHECKED(op_cmd->layout->write_bin_fn(&instr_data, &bin_instr));
+	for (size_t i = 0; i < ctx->data_refs.len; i++) {
+		const struct label_instance *label = &program->labels.labels[refs[i].label_id];
+		size_t offset = chunk->data_base + refs[i].offset;
 
-#ifdef ASM_DEBUG
-	eprintf("Writing instruction: <0x");
-	buf_dump_hex(&bin_instr, sizeof (bin_instr), stderr);
-	eprintf(">\n");
-#endif /* ASM_DEBUG */
+		if (label->instruction_ptr != -1 && label->section != SPU_SECTION_CODE) {
+			log_error("Jump table entry %.*s is not a code label",
+				  (int)label->len, label->name);
+			_CT_FAIL();
+		}
+
+		if (program->relocatable) {
+			struct spu_obj_reloc reloc = {
+				.offset = (uint32_t)offset,
+				.symbol = refs[i].label_id,
+				.type = SPU_RELOC_DATA,
+				.addend = 0,
+			};
+
+			_CT_FAIL_NONZERO(pvector_push_back(&chunk->relocs, &reloc));
+			continue;
+		}
+
+		if (label->instruction_ptr == -1) {
+			log_error("Undefined label %.*s in the jump table",
+				  (int)label->len, label->name);
+			_CT_FAIL();
+		}
 
-	_CT_FAIL_NONZERO(pvector_push_back(
-		&asm_instr->ctx->bin_instr_arr, &bin_instr));
+		program->data[offset] = (spu_data_t)label->instruction_ptr;
+	}
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+static int encode_chunk(struct asm_chunk *chunk) {
+	assert (chunk);
+
+	int ret = S_OK;
+	struct translating_context *ctx = &chunk->ctx;
+	struct asm_program *program = chunk->program;
+
+	_CT_CHECKED(resolve_label_refs(ctx->ir, ctx->n_ir, chunk->base,
+			&program->labels,
+			program->relocatable ? &chunk->relocs : NULL));
+
+	_CT_CHECKED(assembly(ctx->ir, ctx->n_ir,
+			     program->bin_instr_arr + chunk->base));
+
+	for (size_t i = 0; program->relocatable && i < ctx->n_ir; i++) {
+		if (!ir_uses_pool(&ctx->ir[i])) {
+			continue;
+		}
+
+		struct spu_obj_reloc reloc = {
+			.offset = (uint32_t)(chunk->base + i),
+			.symbol = 0,
+			.type = SPU_RELOC_CONST,
+			.addend = ctx->ir[i].data.snum,
+		};
 
-	asm_instr->ctx->n_instruction++;
+		_CT_FAIL_NONZERO(pvector_push_back(&chunk->relocs, &reloc));
+	}
+
+	_CT_CHECKED(resolve_data_refs(chunk));
 
 _CT_EXIT_POINT:
 	return ret;
 }
 
-static int assembly(struct translating_context *ctx) {
-	assert (ctx);
+/**
+ * Moves chunk labels into the program label table and
+ * rewrites chunk label ids to the program ones.
+ */
+static int merge_chunk_labels(struct asm_program *program, struct asm_chunk *chunk) {
+	assert (program);
+	assert (chunk);
 
 	int ret = S_OK;
+	struct translating_context *ctx = &chunk->ctx;
+	uint32_t *label_map = NULL;
+
+	if (ctx->labels.n_labels == 0) {
+		return S_OK;
+	}
+
+	label_map = (uint32_t *)arena_alloc(&ctx->arena,
+				sizeof(uint32_t) * ctx->labels.n_labels);
+	if (!label_map) {
+		_CT_FAIL();
+	}
 
-	for (size_t i = 0; i < ctx->asm_instr_arr.len; i++) {
-		struct asm_instruction *asm_instr = NULL;
-		_CT_FAIL_NONZERO(pvector_get(&ctx->asm_instr_arr,
-			  i, (void **)&asm_instr));
+	for (uint32_t id = 0; id < ctx->labels.n_labels; id++) {
+		const struct label_instance *label = &ctx->labels.labels[id];
+		uint32_t program_id = 0;
 
-		if (asm_instr->is_label) {
-			_CT_CHECKED(process_label(asm_instr));
-		} else {
-			if (assemble_instruction(asm_instr)) {
-				log_error("Invalid line #%zu", asm_instr->nline + 1);
+		_CT_CHECKED(intern_label(&program->labels, &program->arena,
+				label->name, label->len, &program_id));
+
+		struct label_instance *program_label =
+			&program->labels.labels[program_id];
+
+		program_label->flags |= label->flags;
+
+		if (label->instruction_ptr != -1) {
+			if (program_label->instruction_ptr != -1) {
+				log_error("Label %.*s is already used",
+					  (int)label->len, label->name);
 				_CT_FAIL();
 			}
+
+			size_t section_base = (label->section == SPU_SECTION_DATA) ?
+						chunk->data_base : chunk->base;
+
+			program_label->instruction_ptr = (ssize_t)section_base +
+							 label->instruction_ptr;
+			program_label->section = label->section;
 		}
+
+		label_map[id] = program_id;
+	}
+
+	for (size_t i = 0; i < ctx->n_ir; i++) {
+		if (ctx->ir[i].label_id != ASM_NO_LABEL) {
+			ctx->ir[i].label_id = label_map[ctx->ir[i].label_id];
+		}
+	}
+
+	for (size_t i = 0; i < ctx->data_refs.len; i++) {
+		struct asm_data_ref *ref = NULL;
+
+		_CT_FAIL_NONZERO(pvector_get(&ctx->data_refs, i, (void **)&ref));
+		ref->label_id = label_map[ref->label_id];
 	}
 
 _CT_EXIT_POINT:
 	return ret;
 }
 
-static int parse_text(const char *in_filename, FILE *out_stream) {
-	assert (in_filename);
+static int merge_chunk_data(struct asm_program *program, struct asm_chunk *chunk) {
+	assert (program);
+	assert (chunk);
+
+	spu_data_t *chunk_data = NULL;
+
+	if (chunk->ctx.data.len == 0) {
+		return S_OK;
+	}
+
+	if (pvector_get(&chunk->ctx.data, 0, (void **)&chunk_data)) {
+		return S_FAIL;
+	}
+
+	memcpy(program->data + chunk->data_base, chunk_data,
+	       sizeof(spu_data_t) * chunk->ctx.data.len);
+
+	return S_OK;
+}
+
+struct pool_entry {
+	int64_t value;
+	uint32_t raw_index;
+};
+
+static int pool_entry_cmp(const void *lhs, const void *rhs) {
+	const struct pool_entry *lentry = (const struct pool_entry *)lhs;
+	const struct pool_entry *rentry = (const struct pool_entry *)rhs;
+
+	if (lentry->value != rentry->value) {
+		return (lentry->value < rentry->value) ? -1 : 1;
+	}
+
+	return (lentry->raw_index < rentry->raw_index) ? -1 : 1;
+}
+
+/**
+ * Concatenates the chunk pools, removes duplicate constants and
+ * rewrites pool indexes of the instructions to the program ones.
+ */
+static int merge_consts(struct asm_program *program,
+			struct asm_chunk *chunks, size_t n_chunks) {
+	assert (program);
+	assert (chunks);
+
+	size_t n_raw = 0;
+	struct pool_entry *entries = NULL;
+	uint32_t *pool_map = NULL;
+
+	for (size_t i = 0; i < n_chunks; i++) {
+		chunks[i].const_base = n_raw;
+		n_raw += chunks[i].ctx.consts.len;
+	}
+
+	program->n_consts = 0;
+	if (n_raw == 0) {
+		return S_OK;
+	}
+
+	entries = (struct pool_entry *)arena_alloc(&program->arena,
+				sizeof(struct pool_entry) * n_raw);
+	pool_map = (uint32_t *)arena_alloc(&program->arena,
+				sizeof(uint32_t) * n_raw);
+	program->consts = (spu_data_t *)arena_alloc(&program->arena,
+				sizeof(spu_data_t) * n_raw);
+	if (!entries || !pool_map || !program->consts) {
+		return S_FAIL;
+	}
+
+	for (size_t i = 0; i < n_chunks; i++) {
+		for (size_t j = 0; j < chunks[i].ctx.consts.len; j++) {
+			spu_data_t *value = NULL;
+
+			if (pvector_get(&chunks[i].ctx.consts, j, (void **)&value)) {
+				return S_FAIL;
+			}
+
+			entries[chunks[i].const_base + j] = (struct pool_entry) {
+				.value = *value,
+				.raw_index = (uint32_t)(chunks[i].const_base + j),
+			};
+		}
+	}
+
+	qsort(entries, n_raw, sizeof(struct pool_entry), pool_entry_cmp);
+
+	for (size_t i = 0; i < n_raw; i++) {
+		if (i == 0 || entries[i].value != entries[i - 1].value) {
+			program->consts[program->n_consts++] = entries[i].value;
+		}
+
+		pool_map[entries[i].raw_index] = (uint32_t)(program->n_consts - 1);
+	}
+
+	if (program->n_consts > (1 << (LDC_INTEGER_BLEN - 1))) {
+		log_error("Too many wide constants");
+		return S_FAIL;
+	}
+
+	for (size_t i = 0; i < n_chunks; i++) {
+		struct translating_context *ctx = &chunks[i].ctx;
+
+		for (size_t j = 0; j < ctx->n_ir; j++) {
+			if (ir_uses_pool(&ctx->ir[j])) {
+				size_t raw_index = chunks[i].const_base +
+						   (size_t)ctx->ir[j].data.snum;
+
+				ctx->ir[j].data.snum = (int32_t)pool_map[raw_index];
+			}
+		}
+	}
+
+	return S_OK;
+}
+
+/**
+ * Finds the jump offset or the address of the label that does not fit
+ * into the instruction. Returns 0 if the value is short or is not resolved
+ * by the translator: addresses in relocatable programs are left
+ * for the linker.
+ *
+ * Jumps without labels are wide only when the optimizer has moved
+ * the long ones.
+ */
+static int wide_label_value(const struct asm_program *program,
+			    const struct asm_ir_instr *ir_instr, size_t instr_ptr,
+			    int64_t *value) {
+	assert (program);
+	assert (ir_instr);
+	assert (value);
+
+	int is_jmp = ir_instr->data.layout == &opl_jmp &&
+		     (ir_instr->data.opcode == JMP_OPCODE ||
+		      ir_instr->data.opcode == CALL_OPCODE);
+
+	if (ir_instr->label_id == ASM_NO_LABEL) {
+		*value = ir_instr->data.jmp_position;
+
+		return is_jmp && (*value < JMP_POSITION_MIN || *value > JMP_POSITION_MAX);
+	}
+
+	const struct label_instance *label = &program->labels.labels[ir_instr->label_id];
+
+	if (label->instruction_ptr == -1) {
+		return 0;
+	}
+
+	if (is_jmp && label->section == SPU_SECTION_CODE) {
+		*value = (int64_t)label->instruction_ptr - (int64_t)instr_ptr - 1;
+
+		return *value < JMP_POSITION_MIN || *value > JMP_POSITION_MAX;
+	}
+
+	if (	ir_instr->data.layout == &opl_ldc &&
+		ir_instr->data.opcode == LDC_OPCODE &&
+		!program->relocatable) {
+		*value = (int64_t)label->instruction_ptr;
+
+		return *value > LDC_INTEGER_MAX;
+	}
+
+	return 0;
+}
+
+/**
+ * Turns jumps and calls to the labels out of the instruction range into
+ * the long ones, and ldc of the label addresses out of the ldc range
+ * into ldk. Runs when the code is final, the values are appended
+ * to the constant pool.
+ */
+static int relax_wide_labels(struct asm_program *program,
+			     struct asm_chunk *chunks, size_t n_chunks) {
+	assert (program);
+	assert (chunks);
+
+	size_t n_wide = 0;
+	int64_t value = 0;
+	spu_data_t *consts = NULL;
+
+	for (size_t i = 0; i < n_chunks; i++) {
+		for (size_t j = 0; j < chunks[i].ctx.n_ir; j++) {
+			n_wide += (size_t)wide_label_value(program, &chunks[i].ctx.ir[j],
+							   chunks[i].base + j, &value);
+		}
+	}
+
+	if (n_wide == 0) {
+		return S_OK;
+	}
+
+	if (program->n_consts + n_wide > (1 << (LDC_INTEGER_BLEN - 1))) {
+		log_error("Too many wide constants, long jumps and far addresses");
+		return S_FAIL;
+	}
+
+	consts = (spu_data_t *)arena_alloc(&program->arena,
+				sizeof(spu_data_t) * (program->n_consts + n_wide));
+	if (!consts) {
+		return S_FAIL;
+	}
+
+	if (program->n_consts) {
+		memcpy(consts, program->consts, sizeof(spu_data_t) * program->n_consts);
+	}
+	program->consts = consts;
+
+	for (size_t i = 0; i < n_chunks; i++) {
+		for (size_t j = 0; j < chunks[i].ctx.n_ir; j++) {
+			struct asm_ir_instr *ir_instr = &chunks[i].ctx.ir[j];
+
+			if (!wide_label_value(program, ir_instr, chunks[i].base + j, &value)) {
+				continue;
+			}
+
+			switch (ir_instr->data.opcode) {
+				case JMP_OPCODE:	ir_instr->data.opcode = JMPL_OPCODE;	break;
+				case CALL_OPCODE:	ir_instr->data.opcode = CALLL_OPCODE;	break;
+				default:		ir_instr->data.opcode = LDK_OPCODE;	break;
+			}
+
+			ir_instr->data.snum = (int32_t)program->n_consts;
+			ir_instr->label_id = ASM_NO_LABEL;
+
+			program->consts[program->n_consts++] = value;
+		}
+	}
+
+	return S_OK;
+}
+
+/**
+ * Writes the object to out_stream and stores it into the cache
+ * if it is being filled. Cache failures do not fail the translation.
+ */
+static int write_program(struct asm_program *program,
+			 struct asm_chunk *chunks, size_t n_chunks,
+			 FILE *out_stream, struct asm_cache *cache) {
+	assert (program);
+	assert (chunks);
 	assert (out_stream);
+	assert (cache);
 
 	int ret = S_OK;
+	struct spu_obj obj = {{0}};
+	size_t n_relocs = 0;
+	struct spu_obj_reloc *relocs = NULL;
+	struct spu_obj_symbol *symbols = NULL;
+
+	for (size_t i = 0; i < n_chunks; i++) {
+		n_relocs += chunks[i].relocs.len;
+	}
+
+	relocs = (struct spu_obj_reloc *)arena_alloc(&program->arena,
+				sizeof(struct spu_obj_reloc) * n_relocs);
+	symbols = (struct spu_obj_symbol *)arena_calloc(&program->arena,
+				program->labels.n_labels, sizeof(struct spu_obj_symbol));
+	if (!relocs || !symbols) {
+		_CT_FAIL();
+	}
+
+	n_relocs = 0;
+	for (size_t i = 0; i < n_chunks; i++) {
+		struct spu_obj_reloc *chunk_relocs = NULL;
+
+		if (chunks[i].relocs.len == 0) {
+			continue;
+		}
+
+		_CT_FAIL_NONZERO(pvector_get(&chunks[i].relocs, 0, (void **)&chunk_relocs));
+		memcpy(relocs + n_relocs, chunk_relocs,
+		       sizeof(struct spu_obj_reloc) * chunks[i].relocs.len);
+		n_relocs += chunks[i].relocs.len;
+	}
 
-	char *textbuf = NULL;
-	size_t textbuf_len = 0;
+	// Symbol ids are the label ids
+	for (uint32_t id = 0; id < program->labels.n_labels; id++) {
+		const struct label_instance *label = &program->labels.labels[id];
+		struct spu_obj_symbol *symbol = &symbols[id];
 
-	struct translating_context ctx = {
-		.asm_instr_arr = {0},
-		.bin_instr_arr = {0},
+		memcpy(symbol->name, label->name, label->len);
+		symbol->flags = label->flags &
+				(uint8_t)~(ASM_LABEL_INLINE | ASM_LABEL_JTABLE);
 
-		.n_instruction = 0,
+		if (label->instruction_ptr == -1) {
+			symbol->section = SPU_SECTION_UNDEF;
+			symbol->flags |= SPU_SYMBOL_GLOBAL;
+		} else {
+			symbol->section = label->section;
+			symbol->value = (uint64_t)label->instruction_ptr;
+		}
+	}
 
-		.out_stream = out_stream,
-		.labels_table = {0},
-		.second_compilation = 0,
+	obj = (struct spu_obj) {
+		.header = {
+			.magic = SPU_OBJ_MAGIC,
+			.version = SPU_OBJ_VERSION,
+			.n_code = (uint32_t)program->n_instructions,
+			.n_data = (uint32_t)program->n_data,
+			.n_symbols = program->labels.n_labels,
+			.n_relocs = (uint32_t)n_relocs,
+			.n_consts = (uint32_t)program->n_consts,
+			.reserved = 0,
+		},
+		.code = program->bin_instr_arr,
+		.data = program->data,
+		.consts = program->consts,
+		.symbols = symbols,
+		.relocs = relocs,
+		.buf = NULL,
 	};
 
-	_CT_CHECKED(read_file(in_filename, &textbuf, &textbuf_len));
+	_CT_CHECKED(spu_obj_write(&obj, out_stream));
 
-	_CT_CHECKED(tokenize_instructions(&ctx,
-			textbuf, textbuf_len));
-	
-	_CT_FAIL_NONZERO(pvector_init(&ctx.labels_table,
-			  sizeof(struct label_instance)));
+	if (cache->tmp_stream) {
+		if (spu_obj_write(&obj, cache->tmp_stream)) {
+			asm_cache_store_abort(cache);
+		} else {
+			asm_cache_store_commit(cache);
+		}
+	}
+
+_CT_EXIT_POINT:
+	return ret;
+}
+
+/**
+ * Checks that the profile was taken from the program built without -O.
+ */
+static int profile_matches(const struct spu_profile *profile,
+			   const struct asm_ir_instr *ir, size_t n_ir) {
+	assert (profile);
+	assert (ir || n_ir == 0);
+
+	uint64_t hash = SPU_PROFILE_HASH_INIT;
+
+	if (profile->n_code != n_ir) {
+		return 0;
+	}
+
+	for (size_t i = 0; i < n_ir; i++) {
+		hash = spu_profile_hash_opcode(hash, ir[i].data.opcode,
+					       ir[i].data.layout->is_directive);
+	}
+
+	return hash == profile->code_hash;
+}
+
+/**
+ * Optimizes the whole program at once. Its IR is gathered
+ * into the first chunk, so it is encoded on a single thread.
+ */
+static int optimize_program(struct asm_program *program,
+			    struct asm_chunk *chunks, size_t n_chunks,
+			    const struct spu_profile *profile) {
+	assert (program);
+	assert (chunks);
+	assert (profile);
+
+	struct asm_ir_instr *ir = (struct asm_ir_instr *)arena_alloc(&program->arena,
+				sizeof(struct asm_ir_instr) * program->n_instructions);
+	if (!ir) {
+		return S_FAIL;
+	}
+
+	for (size_t i = 0; i < n_chunks; i++) {
+		memcpy(ir + chunks[i].base, chunks[i].ctx.ir,
+		       sizeof(struct asm_ir_instr) * chunks[i].ctx.n_ir);
+	}
+
+	for (size_t i = 0; i < program->n_instructions; i++) {
+		ir[i].prof_id = (uint32_t)i;
+	}
+
+	if (profile->counts && !profile_matches(profile, ir, program->n_instructions)) {
+		log_error("The profile is not of this program, ignoring it");
+		profile = NULL;
+	} else if (!profile->counts) {
+		profile = NULL;
+	}
+
+	if (asm_optimize(&program->arena, &ir, &program->n_instructions,
+			 &program->labels, program->consts, program->n_consts, profile)) {
+		return S_FAIL;
+	}
+
+	for (size_t i = 0; i < n_chunks; i++) {
+		chunks[i].base = program->n_instructions;
+		chunks[i].ctx.n_ir = 0;
+	}
+
+	chunks[0].base = 0;
+	chunks[0].ctx.ir = ir;
+	chunks[0].ctx.n_ir = program->n_instructions;
+
+	return S_OK;
+}
+
+static size_t split_chunks(struct asm_chunk *chunks, size_t n_threads,
+			   const char *textbuf, size_t textbuf_len) {
+	assert (chunks);
+	assert (n_threads > 0 && n_threads <= ASM_MAX_THREADS);
+
+	const char *text_end = textbuf + textbuf_len;
+	size_t chunk_len = textbuf_len / n_threads + 1;
+	size_t n_chunks = 0;
+
+	do {
+		const char *chunk_end = text_end;
+
+		if ((size_t)(text_end - textbuf) > chunk_len) {
+			chunk_end = (const char *)memchr(textbuf + chunk_len, '\n',
+					(size_t)(text_end - textbuf) - chunk_len);
+			chunk_end = chunk_end ? chunk_end + 1 : text_end;
+		}
+
+		chunks[n_chunks].text = textbuf;
+		chunks[n_chunks].text_len = (size_t)(chunk_end - textbuf);
+		n_chunks++;
+
+		textbuf = chunk_end;
+	} while (textbuf < text_end && n_chunks < n_threads);
+
+	// Rounding may leave a tail for the last chunk
+	chunks[n_chunks - 1].text_len = (size_t)(text_end - chunks[n_chunks - 1].text);
+
+	return n_chunks;
+}
+
+static size_t choose_n_threads(size_t textbuf_len, long requested) {
+	long n_threads = requested;
+
+	if (n_threads <= 0) {
+		n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+		if ((size_t)n_threads > textbuf_len / ASM_MIN_CHUNK_LEN) {
+			n_threads = (long)(textbuf_len / ASM_MIN_CHUNK_LEN);
+		}
+	}
+
+	if (n_threads < 1) {
+		n_threads = 1;
+	} else if (n_threads > ASM_MAX_THREADS) {
+		n_threads = ASM_MAX_THREADS;
+	}
+
+	return (size_t)n_threads;
+}
+
+struct asm_options {
+	long n_threads;
+	int relocatable;
+
+	// Directory of the object cache, NULL if caching is off
+	const char *cache_dir;
+
+	int optimize;
+
+	// Profile of the program built without -O, used by -O
+	const char *profile_filename;
+};
+
+static uint64_t asm_cache_salt(const struct asm_options *options,
+			       const struct spu_profile *profile) {
+	assert (options);
+	assert (profile);
+
+	uint64_t salt = (uint64_t)ASM_CACHE_VERSION |
+			(uint64_t)SPU_OBJ_VERSION << 16 |
+			(uint64_t)(options->relocatable != 0) << 32 |
+			(uint64_t)(options->optimize != 0) << 33;
+
+	// Objects of the translator with other instructions are not reused
+	for (const struct op_cmd *op_cmd = op_table; op_cmd->cmd_name; op_cmd++) {
+		salt ^= (uint64_t)op_cmd->opcode |
+			(uint64_t)op_cmd->layout->is_directive << 32;
+		salt = asm_cache_hash(op_cmd->cmd_name, strlen(op_cmd->cmd_name), salt);
+	}
+
+	if (profile->counts) {
+		salt = asm_cache_hash((const char *)profile->counts,
+				sizeof(uint64_t) * profile->n_code, salt);
+		salt = asm_cache_hash((const char *)profile->taken,
+				sizeof(uint64_t) * profile->n_code, salt);
+	}
+
+	return salt;
+}
+
+static int parse_text(const char *in_filename, FILE *out_stream,
+		      const struct asm_options *options) {
+	assert (in_filename);
+	assert (out_stream);
+	assert (options);
+
+	int ret = S_OK;
+
+	struct file_map text_map = {0};
+	struct asm_chunk *chunks = NULL;
+	size_t n_chunks = 0;
+	struct asm_cache cache = {0};
+	struct spu_profile profile = {0};
+
+	struct asm_program program = {
+		.arena = {0},
+		.labels = {0},
+		.bin_instr_arr = NULL,
+		.n_instructions = 0,
+		.data = NULL,
+		.n_data = 0,
+		.consts = NULL,
+		.n_consts = 0,
+		.relocatable = options->relocatable,
+	};
+
+	_CT_CHECKED(arena_init(&program.arena, 0));
+
+	chunks = (struct asm_chunk *)arena_calloc(&program.arena,
+				ASM_MAX_THREADS, sizeof(struct asm_chunk));
+	if (!chunks) {
+		_CT_FAIL();
+	}
+
+	_CT_CHECKED(file_map_open(&text_map, in_filename));
+
+	if (options->profile_filename) {
+		_CT_CHECKED(spu_profile_read(&profile, options->profile_filename));
+	}
 
-	_CT_FAIL_NONZERO(pvector_init(&ctx.bin_instr_arr,
-			  sizeof(spu_instruction_t)));
-	     
-	_CT_CHECKED(assembly(&ctx));
+	if (options->cache_dir) {
+		int hit = 0;
 
-	ctx.second_compilation = 1;
-	_CT_FAIL_NONZERO(pvector_empty(&ctx.bin_instr_arr));
-	ctx.n_instruction = 0;
-	_CT_CHECKED(assembly(&ctx));
+		_CT_CHECKED(asm_cache_init(&cache, options->cache_dir,
+				asm_cache_hash(text_map.data, text_map.len,
+					       asm_cache_salt(options, &profile))));
 
-	for (size_t i = 0; i < ctx.bin_instr_arr.len; i++) {
-		spu_instruction_t *bin_instr = NULL;
-		_CT_FAIL_NONZERO(pvector_get(
-			&ctx.bin_instr_arr, i, (void **)&bin_instr));
-		fwrite(bin_instr, sizeof(*bin_instr), 1, out_stream);
+		_CT_CHECKED(asm_cache_fetch(&cache, out_stream, &hit));
+		if (hit) {
+			goto _CT_EXIT_POINT;
+		}
+
+		// Without the entry stream the source is just assembled
+		asm_cache_store_begin(&cache);
+	}
+
+	n_chunks = split_chunks(chunks,
+			choose_n_threads(text_map.len, options->n_threads),
+			text_map.data, text_map.len);
+
+	for (size_t i = 0; i < n_chunks; i++) {
+		chunks[i].program = &program;
+		chunks[i].ctx.label_ref = ASM_NO_LABEL;
+		chunks[i].ctx.section = SPU_SECTION_CODE;
+		_CT_CHECKED(arena_init(&chunks[i].ctx.arena, 0));
+		_CT_FAIL_NONZERO(pvector_init(&chunks[i].ctx.data, sizeof(spu_data_t)));
+		_CT_FAIL_NONZERO(pvector_init(&chunks[i].ctx.consts, sizeof(spu_data_t)));
+		_CT_FAIL_NONZERO(pvector_init(&chunks[i].ctx.data_refs,
+					sizeof(struct asm_data_ref)));
+		_CT_FAIL_NONZERO(pvector_init(&chunks[i].relocs,
+					sizeof(struct spu_obj_reloc)));
+	}
+
+	_CT_CHECKED(run_chunks(chunks, n_chunks, scan_chunk));
+
+	for (size_t i = 1; i < n_chunks; i++) {
+		// Every chunk except the last one ends with a newline
+		chunks[i].first_line = chunks[i - 1].first_line +
+				       chunks[i - 1].n_lines - 1;
+
+		chunks[i].ctx.section = chunks[i - 1].ctx.section;
+		if (chunks[i - 1].last_section != SPU_SECTION_UNDEF) {
+			chunks[i].ctx.section = chunks[i - 1].last_section;
+		}
 	}
 
+	_CT_CHECKED(run_chunks(chunks, n_chunks, parse_chunk));
+
+	for (size_t i = 0; i < n_chunks; i++) {
+		chunks[i].base = program.n_instructions;
+		chunks[i].data_base = program.n_data;
+		program.n_instructions += chunks[i].ctx.n_ir;
+		program.n_data += chunks[i].ctx.data.len;
+
+		_CT_CHECKED(merge_chunk_labels(&program, &chunks[i]));
+	}
+
+	_CT_CHECKED(merge_consts(&program, chunks, n_chunks));
+
+	if (options->optimize) {
+		_CT_CHECKED(optimize_program(&program, chunks, n_chunks, &profile));
+	}
+
+	_CT_CHECKED(relax_wide_labels(&program, chunks, n_chunks));
+
+	if (program.n_data > RAM_SIZE) {
+		log_error("The data section does not fit into the SPU RAM");
+		_CT_FAIL();
+	}
+
+	program.bin_instr_arr = (spu_instruction_t *)arena_alloc(&program.arena,
+				sizeof(spu_instruction_t) * program.n_instructions);
+	program.data = (spu_data_t *)arena_alloc(&program.arena,
+				sizeof(spu_data_t) * program.n_data);
+	if (!program.bin_instr_arr || !program.data) {
+		_CT_FAIL();
+	}
+
+	for (size_t i = 0; i < n_chunks; i++) {
+		_CT_CHECKED(merge_chunk_data(&program, &chunks[i]));
+	}
+
+	_CT_CHECKED(run_chunks(chunks, n_chunks, encode_chunk));
+
+	_CT_CHECKED(write_program(&program, chunks, n_chunks, out_stream, &cache));
+
 _CT_EXIT_POINT:
-	pvector_destroy(&ctx.bin_instr_arr);
-	pvector_destroy(&ctx.labels_table);
-	pvector_destroy(&ctx.asm_instr_arr);
-	free(textbuf);
+	for (size_t i = 0; i < n_chunks; i++) {
+		pvector_destroy(&chunks[i].relocs);
+		pvector_destroy(&chunks[i].ctx.data);
+		pvector_destroy(&chunks[i].ctx.consts);
+		pvector_destroy(&chunks[i].ctx.data_refs);
+		arena_destroy(&chunks[i].ctx.arena);
+	}
+	arena_destroy(&program.arena);
+	asm_cache_destroy(&cache);
+	spu_profile_destroy(&profile);
+	file_map_close(&text_map);
 
 	return ret;
 }
 
+static void print_usage(const char *progname) {
+	eprintf("Usage: %s [-cO] [-j threads] [-C cache_dir] [-P profile] [-o out.o] [file.asm]\n"
+		"\t-c\tmake a relocatable object for spu-ld\n"
+		"\t-j\tnumber of assembler threads, by default one\n"
+		"\t\tper MiB of the source up to the number of CPUs\n"
+		"\t-O\toptimize the program\n"
+		"\t-P\toptimize using the profile written by spu -p\n"
+		"\t\tfor the program built without -O\n"
+		"\t-C\treuse objects of unchanged sources from cache_dir\n",
+		progname);
+}
 
-int main(int argc, const char *argv[]) {
+int main(int argc, char *argv[]) {
 	const char *asm_filename = "example.asm";
+	const char *out_filename = NULL;
+	FILE *out_stream = stdout;
+	int opt = 0;
+	int ret = EXIT_SUCCESS;
+
+	struct asm_options options = {
+		.n_threads = 0,
+		.relocatable = 0,
+		.cache_dir = NULL,
+		.optimize = 0,
+		.profile_filename = NULL,
+	};
 
-	if (argc < 2) {
-	} else if (argc == 2) {
-		asm_filename = argv[1];
-	} else {
+	while ((opt = getopt(argc, argv, "cj:C:OP:o:")) != -1) {
+		switch (opt) {
+			case 'c':
+				options.relocatable = 1;
+				break;
+			case 'C':
+				options.cache_dir = optarg;
+				break;
+			case 'O':
+				options.optimize = 1;
+				break;
+			case 'P':
+				options.profile_filename = optarg;
+				options.optimize = 1;
+				break;
+			case 'j': {
+				char *end = NULL;
+
+				options.n_threads = strtol(optarg, &end, 10);
+				if (end == optarg || *end != '\0' || options.n_threads <= 0) {
+					print_usage(argv[0]);
+					return EXIT_FAILURE;
+				}
+				break;
+			}
+			case 'o':
+				out_filename = optarg;
+				break;
+			default:
+				print_usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (optind == argc - 1) {
+		asm_filename = argv[optind];
+	} else if (optind != argc) {
 		log_error("Invalid args");
+		print_usage(argv[0]);
 		return EXIT_FAILURE;
 	}
 
-	if (parse_text(asm_filename, stdout)) {
-		log_error("Error while parsing asm");
+	if (out_filename && !(out_stream = fopen(out_filename, "wb"))) {
+		log_error("Unable to open %s", out_filename);
 		return EXIT_FAILURE;
 	}
 
-	return EXIT_SUCCESS;
+	if (parse_text(asm_filename, out_stream, &options)) {
+		log_error("Error while parsing asm");
+		ret = EXIT_FAILURE;
+	}
+
+	if (out_filename && fclose(out_stream)) {
+		ret = EXIT_FAILURE;
+	}
+
+	if (ret && out_filename) {
+		remove(out_filename);
+	}
+
+	return ret;
 }
@@ -0,0 +1,112 @@
+#include "test_config.h"
+
+#include "spu.h"
+
+static int64_t test_binary(struct spu_context *ctx, uint32_t opcode,
+			   uint64_t lhs, uint64_t rhs) {
+	struct spu_instr_data instr = {
+		.opcode = opcode, .rdest = 3, .rsrc1 = 1, .rsrc2 = 2,
+	};
+
+	ctx->registers[1] = (int64_t)lhs;
+	ctx->registers[2] = (int64_t)rhs;
+
+	if (arithm_binary_exec(ctx, instr)) {
+		return -1;
+	}
+
+	return ctx->registers[3];
+}
+
+static int64_t test_unary(struct spu_context *ctx, uint32_t opcode, uint64_t value) {
+	struct spu_instr_data instr = {.opcode = opcode, .rdest = 3, .rsrc1 = 1};
+
+	ctx->registers[1] = (int64_t)value;
+
+	if (arithm_unary_exec(ctx, instr)) {
+		return -1;
+	}
+
+	return ctx->registers[3];
+}
+
+static int test_bitfield(struct spu_context *ctx, uint32_t opcode,
+			 uint8_t pos, uint32_t len) {
+	struct spu_instr_data instr = {
+		.opcode = opcode, .rdest = 3, .rsrc1 = 1, .shift = pos, .unum = len,
+	};
+
+	return bitfield_exec(ctx, instr);
+}
+
+TEST(TestArithm, TestShifts) {
+	struct spu_context ctx = {{0}};
+
+	ASSERT_EQ(test_binary(&ctx, SHL_OPCODE, 5, 0), (int64_t)5);
+	ASSERT_EQ(test_binary(&ctx, SHL_OPCODE, 1, 63), INT64_MIN);
+	// The count is taken modulo 64
+	ASSERT_EQ(test_binary(&ctx, SHL_OPCODE, 5, 64), (int64_t)5);
+	ASSERT_EQ(test_binary(&ctx, SHL_OPCODE, 5, 65), (int64_t)10);
+	ASSERT_EQ(test_binary(&ctx, SHL_OPCODE, 5, (uint64_t)-1), INT64_MIN);
+
+	// Logical, the sign is not extended
+	ASSERT_EQ(test_binary(&ctx, SHR_OPCODE, (uint64_t)INT64_MIN, 63), (int64_t)1);
+	ASSERT_EQ(test_binary(&ctx, SHR_OPCODE, (uint64_t)-1, 0), (int64_t)-1);
+	ASSERT_EQ(test_binary(&ctx, SHR_OPCODE, 8, 67), (int64_t)1);
+}
+
+TEST(TestArithm, TestRotates) {
+	struct spu_context ctx = {{0}};
+	uint64_t value = 0x8000000000000001ULL;
+
+	ASSERT_EQ(test_binary(&ctx, ROL_OPCODE, value, 0), (int64_t)value);
+	ASSERT_EQ(test_binary(&ctx, ROR_OPCODE, value, 0), (int64_t)value);
+	ASSERT_EQ(test_binary(&ctx, ROL_OPCODE, value, 4), (int64_t)0x18);
+	ASSERT_EQ(test_binary(&ctx, ROR_OPCODE, value, 4), (int64_t)0x1800000000000000LL);
+	ASSERT_EQ(test_binary(&ctx, ROL_OPCODE, value, 64), (int64_t)value);
+	ASSERT_EQ(test_binary(&ctx, ROR_OPCODE, value, 68), (int64_t)0x1800000000000000LL);
+	ASSERT_EQ(test_binary(&ctx, ROL_OPCODE, value, 63), (int64_t)0xC000000000000000ULL);
+}
+
+TEST(TestArithm, TestBitCounts) {
+	struct spu_context ctx = {{0}};
+
+	// Defined for zero unlike the builtins
+	ASSERT_EQ(test_unary(&ctx, CLZ_OPCODE, 0), (int64_t)64);
+	ASSERT_EQ(test_unary(&ctx, CTZ_OPCODE, 0), (int64_t)64);
+	ASSERT_EQ(test_unary(&ctx, CLZ_OPCODE, 1), (int64_t)63);
+	ASSERT_EQ(test_unary(&ctx, CTZ_OPCODE, 1), (int64_t)0);
+	ASSERT_EQ(test_unary(&ctx, CLZ_OPCODE, (uint64_t)INT64_MIN), (int64_t)0);
+	ASSERT_EQ(test_unary(&ctx, CTZ_OPCODE, (uint64_t)INT64_MIN), (int64_t)63);
+	ASSERT_EQ(test_unary(&ctx, POPCNT_OPCODE, (uint64_t)-1), (int64_t)64);
+	ASSERT_EQ(test_unary(&ctx, BSWAP_OPCODE, 0x0102030405060708ULL),
+		  (int64_t)0x0807060504030201LL);
+}
+
+TEST(TestArithm, TestBitfields) {
+	struct spu_context ctx = {{0}};
+
+	ctx.registers[1] = (int64_t)0xA5C3000000000F0FULL;
+
+	// The field up to the last bit
+	ASSERT_EQ(test_bitfield(&ctx, BFX_OPCODE, 56, 8), (int)S_OK);
+	ASSERT_EQ(ctx.registers[3], (int64_t)0xA5);
+	ASSERT_EQ(test_bitfield(&ctx, BFX_OPCODE, 0, 64), (int)S_OK);
+	ASSERT_EQ(ctx.registers[1], ctx.registers[3]);
+	ASSERT_EQ(test_bitfield(&ctx, BFX_OPCODE, 4, 8), (int)S_OK);
+	ASSERT_EQ(ctx.registers[3], (int64_t)0xF0);
+
+	ctx.registers[1] = 0x1FF;
+	ctx.registers[3] = 0;
+	ASSERT_EQ(test_bitfield(&ctx, BFI_OPCODE, 60, 4), (int)S_OK);
+	ASSERT_EQ(ctx.registers[3], (int64_t)0xF000000000000000ULL);
+	ASSERT_EQ(test_bitfield(&ctx, BFI_OPCODE, 0, 8), (int)S_OK);
+	ASSERT_EQ(ctx.registers[3], (int64_t)0xF0000000000000FFULL);
+
+	// Does not fit in the register
+	ctx.registers[3] = 7;
+	ASSERT_EQ(test_bitfield(&ctx, BFX_OPCODE, 60, 5), (int)S_FAIL);
+	ASSERT_EQ(test_bitfield(&ctx, BFI_OPCODE, 1, 64), (int)S_FAIL);
+	ASSERT_EQ(test_bitfield(&ctx, BFX_OPCODE, 0, 0), (int)S_FAIL);
+	ASSERT_EQ(ctx.registers[3], (int64_t)7);
+}
@@ -0,0 +1,92 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_config.h"
+
+#include "spu.h"
+
+static spu_data_t test_double_reg(double num) {
+	spu_data_t value = 0;
+
+	memcpy(&value, &num, sizeof(value));
+
+	return value;
+}
+
+static int64_t test_set(struct spu_context *ctx, uint32_t condition) {
+	struct spu_instr_data instr = {
+		.opcode = SET_OPCODE, .rdest = 3, .condition = condition,
+	};
+
+	if (cond_exec(ctx, instr)) {
+		return -1;
+	}
+
+	return ctx->registers[3];
+}
+
+TEST(TestFloat, TestCompareNaN) {
+	struct spu_instr_data fcmp = {.opcode = FCMP_OPCODE, .rdest = 1, .rsrc1 = 2};
+
+	SPUCreate(ctx);
+
+	ctx.registers[1] = test_double_reg(NAN);
+	ctx.registers[2] = test_double_reg(0.0);
+	ASSERT_EQ(float_exec(&ctx, fcmp), (int)S_OK);
+
+	// Unordered, not greater than zero
+	ASSERT_EQ(test_set(&ctx, EQUALS_JMP), (int64_t)0);
+	ASSERT_EQ(test_set(&ctx, NOT_EQUALS_JMP), (int64_t)1);
+	ASSERT_EQ(test_set(&ctx, GREATER_EQUALS_JMP), (int64_t)0);
+	ASSERT_EQ(test_set(&ctx, GREATER_JMP), (int64_t)0);
+	ASSERT_EQ(test_set(&ctx, LESS_EQUALS_JMP), (int64_t)0);
+	ASSERT_EQ(test_set(&ctx, LESS_JMP), (int64_t)0);
+
+	ctx.registers[1] = test_double_reg(1.5);
+	ASSERT_EQ(float_exec(&ctx, fcmp), (int)S_OK);
+
+	ASSERT_EQ(test_set(&ctx, GREATER_JMP), (int64_t)1);
+	ASSERT_EQ(test_set(&ctx, GREATER_EQUALS_JMP), (int64_t)1);
+	ASSERT_EQ(test_set(&ctx, LESS_EQUALS_JMP), (int64_t)0);
+	ASSERT_EQ(test_set(&ctx, NOT_EQUALS_JMP), (int64_t)1);
+
+	SPUDtor(&ctx);
+}
+
+TEST(TestFloat, TestPrintReadBack) {
+	static const double nums[] = {0.1, 1.0 / 3, -2.2250738585072014e-308, 1e300};
+	FILE *text = tmpfile();
+	FILE *out_stream = tmpfile();
+
+	ASSERT_EQ(text != NULL && out_stream != NULL, 1);
+
+	SPUCreate(ctx);
+
+	// print and read through the files instead of the terminal
+	ASSERT_EQ(spu_io_destroy(&ctx.io), (int)S_OK);
+	ASSERT_EQ(spu_io_init(&ctx.io, stdin, text), (int)S_OK);
+
+	for (size_t i = 0; i < sizeof(nums) / sizeof(*nums); i++) {
+		ctx.registers[1] = test_double_reg(nums[i]);
+		ASSERT_EQ(float_exec(&ctx, (struct spu_instr_data) {
+					.opcode = FPRINT_OPCODE, .rdest = 1,
+				}), (int)S_OK);
+	}
+
+	ASSERT_EQ(spu_io_destroy(&ctx.io), (int)S_OK);
+	rewind(text);
+	ASSERT_EQ(spu_io_init(&ctx.io, text, out_stream), (int)S_OK);
+
+	for (size_t i = 0; i < sizeof(nums) / sizeof(*nums); i++) {
+		ASSERT_EQ(float_exec(&ctx, (struct spu_instr_data) {
+					.opcode = FINPUT_OPCODE, .rdest = 2,
+				}), (int)S_OK);
+		ASSERT_EQ(ctx.registers[2], test_double_reg(nums[i]));
+	}
+
+	SPUDtor(&ctx);
+
+	fclose(text);
+	fclose(out_stream);
+}
@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test_config.h"
+
+#include "spu_io.h"
+
+TEST(TestIO, TestReadPrintInt) {
+	struct spu_io io = {0};
+	FILE *in_stream = tmpfile();
+	FILE *out_stream = tmpfile();
+	char output[128] = {0};
+	int64_t num = 0;
+
+	ASSERT_EQ(in_stream != NULL && out_stream != NULL, 1);
+
+	fputs("  42\n-9223372036854775808 +7 9223372036854775808 x", in_stream);
+	rewind(in_stream);
+
+	ASSERT_EQ(spu_io_init(&io, in_stream, out_stream), (int)S_OK);
+
+	ASSERT_EQ(spu_io_read_int(&io, &num), (int)S_OK);
+	ASSERT_EQ(num, (int64_t)42);
+	ASSERT_EQ(spu_io_print_int(&io, num), (int)S_OK);
+
+	ASSERT_EQ(spu_io_read_int(&io, &num), (int)S_OK);
+	ASSERT_EQ(num, INT64_MIN);
+	ASSERT_EQ(spu_io_print_int(&io, num), (int)S_OK);
+
+	ASSERT_EQ(spu_io_read_int(&io, &num), (int)S_OK);
+	ASSERT_EQ(num, (int64_t)7);
+	ASSERT_EQ(spu_io_print_int(&io, 0), (int)S_OK);
+
+	// Does not fit, then is not a number
+	ASSERT_EQ(spu_io_read_int(&io, &num), (int)S_FAIL);
+
+	ASSERT_EQ(spu_io_destroy(&io), (int)S_OK);
+
+	rewind(out_stream);
+	ASSERT_EQ(fread(output, 1, sizeof(output) - 1, out_stream),
+		  strlen("42\n-9223372036854775808\n0\n"));
+	ASSERT_EQ(strcmp(output, "42\n-9223372036854775808\n0\n"), 0);
+
+	fclose(in_stream);
+	fclose(out_stream);
+}
+
+TEST(TestIO, TestReadStdinStream) {
+	struct spu_io io = {0};
+	FILE *in_stream = tmpfile();
+	FILE *out_stream = tmpfile();
+	char buf[16] = {0};
+	size_t n_read = 0;
+	int64_t num = 0;
+
+	ASSERT_EQ(in_stream != NULL && out_stream != NULL, 1);
+
+	fputs("12 abcdef", in_stream);
+	rewind(in_stream);
+
+	ASSERT_EQ(spu_io_init(&io, in_stream, out_stream), (int)S_OK);
+
+	// The number reads ahead the whole input, the stream goes on after it
+	ASSERT_EQ(spu_io_read_int(&io, &num), (int)S_OK);
+	ASSERT_EQ(num, (int64_t)12);
+
+	ASSERT_EQ(spu_io_read_stream(&io, STDIN_FILENO, buf, 4, &n_read), (int)S_OK);
+	ASSERT_EQ(n_read, (size_t)4);
+	ASSERT_EQ(memcmp(buf, " abc", 4), 0);
+
+	// Short at the end of the input
+	ASSERT_EQ(spu_io_read_stream(&io, STDIN_FILENO, buf, sizeof(buf), &n_read),
+		  (int)S_OK);
+	ASSERT_EQ(n_read, (size_t)3);
+	ASSERT_EQ(memcmp(buf, "def", 3), 0);
+
+	ASSERT_EQ(spu_io_read_stream(&io, STDIN_FILENO, buf, sizeof(buf), &n_read),
+		  (int)S_OK);
+	ASSERT_EQ(n_read, (size_t)0);
+
+	ASSERT_EQ(spu_io_destroy(&io), (int)S_OK);
+
+	fclose(in_stream);
+	fclose(out_stream);
+}
+
+TEST(TestIO, TestFileStreams) {
+	struct spu_io io = {0};
+	FILE *in_stream = tmpfile();
+	FILE *out_stream = tmpfile();
+	char path[] = "/tmp/spu_io_XXXXXX";
+	char buf[16] = {0};
+	size_t out_file = 0;
+	size_t in_file = 0;
+	size_t n_read = 0;
+	int fd = mkstemp(path);
+
+	ASSERT_EQ(in_stream != NULL && out_stream != NULL, 1);
+	ASSERT_EQ(fd != -1, 1);
+	close(fd);
+
+	ASSERT_EQ(spu_io_init(&io, in_stream, out_stream), (int)S_OK);
+
+	ASSERT_EQ(spu_io_open(&io, path, SPU_STREAM_WRITE, &out_file), (int)S_OK);
+	ASSERT_EQ(out_file, (size_t)(STDERR_FILENO + 1));
+	ASSERT_EQ(spu_io_write_stream(&io, out_file, "hello", 5), (int)S_OK);
+
+	// Wrong mode and streams that are not open
+	ASSERT_EQ(spu_io_read_stream(&io, out_file, buf, 1, &n_read), (int)S_FAIL);
+	ASSERT_EQ(spu_io_read_stream(&io, STDOUT_FILENO, buf, 1, &n_read), (int)S_FAIL);
+	ASSERT_EQ(spu_io_write_stream(&io, STDIN_FILENO, "x", 1), (int)S_FAIL);
+	ASSERT_EQ(spu_io_write_stream(&io, out_file + 1, "x", 1), (int)S_FAIL);
+	ASSERT_EQ(spu_io_open(&io, path, SPU_STREAM_CLOSED, &in_file), (int)S_FAIL);
+
+	ASSERT_EQ(spu_io_open(&io, path, SPU_STREAM_READ, &in_file), (int)S_OK);
+	ASSERT_EQ(in_file, out_file + 1);
+	ASSERT_EQ(spu_io_write_stream(&io, in_file, "x", 1), (int)S_FAIL);
+
+	ASSERT_EQ(spu_io_read_stream(&io, in_file, buf, sizeof(buf), &n_read), (int)S_OK);
+	ASSERT_EQ(n_read, (size_t)5);
+	ASSERT_EQ(memcmp(buf, "hello", 5), 0);
+
+	// Shares the buffer with print, the order is kept
+	ASSERT_EQ(spu_io_print_int(&io, 1), (int)S_OK);
+	ASSERT_EQ(spu_io_write_stream(&io, STDOUT_FILENO, "ab", 2), (int)S_OK);
+	ASSERT_EQ(spu_io_print_int(&io, 2), (int)S_OK);
+
+	ASSERT_EQ(spu_io_destroy(&io), (int)S_OK);
+	unlink(path);
+
+	memset(buf, 0, sizeof(buf));
+	rewind(out_stream);
+	ASSERT_EQ(fread(buf, 1, sizeof(buf) - 1, out_stream), strlen("1\nab2\n"));
+	ASSERT_EQ(strcmp(buf, "1\nab2\n"), 0);
+
+	fclose(in_stream);
+	fclose(out_stream);
+}
@@ -0,0 +1,40 @@
+#include "test_config.h"
+
+#include "spu.h"
+
+TEST(TestJmp, TestIndirectTarget) {
+	struct spu_instr_data jmpr = {.opcode = JMPR_OPCODE, .rdest = 1};
+	struct spu_instr_data callr = {.opcode = CALLR_OPCODE, .rdest = 1};
+
+	SPUCreate(ctx);
+
+	ctx.instr_bufsize = 4;
+	ctx.ip = 2;
+
+	ctx.registers[1] = 4;
+	ASSERT_EQ(jmpr_exec(&ctx, jmpr), (int)S_FAIL);
+	ctx.registers[1] = -1;
+	ASSERT_EQ(jmpr_exec(&ctx, jmpr), (int)S_FAIL);
+	ASSERT_EQ(jmpr_exec(&ctx, callr), (int)S_FAIL);
+	ASSERT_EQ(ctx.ip, (size_t)2);
+	ASSERT_EQ(ctx.call_stack.len, (size_t)0);
+
+	ctx.registers[1] = 3;
+	ASSERT_EQ(jmpr_exec(&ctx, jmpr), (int)S_OK);
+	ASSERT_EQ(ctx.ip, (size_t)3);
+
+	// Returns after the callr
+	ctx.registers[1] = 0;
+	ASSERT_EQ(jmpr_exec(&ctx, callr), (int)S_OK);
+	ASSERT_EQ(ctx.ip, (size_t)0);
+	ASSERT_EQ(ctx.call_stack.len, (size_t)1);
+
+	while (ctx.call_stack.len < RET_STACK_MAX_SIZE) {
+		ASSERT_EQ(jmpr_exec(&ctx, callr), (int)S_OK);
+	}
+
+	ASSERT_EQ(jmpr_exec(&ctx, callr), (int)S_FAIL);
+	ASSERT_EQ(ctx.call_stack.len, (size_t)RET_STACK_MAX_SIZE);
+
+	SPUDtor(&ctx);
+}
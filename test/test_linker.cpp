@@ -0,0 +1,337 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test_config.h"
+
+#include "spu.h"
+#include "spu_ld.h"
+#include "spu_obj.h"
+
+#define TEST_OBJ_PATH "/tmp/spu_ld_XXXXXX"
+
+static spu_instruction_t test_encode(const struct op_layout *layout, uint32_t opcode,
+				     spu_register_num_t rdest, spu_register_num_t rsrc1,
+				     int32_t snum) {
+	struct spu_instr_data instr_data = {
+		.opcode = opcode,
+		.layout = layout,
+		.rdest = rdest,
+		.rsrc1 = rsrc1,
+		.snum = snum,
+	};
+	struct spu_instruction bin_instr = {0};
+
+	if (layout->write_bin_fn(&instr_data, &bin_instr)) {
+		return 0;
+	}
+
+	return bin_instr.instruction;
+}
+
+static struct spu_obj_symbol test_symbol(const char *name, uint32_t section,
+					 uint32_t flags, uint64_t value) {
+	struct spu_obj_symbol symbol = {
+		.name = {0},
+		.section = section,
+		.flags = flags,
+		.value = value,
+	};
+
+	strncpy(symbol.name, name, sizeof(symbol.name) - 1);
+
+	return symbol;
+}
+
+static int test_write_object(char *path, const struct spu_obj *obj) {
+	int fd = mkstemp(path);
+	FILE *out_stream = (fd == -1) ? NULL : fdopen(fd, "wb");
+
+	if (!out_stream) {
+		return S_FAIL;
+	}
+
+	if (spu_obj_write(obj, out_stream)) {
+		fclose(out_stream);
+		return S_FAIL;
+	}
+
+	return fclose(out_stream) ? S_FAIL : S_OK;
+}
+
+/**
+ * Links the objects and runs the program until halt.
+ */
+static int test_link_run(struct spu_context *ctx, const char *const *paths, size_t n_paths) {
+	char path[] = TEST_OBJ_PATH;
+	int fd = mkstemp(path);
+	FILE *out_stream = (fd == -1) ? NULL : fdopen(fd, "wb");
+	int ret = S_OK;
+
+	if (!out_stream) {
+		return S_FAIL;
+	}
+
+	ret = spu_ld_link(paths, n_paths, out_stream);
+
+	if (fclose(out_stream)) {
+		ret = S_FAIL;
+	}
+
+	if (ret == S_OK) {
+		ret = SPULoadBinary(ctx, path);
+	}
+
+	if (ret == S_OK) {
+		ret = SPUExecute(ctx);
+	}
+
+	unlink(path);
+
+	return ret;
+}
+
+TEST(TestLinker, TestJumpTable) {
+	char a_path[] = TEST_OBJ_PATH;
+	char b_path[] = TEST_OBJ_PATH;
+	const char *paths[] = {a_path, b_path};
+
+	// .jtable .handler .local, the first one is in the other object
+	spu_data_t a_data[2] = {0};
+	spu_instruction_t a_code[] = {
+		test_encode(&opl_ldc, LDC_OPCODE, 1, 0, 0),
+		test_encode(&opl_double_reg, LDM_OPCODE, 1, 2, 0),
+		test_encode(&opl_single_reg, CALLR_OPCODE, 2, 0, 0),
+		test_encode(&opl_noarg, HALT_OPCODE, 0, 0, 0),
+		// .local:
+		test_encode(&opl_ldc, LDC_OPCODE, 4, 0, 9),
+		test_encode(&opl_noarg, RET_OPCODE, 0, 0, 0),
+	};
+	struct spu_obj_symbol a_symbols[] = {
+		test_symbol(".handler", SPU_SECTION_UNDEF, SPU_SYMBOL_GLOBAL, 0),
+		test_symbol(".local", SPU_SECTION_CODE, 0, 4),
+	};
+	struct spu_obj_reloc a_relocs[] = {
+		{.offset = 0, .symbol = 0, .type = SPU_RELOC_DATA, .addend = 0},
+		{.offset = 1, .symbol = 1, .type = SPU_RELOC_DATA, .addend = 0},
+	};
+	struct spu_obj a_obj = {
+		.header = {
+			.n_code = 6, .n_data = 2, .n_symbols = 2, .n_relocs = 2,
+		},
+		.code = a_code,
+		.data = a_data,
+		.symbols = a_symbols,
+		.relocs = a_relocs,
+	};
+
+	spu_data_t b_data[] = {77};
+	spu_instruction_t b_code[] = {
+		test_encode(&opl_noarg, HALT_OPCODE, 0, 0, 0),
+		// .handler: calls the second entry of the table
+		test_encode(&opl_ldc, LDC_OPCODE, 3, 0, 42),
+		test_encode(&opl_ldc, LDC_OPCODE, 1, 0, 1),
+		test_encode(&opl_double_reg, LDM_OPCODE, 1, 2, 0),
+		test_encode(&opl_single_reg, CALLR_OPCODE, 2, 0, 0),
+		test_encode(&opl_noarg, RET_OPCODE, 0, 0, 0),
+	};
+	struct spu_obj_symbol b_symbols[] = {
+		test_symbol(".handler", SPU_SECTION_CODE, SPU_SYMBOL_GLOBAL, 1),
+	};
+	struct spu_obj b_obj = {
+		.header = {.n_code = 6, .n_data = 1, .n_symbols = 1},
+		.code = b_code,
+		.data = b_data,
+		.symbols = b_symbols,
+	};
+
+	ASSERT_EQ(test_write_object(a_path, &a_obj), (int)S_OK);
+	ASSERT_EQ(test_write_object(b_path, &b_obj), (int)S_OK);
+
+	SPUCreate(ctx);
+
+	ASSERT_EQ(test_link_run(&ctx, paths, 2), (int)S_OK);
+
+	// The entries are the absolute positions in the linked code
+	ASSERT_EQ(ctx.ram[0], (int64_t)(6 + 1));
+	ASSERT_EQ(ctx.ram[1], (int64_t)4);
+	ASSERT_EQ(ctx.ram[2], (int64_t)77);
+	ASSERT_EQ(ctx.registers[3], (int64_t)42);
+	ASSERT_EQ(ctx.registers[4], (int64_t)9);
+
+	SPUDtor(&ctx);
+
+	// The entry of a data symbol is refused
+	struct spu_obj_symbol data_symbol = test_symbol(".table", SPU_SECTION_DATA, 0, 0);
+	a_obj.symbols = &data_symbol;
+	a_obj.header.n_symbols = 1;
+	a_obj.header.n_relocs = 1;
+	a_relocs[0].symbol = 0;
+
+	unlink(a_path);
+	strcpy(a_path, TEST_OBJ_PATH);
+	ASSERT_EQ(test_write_object(a_path, &a_obj), (int)S_OK);
+
+	FILE *null_stream = tmpfile();
+	ASSERT_EQ(null_stream != NULL, 1);
+	ASSERT_EQ(spu_ld_link(paths, 1, null_stream), (int)S_FAIL);
+	fclose(null_stream);
+
+	unlink(a_path);
+	unlink(b_path);
+}
+
+TEST(TestLinker, TestConstPools) {
+	char a_path[] = TEST_OBJ_PATH;
+	char b_path[] = TEST_OBJ_PATH;
+	const char *paths[] = {a_path, b_path};
+
+	spu_data_t a_consts[] = {0x123456789abcdef0LL};
+	spu_instruction_t a_code[] = {
+		test_encode(&opl_ldc, LDK_OPCODE, 1, 0, 0),
+		test_encode(&opl_jmp, CALL_OPCODE, UNCONDITIONAL_JMP, 0, 0),
+		test_encode(&opl_noarg, HALT_OPCODE, 0, 0, 0),
+	};
+	struct spu_obj_symbol a_symbols[] = {
+		test_symbol(".fn", SPU_SECTION_UNDEF, SPU_SYMBOL_GLOBAL, 0),
+	};
+	struct spu_obj_reloc a_relocs[] = {
+		{.offset = 0, .symbol = 0, .type = SPU_RELOC_CONST, .addend = 0},
+		{.offset = 1, .symbol = 0, .type = SPU_RELOC_PCREL, .addend = 0},
+	};
+	struct spu_obj a_obj = {
+		.header = {
+			.n_code = 3, .n_symbols = 1, .n_relocs = 2, .n_consts = 1,
+		},
+		.code = a_code,
+		.consts = a_consts,
+		.symbols = a_symbols,
+		.relocs = a_relocs,
+	};
+
+	// The indexes are in the pool of the object, rebased by the linker
+	spu_data_t b_consts[] = {-7, INT64_MIN};
+	spu_instruction_t b_code[] = {
+		test_encode(&opl_ldc, LDK_OPCODE, 2, 0, 0),
+		test_encode(&opl_ldc, LDK_OPCODE, 3, 0, 0),
+		test_encode(&opl_noarg, RET_OPCODE, 0, 0, 0),
+	};
+	struct spu_obj_symbol b_symbols[] = {
+		test_symbol(".fn", SPU_SECTION_CODE, SPU_SYMBOL_GLOBAL, 0),
+	};
+	struct spu_obj_reloc b_relocs[] = {
+		{.offset = 0, .symbol = 0, .type = SPU_RELOC_CONST, .addend = 1},
+		{.offset = 1, .symbol = 0, .type = SPU_RELOC_CONST, .addend = 0},
+	};
+	struct spu_obj b_obj = {
+		.header = {
+			.n_code = 3, .n_symbols = 1, .n_relocs = 2, .n_consts = 2,
+		},
+		.code = b_code,
+		.consts = b_consts,
+		.symbols = b_symbols,
+		.relocs = b_relocs,
+	};
+
+	ASSERT_EQ(test_write_object(a_path, &a_obj), (int)S_OK);
+	ASSERT_EQ(test_write_object(b_path, &b_obj), (int)S_OK);
+
+	SPUCreate(ctx);
+
+	ASSERT_EQ(test_link_run(&ctx, paths, 2), (int)S_OK);
+	unlink(a_path);
+	unlink(b_path);
+
+	ASSERT_EQ(ctx.n_consts, (size_t)3);
+	ASSERT_EQ(ctx.registers[1], (int64_t)0x123456789abcdef0LL);
+	ASSERT_EQ(ctx.registers[2], INT64_MIN);
+	ASSERT_EQ(ctx.registers[3], (int64_t)-7);
+
+	SPUDtor(&ctx);
+}
+
+TEST(TestLinker, TestFarJumps) {
+	char a_path[] = TEST_OBJ_PATH;
+	char b_path[] = TEST_OBJ_PATH;
+	const char *paths[] = {a_path, b_path};
+	// Further than the offset of jmp reaches
+	const uint32_t b_n_code = (1 << (JMP_INTEGER_BLEN - 1)) + 8;
+
+	spu_data_t a_consts[] = {5};
+	spu_instruction_t a_code[] = {
+		test_encode(&opl_ldc, LDK_OPCODE, 1, 0, 0),
+		test_encode(&opl_jmp, JMP_OPCODE, UNCONDITIONAL_JMP, 0, 0),
+		// .done:
+		test_encode(&opl_noarg, HALT_OPCODE, 0, 0, 0),
+	};
+	struct spu_obj_symbol a_symbols[] = {
+		test_symbol(".far", SPU_SECTION_UNDEF, SPU_SYMBOL_GLOBAL, 0),
+		test_symbol(".done", SPU_SECTION_CODE, SPU_SYMBOL_GLOBAL, 2),
+	};
+	struct spu_obj_reloc a_relocs[] = {
+		{.offset = 0, .symbol = 0, .type = SPU_RELOC_CONST, .addend = 0},
+		{.offset = 1, .symbol = 0, .type = SPU_RELOC_PCREL, .addend = 0},
+	};
+	struct spu_obj a_obj = {
+		.header = {
+			.n_code = 3, .n_symbols = 2, .n_relocs = 2, .n_consts = 1,
+		},
+		.code = a_code,
+		.consts = a_consts,
+		.symbols = a_symbols,
+		.relocs = a_relocs,
+	};
+
+	spu_data_t b_consts[] = {11};
+	spu_instruction_t *b_code = (spu_instruction_t *)calloc(b_n_code,
+								sizeof(spu_instruction_t));
+	struct spu_obj_symbol b_symbols[] = {
+		test_symbol(".far", SPU_SECTION_CODE, SPU_SYMBOL_GLOBAL, b_n_code - 2),
+		test_symbol(".done", SPU_SECTION_UNDEF, SPU_SYMBOL_GLOBAL, 0),
+	};
+	struct spu_obj_reloc b_relocs[] = {
+		{.offset = b_n_code - 2, .symbol = 0, .type = SPU_RELOC_CONST, .addend = 0},
+		{.offset = b_n_code - 1, .symbol = 1, .type = SPU_RELOC_PCREL, .addend = 0},
+	};
+	struct spu_obj b_obj = {
+		.header = {
+			.n_code = b_n_code, .n_symbols = 2, .n_relocs = 2, .n_consts = 1,
+		},
+		.code = b_code,
+		.consts = b_consts,
+		.symbols = b_symbols,
+		.relocs = b_relocs,
+	};
+
+	ASSERT_EQ(b_code != NULL, 1);
+
+	for (uint32_t i = 0; i < b_n_code - 2; i++) {
+		b_code[i] = test_encode(&opl_noarg, HALT_OPCODE, 0, 0, 0);
+	}
+	// .far:
+	b_code[b_n_code - 2] = test_encode(&opl_ldc, LDK_OPCODE, 2, 0, 0);
+	b_code[b_n_code - 1] = test_encode(&opl_jmp, JMP_OPCODE, UNCONDITIONAL_JMP, 0, 0);
+
+	ASSERT_EQ(test_write_object(a_path, &a_obj), (int)S_OK);
+	ASSERT_EQ(test_write_object(b_path, &b_obj), (int)S_OK);
+	free(b_code);
+
+	SPUCreate(ctx);
+
+	ASSERT_EQ(test_link_run(&ctx, paths, 2), (int)S_OK);
+	unlink(a_path);
+	unlink(b_path);
+
+	// Both jumps take the offsets from the pool, after the constants
+	struct spu_instruction forward = {.instruction = ctx.instr_buf[1]};
+	struct spu_instruction backward = {.instruction = ctx.instr_buf[3 + b_n_code - 1]};
+
+	ASSERT_EQ(forward.opcode.code, (unsigned)JMPL_OPCODE);
+	ASSERT_EQ(backward.opcode.code, (unsigned)JMPL_OPCODE);
+	ASSERT_EQ(ctx.n_consts, (size_t)4);
+	ASSERT_EQ(ctx.registers[1], (int64_t)5);
+	ASSERT_EQ(ctx.registers[2], (int64_t)11);
+	ASSERT_EQ(ctx.ip, (size_t)3);
+
+	SPUDtor(&ctx);
+}
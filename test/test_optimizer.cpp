@@ -0,0 +1,273 @@
+#include <string.h>
+
+#include "test_config.h"
+
+#include "asm_optimizer.h"
+#include "jmp_opl.h"
+#include "spu_obj.h"
+
+#define TEST_MAX_IR (64)
+
+struct test_program {
+	struct arena arena;
+	struct label_table labels;
+	struct asm_ir_instr *ir;
+	size_t n_ir;
+};
+
+static int test_program_init(struct test_program *prog) {
+	memset(prog, 0, sizeof(*prog));
+
+	if (arena_init(&prog->arena, ARENA_DEFAULT_BLOCK_SIZE)) {
+		return S_FAIL;
+	}
+
+	prog->ir = (struct asm_ir_instr *)arena_calloc(&prog->arena, TEST_MAX_IR,
+						       sizeof(struct asm_ir_instr));
+
+	return prog->ir ? S_OK : S_FAIL;
+}
+
+static uint32_t test_label(struct test_program *prog, const char *name,
+			   int section, ssize_t instruction_ptr) {
+	uint32_t label_id = ASM_NO_LABEL;
+
+	if (intern_label(&prog->labels, &prog->arena, name, strlen(name), &label_id)) {
+		return ASM_NO_LABEL;
+	}
+
+	prog->labels.labels[label_id].section = (uint8_t)section;
+	prog->labels.labels[label_id].instruction_ptr = instruction_ptr;
+
+	return label_id;
+}
+
+static void test_emit(struct test_program *prog, const struct op_layout *layout,
+		      uint32_t opcode, spu_register_num_t rdest, int32_t snum,
+		      uint32_t label_id) {
+	prog->ir[prog->n_ir] = (struct asm_ir_instr) {
+		.data = {
+			.opcode = opcode,
+			.layout = layout,
+			.rdest = rdest,
+			.snum = snum,
+		},
+		.label_id = label_id,
+		.nline = (uint32_t)prog->n_ir,
+		.prof_id = (uint32_t)prog->n_ir,
+	};
+	prog->n_ir++;
+}
+
+TEST(TestOptimizer, TestInlineKeepsLabelAddress) {
+	struct test_program prog = {{0}};
+
+	ASSERT_EQ(test_program_init(&prog), (int)S_OK);
+
+	uint32_t fn = test_label(&prog, ".fn", SPU_SECTION_CODE, 3);
+	uint32_t table = test_label(&prog, ".table", SPU_SECTION_DATA, 7);
+
+	test_emit(&prog, &opl_jmp, CALL_OPCODE, UNCONDITIONAL_JMP, 0, fn);
+	test_emit(&prog, &opl_single_reg, PRINT_OPCODE, 1, 0, ASM_NO_LABEL);
+	test_emit(&prog, &opl_noarg, HALT_OPCODE, 0, 0, ASM_NO_LABEL);
+	// .fn:
+	test_emit(&prog, &opl_ldc, LDC_OPCODE, 1, 0, table);
+	test_emit(&prog, &opl_noarg, RET_OPCODE, 0, 0, ASM_NO_LABEL);
+
+	ASSERT_EQ(asm_optimize(&prog.arena, &prog.ir, &prog.n_ir, &prog.labels, NULL, 0, NULL),
+		  (int)S_OK);
+
+	// The call is replaced by the body, the subroutine is not reachable
+	ASSERT_EQ(prog.n_ir, (size_t)3);
+	ASSERT_EQ(prog.ir[0].data.opcode, (uint32_t)LDC_OPCODE);
+	ASSERT_EQ(prog.ir[0].label_id, table);
+	ASSERT_EQ(prog.ir[1].data.opcode, (uint32_t)PRINT_OPCODE);
+
+	arena_destroy(&prog.arena);
+}
+
+TEST(TestOptimizer, TestLongJumpChain) {
+	struct test_program prog = {{0}};
+
+	ASSERT_EQ(test_program_init(&prog), (int)S_OK);
+
+	// The chain of 18 jumps is longer than the peephole follows,
+	// the layout removes the rest of it
+	test_emit(&prog, &opl_single_reg, PRINT_OPCODE, 1, 0, ASM_NO_LABEL);
+	test_emit(&prog, &opl_jmp, JMP_OPCODE, UNCONDITIONAL_JMP, 1, ASM_NO_LABEL);
+	test_emit(&prog, &opl_noarg, HALT_OPCODE, 0, 0, ASM_NO_LABEL);
+
+	for (size_t i = 0; i < 18; i++) {
+		test_emit(&prog, &opl_jmp, JMP_OPCODE, UNCONDITIONAL_JMP, 1, ASM_NO_LABEL);
+		test_emit(&prog, &opl_noarg, HALT_OPCODE, 0, 0, ASM_NO_LABEL);
+	}
+
+	test_emit(&prog, &opl_single_reg, PRINT_OPCODE, 2, 0, ASM_NO_LABEL);
+	test_emit(&prog, &opl_noarg, HALT_OPCODE, 0, 0, ASM_NO_LABEL);
+
+	ASSERT_EQ(asm_optimize(&prog.arena, &prog.ir, &prog.n_ir, &prog.labels, NULL, 0, NULL),
+		  (int)S_OK);
+
+	ASSERT_EQ(prog.n_ir, (size_t)3);
+	ASSERT_EQ(prog.ir[0].data.rdest, (spu_register_num_t)1);
+	ASSERT_EQ(prog.ir[1].data.rdest, (spu_register_num_t)2);
+	ASSERT_EQ(prog.ir[2].data.opcode, (uint32_t)HALT_OPCODE);
+
+	arena_destroy(&prog.arena);
+}
+
+TEST(TestOptimizer, TestLongJumpTarget) {
+	struct test_program prog = {{0}};
+	const spu_data_t consts[] = {7, 3};
+
+	ASSERT_EQ(test_program_init(&prog), (int)S_OK);
+
+	// The offset is in the pool, the code it jumps over is not reachable
+	test_emit(&prog, &opl_jmp, JMPL_OPCODE, UNCONDITIONAL_JMP, 1, ASM_NO_LABEL);
+	test_emit(&prog, &opl_single_reg, PRINT_OPCODE, 1, 0, ASM_NO_LABEL);
+	test_emit(&prog, &opl_single_reg, PRINT_OPCODE, 1, 0, ASM_NO_LABEL);
+	test_emit(&prog, &opl_single_reg, PRINT_OPCODE, 1, 0, ASM_NO_LABEL);
+	test_emit(&prog, &opl_single_reg, PRINT_OPCODE, 2, 0, ASM_NO_LABEL);
+	test_emit(&prog, &opl_noarg, HALT_OPCODE, 0, 0, ASM_NO_LABEL);
+
+	ASSERT_EQ(asm_optimize(&prog.arena, &prog.ir, &prog.n_ir, &prog.labels,
+			       consts, 2, NULL),
+		  (int)S_OK);
+
+	ASSERT_EQ(prog.n_ir, (size_t)2);
+	ASSERT_EQ(prog.ir[0].data.rdest, (spu_register_num_t)2);
+	ASSERT_EQ(prog.ir[1].data.opcode, (uint32_t)HALT_OPCODE);
+
+	arena_destroy(&prog.arena);
+}
+
+TEST(TestOptimizer, TestLabelsFollowRemovedCode) {
+	struct test_program prog = {{0}};
+
+	ASSERT_EQ(test_program_init(&prog), (int)S_OK);
+
+	uint32_t entry = test_label(&prog, ".entry", SPU_SECTION_CODE, 2);
+	uint32_t end = test_label(&prog, ".end", SPU_SECTION_CODE, 4);
+
+	prog.labels.labels[entry].flags |= SPU_SYMBOL_GLOBAL;
+
+	// Overwritten before it is read
+	test_emit(&prog, &opl_ldc, LDC_OPCODE, 1, 1, ASM_NO_LABEL);
+	test_emit(&prog, &opl_ldc, LDC_OPCODE, 1, 2, ASM_NO_LABEL);
+	// .entry:
+	test_emit(&prog, &opl_single_reg, PRINT_OPCODE, 1, 0, ASM_NO_LABEL);
+	test_emit(&prog, &opl_jmp, JMP_OPCODE, EQUALS_JMP, 0, entry);
+	// .end:
+	test_emit(&prog, &opl_noarg, HALT_OPCODE, 0, 0, ASM_NO_LABEL);
+
+	ASSERT_EQ(asm_optimize(&prog.arena, &prog.ir, &prog.n_ir, &prog.labels,
+			       NULL, 0, NULL),
+		  (int)S_OK);
+
+	ASSERT_EQ(prog.n_ir, (size_t)4);
+	ASSERT_EQ(prog.labels.labels[entry].instruction_ptr, (ssize_t)1);
+	ASSERT_EQ(prog.labels.labels[end].instruction_ptr, (ssize_t)3);
+	ASSERT_EQ(prog.ir[1].data.opcode, (uint32_t)PRINT_OPCODE);
+	ASSERT_EQ(prog.ir[2].label_id, entry);
+
+	arena_destroy(&prog.arena);
+}
+
+TEST(TestOptimizer, TestRegistersLiveAcrossCall) {
+	struct test_program prog = {{0}};
+
+	ASSERT_EQ(test_program_init(&prog), (int)S_OK);
+
+	// Defined in another object, may read any register
+	uint32_t ext = test_label(&prog, ".ext", SPU_SECTION_UNDEF, -1);
+
+	test_emit(&prog, &opl_ldc, LDC_OPCODE, 1, 5, ASM_NO_LABEL);
+	test_emit(&prog, &opl_jmp, CALL_OPCODE, UNCONDITIONAL_JMP, 0, ext);
+	// Nobody reads it after the call
+	test_emit(&prog, &opl_ldc, LDC_OPCODE, 2, 6, ASM_NO_LABEL);
+	test_emit(&prog, &opl_noarg, HALT_OPCODE, 0, 0, ASM_NO_LABEL);
+
+	ASSERT_EQ(asm_optimize(&prog.arena, &prog.ir, &prog.n_ir, &prog.labels,
+			       NULL, 0, NULL),
+		  (int)S_OK);
+
+	ASSERT_EQ(prog.n_ir, (size_t)3);
+	ASSERT_EQ(prog.ir[0].data.opcode, (uint32_t)LDC_OPCODE);
+	ASSERT_EQ(prog.ir[0].data.snum, (int32_t)5);
+	ASSERT_EQ(prog.ir[1].label_id, ext);
+	ASSERT_EQ(prog.ir[2].data.opcode, (uint32_t)HALT_OPCODE);
+
+	arena_destroy(&prog.arena);
+}
+
+TEST(TestOptimizer, TestJumpChain) {
+	struct test_program prog = {{0}};
+
+	ASSERT_EQ(test_program_init(&prog), (int)S_OK);
+
+	uint32_t first = test_label(&prog, ".first", SPU_SECTION_CODE, 3);
+	uint32_t last = test_label(&prog, ".last", SPU_SECTION_CODE, 5);
+
+	prog.labels.labels[first].flags |= SPU_SYMBOL_GLOBAL;
+
+	test_emit(&prog, &opl_single_reg, PRINT_OPCODE, 1, 0, ASM_NO_LABEL);
+	test_emit(&prog, &opl_jmp, JMP_OPCODE, EQUALS_JMP, 0, first);
+	test_emit(&prog, &opl_noarg, HALT_OPCODE, 0, 0, ASM_NO_LABEL);
+	// .first:
+	test_emit(&prog, &opl_jmp, JMP_OPCODE, UNCONDITIONAL_JMP, 0, last);
+	test_emit(&prog, &opl_noarg, HALT_OPCODE, 0, 0, ASM_NO_LABEL);
+	// .last:
+	test_emit(&prog, &opl_single_reg, PRINT_OPCODE, 2, 0, ASM_NO_LABEL);
+	test_emit(&prog, &opl_noarg, HALT_OPCODE, 0, 0, ASM_NO_LABEL);
+
+	ASSERT_EQ(asm_optimize(&prog.arena, &prog.ir, &prog.n_ir, &prog.labels,
+			       NULL, 0, NULL),
+		  (int)S_OK);
+
+	// The conditional jump goes to the end of the chain,
+	// the jump of the chain is removed
+	ASSERT_EQ(prog.n_ir, (size_t)5);
+	ASSERT_EQ(prog.ir[1].data.opcode, (uint32_t)JMP_OPCODE);
+	ASSERT_EQ(prog.ir[1].data.jmp_condition, (spu_register_num_t)EQUALS_JMP);
+	ASSERT_EQ(prog.ir[1].data.jmp_position, (int32_t)1);
+	ASSERT_EQ(prog.ir[3].data.opcode, (uint32_t)PRINT_OPCODE);
+	ASSERT_EQ(prog.labels.labels[first].instruction_ptr, (ssize_t)3);
+	ASSERT_EQ(prog.labels.labels[last].instruction_ptr, (ssize_t)3);
+
+	arena_destroy(&prog.arena);
+}
+
+TEST(TestOptimizer, TestFloatConditionKept) {
+	struct test_program prog = {{0}};
+
+	ASSERT_EQ(test_program_init(&prog), (int)S_OK);
+
+	uint32_t next = test_label(&prog, ".next", SPU_SECTION_CODE, 3);
+	uint32_t far = test_label(&prog, ".far", SPU_SECTION_CODE, 5);
+
+	prog.labels.labels[next].flags |= SPU_SYMBOL_GLOBAL;
+	prog.labels.labels[far].flags |= SPU_SYMBOL_GLOBAL;
+
+	test_emit(&prog, &opl_double_reg, FCMP_OPCODE, 1, 0, ASM_NO_LABEL);
+	test_emit(&prog, &opl_jmp, JMP_OPCODE, GREATER_JMP, 0, next);
+	test_emit(&prog, &opl_jmp, JMP_OPCODE, UNCONDITIONAL_JMP, 0, far);
+	// .next:
+	test_emit(&prog, &opl_single_reg, PRINT_OPCODE, 1, 0, ASM_NO_LABEL);
+	test_emit(&prog, &opl_noarg, HALT_OPCODE, 0, 0, ASM_NO_LABEL);
+	// .far:
+	test_emit(&prog, &opl_single_reg, PRINT_OPCODE, 2, 0, ASM_NO_LABEL);
+	test_emit(&prog, &opl_noarg, HALT_OPCODE, 0, 0, ASM_NO_LABEL);
+
+	ASSERT_EQ(asm_optimize(&prog.arena, &prog.ir, &prog.n_ir, &prog.labels,
+			       NULL, 0, NULL),
+		  (int)S_OK);
+
+	// jmp.leq .far would be taken by NaN, jmp.gt .next is not,
+	// so .far is moved to fall through instead
+	ASSERT_EQ(prog.n_ir, (size_t)6);
+	ASSERT_EQ(prog.ir[1].data.jmp_condition, (spu_register_num_t)GREATER_JMP);
+	ASSERT_EQ(prog.ir[1].label_id, next);
+	ASSERT_EQ(prog.ir[2].data.rdest, (spu_register_num_t)2);
+
+	arena_destroy(&prog.arena);
+}
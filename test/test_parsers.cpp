@@ -0,0 +1,49 @@
+#include <string.h>
+
+#include "test_config.h"
+
+#include "translator_parsers.h"
+
+TEST(TestParsers, TestParseInteger) {
+	int64_t num = 0;
+
+	ASSERT_EQ(parse_integer("123", 3, &num), (int)S_OK);
+	ASSERT_EQ(num, (int64_t)123);
+
+	// Only first two characters are in the token
+	ASSERT_EQ(parse_integer("123", 2, &num), (int)S_OK);
+	ASSERT_EQ(num, (int64_t)12);
+
+	ASSERT_EQ(parse_integer("-0x1F", 5, &num), (int)S_OK);
+	ASSERT_EQ(num, (int64_t)-31);
+
+	ASSERT_EQ(parse_integer("017", 3, &num), (int)S_OK);
+	ASSERT_EQ(num, (int64_t)15);
+
+	ASSERT_EQ(parse_integer("-9223372036854775808", 20, &num), (int)S_OK);
+	ASSERT_EQ(num, INT64_MIN);
+
+	ASSERT_EQ(parse_integer("9223372036854775808", 19, &num), (int)S_FAIL);
+	ASSERT_EQ(parse_integer("0x", 2, &num), (int)S_FAIL);
+	ASSERT_EQ(parse_integer("-", 1, &num), (int)S_FAIL);
+	ASSERT_EQ(parse_integer("12a", 3, &num), (int)S_FAIL);
+	ASSERT_EQ(parse_integer("08", 2, &num), (int)S_FAIL);
+}
+
+TEST(TestParsers, TestParseRegister) {
+	spu_register_num_t rn = 0;
+
+	struct asm_token tok = {"r12 r0", 3};
+	ASSERT_EQ(parse_register(&tok, &rn), (int)S_OK);
+	ASSERT_EQ((int)rn, 12);
+
+	tok = (struct asm_token) {"rsp", 3};
+	ASSERT_EQ(parse_register(&tok, &rn), (int)S_OK);
+	ASSERT_EQ((int)rn, REGISTER_RSP_CODE);
+
+	tok = (struct asm_token) {"r31", 3};
+	ASSERT_EQ(parse_register(&tok, &rn), (int)S_FAIL);
+
+	tok = (struct asm_token) {"r", 1};
+	ASSERT_EQ(parse_register(&tok, &rn), (int)S_FAIL);
+}
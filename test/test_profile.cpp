@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "test_config.h"
+
+#include "spu_bit_ops.h"
+#include "spu_profile.h"
+
+TEST(TestProfile, TestWriteRead) {
+	struct spu_profile profile = {0};
+	struct spu_profile read_profile = {0};
+	char path[] = "/tmp/spu_profile_XXXXXX";
+	int fd = mkstemp(path);
+
+	ASSERT_EQ(fd != -1, 1);
+
+	FILE *out_stream = fdopen(fd, "w");
+	ASSERT_EQ(out_stream != NULL, 1);
+
+	ASSERT_EQ(spu_profile_init(&profile, 4), (int)S_OK);
+	profile.code_hash = 0xfedcba9876543210ULL;
+	profile.counts[0] = 1;
+	profile.counts[2] = 0x123456789aULL;
+	profile.taken[2] = 0x100000000ULL;
+	profile.counts[3] = UINT64_MAX;
+	profile.taken[3] = UINT64_MAX;
+
+	ASSERT_EQ(spu_profile_write(&profile, out_stream), (int)S_OK);
+	ASSERT_EQ(fclose(out_stream), 0);
+
+	ASSERT_EQ(spu_profile_read(&read_profile, path), (int)S_OK);
+	unlink(path);
+
+	ASSERT_EQ(read_profile.n_code, profile.n_code);
+	ASSERT_EQ(read_profile.code_hash, profile.code_hash);
+
+	for (size_t ip = 0; ip < profile.n_code; ip++) {
+		ASSERT_EQ(read_profile.counts[ip], profile.counts[ip]);
+		ASSERT_EQ(read_profile.taken[ip], profile.taken[ip]);
+	}
+
+	spu_profile_destroy(&profile);
+	spu_profile_destroy(&read_profile);
+}
+
+TEST(TestProfile, TestCodeHash) {
+	struct spu_instruction code[3] = {0};
+	uint64_t hash = 0;
+	uint64_t ir_hash = SPU_PROFILE_HASH_INIT;
+
+	// The translator hashes the code before long jumps are made
+	code[0].opcode.code = JMPL_OPCODE;
+	code[1].opcode.code = LDK_OPCODE;
+	ASSERT_EQ(set_directive_opcode(PRINT_OPCODE, &code[2]), 0);
+
+	ir_hash = spu_profile_hash_opcode(ir_hash, JMP_OPCODE, 0);
+	ir_hash = spu_profile_hash_opcode(ir_hash, LDC_OPCODE, 0);
+	ir_hash = spu_profile_hash_opcode(ir_hash, PRINT_OPCODE, 1);
+
+	spu_instruction_t words[3] = {
+		code[0].instruction, code[1].instruction, code[2].instruction,
+	};
+
+	ASSERT_EQ(spu_profile_hash_code(words, 3, &hash), (int)S_OK);
+	ASSERT_EQ(hash, ir_hash);
+
+	// Directives do not collide with the instructions of the same number
+	ASSERT_EQ(spu_profile_hash_opcode(SPU_PROFILE_HASH_INIT, LDC_OPCODE, 0) ==
+		  spu_profile_hash_opcode(SPU_PROFILE_HASH_INIT, LDC_OPCODE, 1), 0);
+}
@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "test_config.h"
+
+#include "spu.h"
+
+#define TEST_MAP_ADDR (RAM_PAGE_WORDS)
+#define TEST_FILE_WORDS (16)
+
+static int test_write_words(char *path, size_t n_words) {
+	int fd = mkstemp(path);
+
+	if (fd == -1) {
+		return S_FAIL;
+	}
+
+	for (size_t i = 0; i < n_words; i++) {
+		int64_t word = (int64_t)i * 3 + 1;
+
+		if (write(fd, &word, sizeof(word)) != (ssize_t)sizeof(word)) {
+			close(fd);
+			return S_FAIL;
+		}
+	}
+
+	close(fd);
+	return S_OK;
+}
+
+TEST(TestRam, TestReadonlyMap) {
+	char path[] = "/tmp/spu_ram_XXXXXX";
+	struct spu_instr_data instr = {0};
+
+	ASSERT_EQ(test_write_words(path, TEST_FILE_WORDS), (int)S_OK);
+
+	SPUCreate(ctx);
+
+	ASSERT_EQ(SPUMapFile(&ctx, path, TEST_MAP_ADDR, 1), (int)S_OK);
+	unlink(path);
+
+	ASSERT_EQ(spu_ram_writable(&ctx, TEST_MAP_ADDR - 1, 1), 1);
+	ASSERT_EQ(spu_ram_writable(&ctx, TEST_MAP_ADDR - 1, 2), 0);
+	ASSERT_EQ(spu_ram_writable(&ctx, TEST_MAP_ADDR + RAM_PAGE_WORDS, 1), 1);
+
+	// ldm sees the file, stm is refused
+	ctx.registers[1] = TEST_MAP_ADDR + 2;
+	instr = (struct spu_instr_data) {.opcode = LDM_OPCODE, .rdest = 1, .rsrc1 = 2};
+	ASSERT_EQ(ram_exec(&ctx, instr), (int)S_OK);
+	ASSERT_EQ(ctx.registers[2], (int64_t)7);
+
+	instr.opcode = STM_OPCODE;
+	ASSERT_EQ(ram_exec(&ctx, instr), (int)S_FAIL);
+	ASSERT_EQ(ctx.ram[TEST_MAP_ADDR + 2], (int64_t)7);
+
+	// The next page is not mapped
+	ctx.registers[1] = TEST_MAP_ADDR + RAM_PAGE_WORDS;
+	ASSERT_EQ(ram_exec(&ctx, instr), (int)S_OK);
+
+	// mset ending in the mapping
+	ctx.registers[1] = TEST_MAP_ADDR - 4;
+	ctx.registers[2] = 0;
+	ctx.registers[3] = 5;
+	instr = (struct spu_instr_data) {
+		.opcode = MSET_OPCODE, .rdest = 1, .rsrc1 = 2, .rsrc2 = 3,
+	};
+	ASSERT_EQ(ram_bulk_exec(&ctx, instr), (int)S_FAIL);
+	ASSERT_EQ(ctx.ram[TEST_MAP_ADDR], (int64_t)1);
+
+	ctx.registers[3] = 4;
+	ASSERT_EQ(ram_bulk_exec(&ctx, instr), (int)S_OK);
+
+	// Bytes and bits of the mapping
+	ctx.registers[1] = 0;
+	ctx.registers[2] = TEST_MAP_ADDR * 8 - 2;
+	instr = (struct spu_instr_data) {
+		.opcode = STW_OPCODE, .rdest = 1, .rsrc1 = 2, .rsrc2 = MEM_NO_INDEX,
+	};
+	ASSERT_EQ(ram_byte_exec(&ctx, instr), (int)S_FAIL);
+	instr.opcode = STB_OPCODE;
+	ASSERT_EQ(ram_byte_exec(&ctx, instr), (int)S_OK);
+
+	ctx.registers[1] = TEST_MAP_ADDR - 1;
+	ctx.registers[2] = 64;
+	instr = (struct spu_instr_data) {.opcode = BSET_OPCODE, .rdest = 1, .rsrc1 = 2};
+	ASSERT_EQ(ram_bit_exec(&ctx, instr), (int)S_FAIL);
+	instr.opcode = BTST_OPCODE;
+	ASSERT_EQ(ram_bit_exec(&ctx, instr), (int)S_OK);
+	ASSERT_EQ(ctx.RFLAGS, (spu_data_t)CMP_EQ_FLAG);
+
+	// Refused before stdin is read
+	ctx.registers[1] = 16;
+	ctx.registers[2] = STDIN_FILENO;
+	ctx.registers[3] = TEST_MAP_ADDR;
+	instr = (struct spu_instr_data) {
+		.opcode = READ_OPCODE, .rdest = 1, .rsrc1 = 2, .rsrc2 = 3,
+	};
+	ASSERT_EQ(ram_stream_exec(&ctx, instr), (int)S_FAIL);
+	ASSERT_EQ(ctx.registers[1], (int64_t)16);
+
+	SPUDtor(&ctx);
+}
+
+TEST(TestRam, TestMapRejected) {
+	char path[] = "/tmp/spu_ram_XXXXXX";
+
+	// One word past the last page of the RAM
+	ASSERT_EQ(test_write_words(path, RAM_PAGE_WORDS + 1), (int)S_OK);
+
+	SPUCreate(ctx);
+
+	ASSERT_EQ(SPUMapFile(&ctx, path, TEST_MAP_ADDR + 1, 1), (int)S_FAIL);
+	ASSERT_EQ(SPUMapFile(&ctx, path, RAM_SIZE - RAM_PAGE_WORDS, 1), (int)S_FAIL);
+	ASSERT_EQ(SPUMapFile(&ctx, path, RAM_SIZE + RAM_PAGE_WORDS, 1), (int)S_FAIL);
+	ASSERT_EQ(ctx.n_ro_pages, (size_t)0);
+
+	ASSERT_EQ(SPUMapFile(&ctx, path, RAM_SIZE - 2 * RAM_PAGE_WORDS, 1), (int)S_OK);
+	ASSERT_EQ(ctx.n_ro_pages, (size_t)2);
+	unlink(path);
+
+	SPUDtor(&ctx);
+}
+
+static int test_byte_access(struct spu_context *ctx, uint32_t opcode,
+			    int64_t byte_addr) {
+	struct spu_instr_data instr = {
+		.opcode = opcode, .rdest = 1, .rsrc1 = 2, .rsrc2 = MEM_NO_INDEX,
+	};
+
+	ctx->registers[2] = byte_addr;
+
+	return ram_byte_exec(ctx, instr);
+}
+
+static int test_bit_access(struct spu_context *ctx, uint32_t opcode,
+			   int64_t word_addr, int64_t bit) {
+	struct spu_instr_data instr = {.opcode = opcode, .rdest = 1, .rsrc1 = 2};
+
+	ctx->registers[1] = word_addr;
+	ctx->registers[2] = bit;
+
+	return ram_bit_exec(ctx, instr);
+}
+
+TEST(TestRam, TestByteAccess) {
+	const int64_t ram_bytes = RAM_SIZE * (int64_t)sizeof(int64_t);
+
+	SPUCreate(ctx);
+
+	// The last byte of the RAM, zero-extended
+	ctx.registers[1] = -1;
+	ASSERT_EQ(test_byte_access(&ctx, STB_OPCODE, ram_bytes - 1), (int)S_OK);
+	ASSERT_EQ(test_byte_access(&ctx, LDB_OPCODE, ram_bytes - 1), (int)S_OK);
+	ASSERT_EQ(ctx.registers[1], (int64_t)0xFF);
+	ASSERT_EQ(test_byte_access(&ctx, LDB_OPCODE, ram_bytes), (int)S_FAIL);
+	ASSERT_EQ(test_byte_access(&ctx, LDB_OPCODE, -1), (int)S_FAIL);
+
+	// 32-bit accesses do not run past the end
+	ASSERT_EQ(test_byte_access(&ctx, LDW_OPCODE, ram_bytes - 4), (int)S_OK);
+	ASSERT_EQ(test_byte_access(&ctx, LDW_OPCODE, ram_bytes - 3), (int)S_FAIL);
+	ASSERT_EQ(test_byte_access(&ctx, STW_OPCODE, ram_bytes - 3), (int)S_FAIL);
+
+	// Across the words 10 and 11, sign-extended
+	ctx.registers[1] = (int64_t)0x81828384;
+	ASSERT_EQ(test_byte_access(&ctx, STW_OPCODE, 10 * 8 + 6), (int)S_OK);
+	ASSERT_EQ(ctx.ram[10], (int64_t)0x8384000000000000ULL);
+	ASSERT_EQ(ctx.ram[11], (int64_t)0x8182);
+	ASSERT_EQ(test_byte_access(&ctx, LDW_OPCODE, 10 * 8 + 6), (int)S_OK);
+	ASSERT_EQ(ctx.registers[1], (int64_t)(int32_t)0x81828384);
+	ASSERT_EQ(test_byte_access(&ctx, LDB_OPCODE, 11 * 8 + 1), (int)S_OK);
+	ASSERT_EQ(ctx.registers[1], (int64_t)0x81);
+
+	SPUDtor(&ctx);
+}
+
+TEST(TestRam, TestBitAccess) {
+	SPUCreate(ctx);
+
+	// Bits past the word go to the next words
+	ASSERT_EQ(test_bit_access(&ctx, BSET_OPCODE, 10, 3 * 64 + 5), (int)S_OK);
+	ASSERT_EQ(ctx.ram[13], (int64_t)0x20);
+	ASSERT_EQ(test_bit_access(&ctx, BTST_OPCODE, 13, 5), (int)S_OK);
+	ASSERT_EQ(ctx.RFLAGS, (spu_data_t)CMP_EQ_FLAG);
+	ASSERT_EQ(test_bit_access(&ctx, BCLR_OPCODE, 12, 64 + 5), (int)S_OK);
+	ASSERT_EQ(ctx.ram[13], (int64_t)0);
+	ASSERT_EQ(test_bit_access(&ctx, BTST_OPCODE, 13, 5), (int)S_OK);
+	ASSERT_EQ(ctx.RFLAGS, (spu_data_t)CMP_SIGN_FLAG);
+
+	ASSERT_EQ(test_bit_access(&ctx, BSET_OPCODE, RAM_SIZE - 1, 63), (int)S_OK);
+	ASSERT_EQ(ctx.ram[RAM_SIZE - 1], INT64_MIN);
+	ASSERT_EQ(test_bit_access(&ctx, BSET_OPCODE, RAM_SIZE - 1, 64), (int)S_FAIL);
+	ASSERT_EQ(test_bit_access(&ctx, BSET_OPCODE, 0, -1), (int)S_FAIL);
+	ASSERT_EQ(test_bit_access(&ctx, BTST_OPCODE, RAM_SIZE, 0), (int)S_FAIL);
+
+	SPUDtor(&ctx);
+}
+
+static int test_bulk(struct spu_context *ctx, uint32_t opcode,
+		     int64_t dst, int64_t src, int64_t len) {
+	struct spu_instr_data instr = {
+		.opcode = opcode, .rdest = 1, .rsrc1 = 2, .rsrc2 = 3,
+	};
+
+	ctx->registers[1] = dst;
+	ctx->registers[2] = src;
+	ctx->registers[3] = len;
+
+	return ram_bulk_exec(ctx, instr);
+}
+
+TEST(TestRam, TestBulk) {
+	SPUCreate(ctx);
+
+	// Not a repeated byte, filled word by word
+	ASSERT_EQ(test_bulk(&ctx, MSET_OPCODE, 10, 0x0102030405060708LL, 3), (int)S_OK);
+	ASSERT_EQ(ctx.ram[9], (int64_t)0);
+	ASSERT_EQ(ctx.ram[12], (int64_t)0x0102030405060708LL);
+	ASSERT_EQ(ctx.ram[13], (int64_t)0);
+
+	ASSERT_EQ(test_bulk(&ctx, MSET_OPCODE, 20, -1, 2), (int)S_OK);
+	ASSERT_EQ(ctx.ram[21], (int64_t)-1);
+	ASSERT_EQ(ctx.ram[22], (int64_t)0);
+
+	ASSERT_EQ(test_bulk(&ctx, MSET_OPCODE, RAM_SIZE, 1, 0), (int)S_OK);
+	ASSERT_EQ(test_bulk(&ctx, MSET_OPCODE, RAM_SIZE - 1, 1, 2), (int)S_FAIL);
+	ASSERT_EQ(test_bulk(&ctx, MSET_OPCODE, 0, 1, -1), (int)S_FAIL);
+
+	// Overlapping copy to the higher address
+	ASSERT_EQ(test_bulk(&ctx, MCPY_OPCODE, 11, 10, 3), (int)S_OK);
+	ASSERT_EQ(ctx.ram[11], (int64_t)0x0102030405060708LL);
+	ASSERT_EQ(ctx.ram[13], (int64_t)0x0102030405060708LL);
+	ASSERT_EQ(test_bulk(&ctx, MCPY_OPCODE, 0, RAM_SIZE - 1, 2), (int)S_FAIL);
+
+	// Words compare as signed, the first difference decides
+	ctx.ram[30] = -1;
+	ctx.ram[40] = 1;
+	ASSERT_EQ(test_bulk(&ctx, MCMP_OPCODE, 30, 40, 1), (int)S_OK);
+	ASSERT_EQ(ctx.RFLAGS, (spu_data_t)CMP_SIGN_FLAG);
+	ASSERT_EQ(test_bulk(&ctx, MCMP_OPCODE, 40, 30, 1), (int)S_OK);
+	ASSERT_EQ(ctx.RFLAGS, (spu_data_t)0);
+	ASSERT_EQ(test_bulk(&ctx, MCMP_OPCODE, 31, 41, 5), (int)S_OK);
+	ASSERT_EQ(ctx.RFLAGS, (spu_data_t)CMP_EQ_FLAG);
+	ASSERT_EQ(test_bulk(&ctx, MCMP_OPCODE, 29, 39, 3), (int)S_OK);
+	ASSERT_EQ(ctx.RFLAGS, (spu_data_t)CMP_SIGN_FLAG);
+
+	SPUDtor(&ctx);
+}
@@ -0,0 +1,60 @@
+#include <string.h>
+
+#include "test_config.h"
+
+#include "spu_vector.h"
+
+#define TEST_VEC_LEN (37)
+
+static void fill_test_vector(int64_t *vec, size_t len, uint64_t seed) {
+	for (size_t i = 0; i < len; i++) {
+		seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+		vec[i] = (int64_t)seed;
+	}
+
+	// Extremes of the signed range
+	vec[0] = INT64_MIN;
+	vec[1] = INT64_MAX;
+}
+
+TEST(TestVector, TestKernelsMatchScalar) {
+	const struct spu_vec_kernels *scalar = spu_vec_kernels_get(SPU_VEC_SCALAR);
+
+	int64_t lhs[TEST_VEC_LEN] = {0};
+	int64_t rhs[TEST_VEC_LEN] = {0};
+	int64_t expected[TEST_VEC_LEN] = {0};
+	int64_t result[TEST_VEC_LEN] = {0};
+
+	fill_test_vector(lhs, TEST_VEC_LEN, 1);
+	fill_test_vector(rhs, TEST_VEC_LEN, 2);
+
+	ASSERT_EQ(spu_vec_kernels_best() != NULL, 1);
+	ASSERT_EQ(scalar != NULL, 1);
+
+	for (int isa = 0; isa < SPU_VEC_N_ISA; isa++) {
+		const struct spu_vec_kernels *kernels =
+			spu_vec_kernels_get((enum spu_vec_isa)isa);
+
+		if (!kernels) {
+			continue;
+		}
+
+		for (size_t len = 0; len <= TEST_VEC_LEN; len++) {
+#define CHECK_BINARY(op)							\
+			scalar->op(expected, lhs, rhs, len);			\
+			memset(result, 0, sizeof(result));			\
+			kernels->op(result, lhs, rhs, len);			\
+			ASSERT_EQ(memcmp(expected, result, len * sizeof(*result)), 0);
+
+			CHECK_BINARY(add);
+			CHECK_BINARY(sub);
+			CHECK_BINARY(mul);
+			CHECK_BINARY(min);
+			CHECK_BINARY(max);
+#undef CHECK_BINARY
+
+			ASSERT_EQ(kernels->dot(lhs, rhs, len), scalar->dot(lhs, rhs, len));
+			ASSERT_EQ(kernels->sum(lhs, len), scalar->sum(lhs, len));
+		}
+	}
+}